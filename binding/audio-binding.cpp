@@ -20,6 +20,7 @@
 */
 
 #include "audio.h"
+#include "soundemitter.h"
 #include "sharedstate.h"
 #include "binding-util.h"
 #include "exception.h"
@@ -157,6 +158,51 @@ DEF_FADE( me )
 
 DEF_PLAY_STOP( se )
 
+static void sePreloadEach(VALUE name)
+{
+	if (RB_TYPE_P(name, RUBY_T_ARRAY))
+	{
+		for (long i = 0; i < RARRAY_LEN(name); ++i)
+			sePreloadEach(rb_ary_entry(name, i));
+
+		return;
+	}
+
+	SafeStringValue(name);
+	shState->audio().sePreload(RSTRING_PTR(name));
+}
+
+RB_METHOD(audio_sePreload)
+{
+	RB_UNUSED_PARAM;
+
+	for (int i = 0; i < argc; ++i)
+		sePreloadEach(argv[i]);
+
+	return Qnil;
+}
+
+RB_METHOD(audio_seCacheStats)
+{
+	RB_UNUSED_PARAM;
+
+	rb_check_argc(argc, 0);
+
+	SECacheStats stats;
+	shState->audio().seCacheStats(stats);
+
+	VALUE ret = rb_hash_new();
+	rb_hash_aset(ret, ID2SYM(rb_intern("hits")), ULL2NUM(stats.hits));
+	rb_hash_aset(ret, ID2SYM(rb_intern("misses")), ULL2NUM(stats.misses));
+	rb_hash_aset(ret, ID2SYM(rb_intern("evictions")), ULL2NUM(stats.evictions));
+	rb_hash_aset(ret, ID2SYM(rb_intern("entries")), SIZET2NUM(stats.entries));
+	rb_hash_aset(ret, ID2SYM(rb_intern("size")), SIZET2NUM(stats.size));
+	rb_hash_aset(ret, ID2SYM(rb_intern("capacity")), SIZET2NUM(stats.capacity));
+	rb_hash_aset(ret, ID2SYM(rb_intern("pending")), SIZET2NUM(stats.pending));
+
+	return ret;
+}
+
 RB_METHOD(audioSetupMidi)
 {
 	RB_UNUSED_PARAM;
@@ -208,6 +254,8 @@ audioBindingInit()
 	_rb_define_module_function(module, "setup_midi", audioSetupMidi);
 
 	BIND_PLAY_STOP( se )
+	_rb_define_module_function(module, "se_preload", audio_sePreload);
+	_rb_define_module_function(module, "se_cache_stats", audio_seCacheStats);
 
 	_rb_define_module_function(module, "__reset__", audioReset);
 }
@@ -21,6 +21,7 @@
 
 #include "audio/audio.h"
 #include "filesystem/filesystem.h"
+#include "filesystem/datawriter.h"
 #include "display/graphics.h"
 #include "display/font.h"
 #include "system/system.h"
@@ -54,6 +55,7 @@ extern "C" {
 #include "binding-mri-win32.h"
 #endif
 
+#include <algorithm>
 #include <assert.h>
 #include <string>
 #include <zlib.h>
@@ -62,6 +64,7 @@ extern "C" {
 #include <SDL_filesystem.h>
 #include <SDL_loadso.h>
 #include <SDL_power.h>
+#include <SDL_timer.h>
 
 extern const char module_rpg1[];
 extern const char module_rpg2[];
@@ -884,6 +887,275 @@ bool evalScript(VALUE string, const char *filename)
 
 #define SCRIPT_SECTION_FMT (rgssVer >= 3 ? "{%04ld}" : "Section%03ld")
 
+static int scriptSectionName(long i, const char *scriptName, char *buf, size_t size) {
+    if (shState->config().useScriptNames)
+        return snprintf(buf, size, "%03ld:%s", i, scriptName);
+    
+    return snprintf(buf, size, SCRIPT_SECTION_FMT, i);
+}
+
+#if RAPI_FULL >= 260
+#define SCRIPT_CACHE_FILE "ScriptCache.dat"
+/* Bump whenever the layout of the cache file changes */
+#define SCRIPT_CACHE_VERSION 1
+
+struct FuncallArg {
+    VALUE recv;
+    ID mid;
+    int argc;
+    const VALUE *argv;
+};
+
+static VALUE funcallHelper(FuncallArg *arg) {
+    return rb_funcall2(arg->recv, arg->mid, arg->argc, const_cast<VALUE *>(arg->argv));
+}
+
+/* Returns Qnil (and clears $!) if the call raised */
+static VALUE tryFuncall(VALUE recv, const char *method, int argc, const VALUE *argv) {
+    FuncallArg arg = {recv, rb_intern(method), argc, argv};
+    int state;
+    
+    VALUE ret = rb_protect((VALUE(*)(VALUE))funcallHelper, (VALUE)&arg, &state);
+    
+    if (state) {
+        rb_set_errinfo(Qnil);
+        return Qnil;
+    }
+    
+    return ret;
+}
+
+static VALUE evalISeq(VALUE iseq, int *state) {
+    FuncallArg arg = {iseq, rb_intern("eval"), 0, 0};
+    return rb_protect((VALUE(*)(VALUE))funcallHelper, (VALUE)&arg, state);
+}
+
+/* Returns an array holding the compiled InstructionSequence of
+ * every script section, loaded from the on-disk cache where
+ * possible. Sections that fail to compile are left nil, so
+ * evaluating them from source raises the error at the usual time. */
+static VALUE prepareScriptCache(VALUE scriptArray, long scriptCount) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    
+    const std::string path = shState->config().customDataPath + "/" SCRIPT_CACHE_FILE;
+    VALUE iseqClass = rb_path2class("RubyVM::InstructionSequence");
+    VALUE marshal = rb_const_get(rb_cObject, rb_intern("Marshal"));
+    
+    /* Any change to the script pack drops the whole cache,
+     * so stale sections don't pile up in it */
+    uLong packStamp = crc32(0, Z_NULL, 0);
+    
+    for (long i = 0; i < scriptCount; ++i) {
+        VALUE script = rb_ary_entry(scriptArray, i);
+        
+        if (!RB_TYPE_P(script, RUBY_T_ARRAY))
+            continue;
+        
+        VALUE compressed = rb_ary_entry(script, 2);
+        
+        if (RB_TYPE_P(compressed, RUBY_T_STRING))
+            packStamp = crc32(packStamp, reinterpret_cast<const Bytef *>(RSTRING_PTR(compressed)),
+                              RSTRING_LEN(compressed));
+    }
+    
+    VALUE header = rb_ary_new();
+    rb_ary_push(header, INT2FIX(SCRIPT_CACHE_VERSION));
+    rb_ary_push(header, rb_const_get(rb_cObject, rb_intern("RUBY_VERSION")));
+    rb_ary_push(header, rb_const_get(rb_cObject, rb_intern("RUBY_PLATFORM")));
+    rb_ary_push(header, ULONG2NUM(packStamp));
+    
+    VALUE cached = Qnil;
+    std::string cacheData;
+    
+    if (readFileSDL(path.c_str(), cacheData)) {
+        VALUE str = rb_str_new(cacheData.c_str(), cacheData.size());
+        VALUE loaded = tryFuncall(marshal, "load", 1, &str);
+        
+        if (RB_TYPE_P(loaded, RUBY_T_ARRAY) && RARRAY_LEN(loaded) == 2 &&
+            rb_equal(rb_ary_entry(loaded, 0), header) &&
+            RB_TYPE_P(rb_ary_entry(loaded, 1), RUBY_T_HASH))
+            cached = rb_ary_entry(loaded, 1);
+    }
+    
+    VALUE entries = rb_hash_new();
+    VALUE iseqs = rb_ary_new2(scriptCount);
+    long hits = 0, misses = 0;
+    
+    for (long i = 0; i < scriptCount; ++i) {
+        VALUE script = rb_ary_entry(scriptArray, i);
+        
+        if (!RB_TYPE_P(script, RUBY_T_ARRAY))
+            continue;
+        
+        VALUE decoded = rb_ary_entry(script, 3);
+        
+        if (!RB_TYPE_P(decoded, RUBY_T_STRING))
+            continue;
+        
+        const Bytef *source = reinterpret_cast<const Bytef *>(RSTRING_PTR(decoded));
+        long sourceLen = RSTRING_LEN(decoded);
+        
+        char buf[512];
+        int len = scriptSectionName(i, RSTRING_PTR(rb_ary_entry(script, 1)), buf, sizeof(buf));
+        len = std::min<int>(len, sizeof(buf) - 1);
+        
+        /* The section name ends up in the compiled code */
+        char keyBuf[64];
+        snprintf(keyBuf, sizeof(keyBuf), "|%ld|%08lx|%08lx", sourceLen,
+                 crc32(crc32(0, Z_NULL, 0), source, sourceLen),
+                 adler32(adler32(0, Z_NULL, 0), source, sourceLen));
+        
+        VALUE key = rb_str_new(buf, len);
+        rb_str_cat2(key, keyBuf);
+        
+        VALUE binary = (cached != Qnil) ? rb_hash_aref(cached, key) : Qnil;
+        VALUE iseq = Qnil;
+        
+        if (RB_TYPE_P(binary, RUBY_T_STRING))
+            iseq = tryFuncall(iseqClass, "load_from_binary", 1, &binary);
+        
+        if (iseq != Qnil) {
+            ++hits;
+        } else {
+            VALUE fname = newStringUTF8(buf, len);
+            VALUE args[] = {newStringUTF8(RSTRING_PTR(decoded), sourceLen), fname, fname, INT2FIX(1)};
+            
+            iseq = tryFuncall(iseqClass, "compile", ARRAY_SIZE(args), args);
+            
+            if (iseq == Qnil)
+                continue;
+            
+            binary = tryFuncall(iseq, "to_binary", 0, 0);
+            ++misses;
+        }
+        
+        if (binary != Qnil)
+            rb_hash_aset(entries, key, binary);
+        
+        rb_ary_store(iseqs, i, iseq);
+    }
+    
+    if (misses > 0 || cached == Qnil) {
+        VALUE contents = rb_ary_new();
+        rb_ary_push(contents, header);
+        rb_ary_push(contents, entries);
+        
+        VALUE dump = tryFuncall(marshal, "dump", 1, &contents);
+        
+        /* Replace the cache atomically, so a crash mid-write
+         * can't leave a truncated cache behind */
+        std::string error;
+        
+        if (!RB_TYPE_P(dump, RUBY_T_STRING))
+            Debug() << "Failed to serialize script cache";
+        else if (DataWriter::writeFile(RSTRING_PTR(dump), RSTRING_LEN(dump), path.c_str(), error) != 0)
+            Debug() << "Failed to write script cache:" << error;
+    }
+    
+    double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    Debug() << "Script cache:" << hits << "sections loaded," << misses << "compiled in" << ms << "ms";
+    
+    return iseqs;
+}
+#endif
+
+/* zlib streams don't record their inflated size, so instead
+ * of guessing and re-inflating the whole section on Z_BUF_ERROR,
+ * inflate incrementally and grow the buffer as needed */
+static int inflateScript(const unsigned char *source, unsigned long sourceLen,
+                         std::string &out) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    
+    int result = inflateInit(&stream);
+    
+    if (result != Z_OK)
+        return result;
+    
+    /* Script sources usually compress 3-5x */
+    out.resize(std::max<size_t>(sourceLen * 4, 0x1000));
+    
+    stream.next_in = const_cast<Bytef *>(source);
+    stream.avail_in = sourceLen;
+    
+    while (true) {
+        stream.next_out = reinterpret_cast<Bytef *>(&out[stream.total_out]);
+        stream.avail_out = out.size() - stream.total_out;
+        
+        result = inflate(&stream, Z_NO_FLUSH);
+        
+        if (result == Z_STREAM_END) {
+            result = Z_OK;
+            break;
+        }
+        
+        if (result != Z_OK && result != Z_BUF_ERROR)
+            break;
+        
+        /* Out of input before the end of the stream */
+        if (stream.avail_out > 0) {
+            result = Z_DATA_ERROR;
+            break;
+        }
+        
+        out.resize(out.size() * 2);
+    }
+    
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    
+    return result;
+}
+
+struct ScriptInflater {
+    struct Job {
+        const unsigned char *source;
+        unsigned long sourceLen;
+        
+        std::string result;
+        int status;
+    };
+    
+    std::vector<Job> jobs;
+    SDL_atomic_t nextJob;
+    
+    /* Runs on the Ruby thread as well as on the helper threads,
+     * so it must not touch any Ruby objects */
+    void worker() {
+        while (true) {
+            int i = SDL_AtomicAdd(&nextJob, 1);
+            
+            if (i >= (int)jobs.size())
+                break;
+            
+            Job &job = jobs[i];
+            job.status = inflateScript(job.source, job.sourceLen, job.result);
+        }
+    }
+    
+    void run() {
+        SDL_AtomicSet(&nextJob, 0);
+        
+        int threadCount = std::min<int>(SDL_GetCPUCount(), 8) - 1;
+        threadCount = std::min<int>(threadCount, jobs.size() / 16);
+        
+        std::vector<SDL_Thread *> threads;
+        
+        for (int i = 0; i < threadCount; ++i) {
+            SDL_Thread *thread =
+            createSDLThread<ScriptInflater, &ScriptInflater::worker>(this, "scriptinflate");
+            
+            if (thread)
+                threads.push_back(thread);
+        }
+        
+        worker();
+        
+        for (size_t i = 0; i < threads.size(); ++i)
+            SDL_WaitThread(threads[i], 0);
+    }
+};
+
 static void runRMXPScripts(BacktraceData &btData) {
     const Config &conf = shState->rtData().config;
     const std::string &scriptPack = conf.game.scripts;
@@ -918,8 +1190,12 @@ static void runRMXPScripts(BacktraceData &btData) {
     
     long scriptCount = RARRAY_LEN(scriptArray);
     
-    std::string decodeBuffer;
-    decodeBuffer.resize(0x1000);
+    Uint64 inflateStart = SDL_GetPerformanceCounter();
+    
+    /* Gather the compressed sections first; the inflater threads
+     * only see raw pointers into the (GC-rooted) source strings */
+    ScriptInflater inflater;
+    std::vector<long> jobScripts;
     
     for (long i = 0; i < scriptCount; ++i) {
         VALUE script = rb_ary_entry(scriptArray, i);
@@ -927,32 +1203,27 @@ static void runRMXPScripts(BacktraceData &btData) {
         if (!RB_TYPE_P(script, RUBY_T_ARRAY))
             continue;
         
-        VALUE scriptName = rb_ary_entry(script, 1);
         VALUE scriptString = rb_ary_entry(script, 2);
         
-        int result = Z_OK;
-        unsigned long bufferLen;
+        ScriptInflater::Job job;
+        job.source = reinterpret_cast<const unsigned char *>(RSTRING_PTR(scriptString));
+        job.sourceLen = RSTRING_LEN(scriptString);
+        job.status = Z_OK;
         
-        while (true) {
-            unsigned char *bufferPtr = reinterpret_cast<unsigned char *>(
-                                                                         const_cast<char *>(decodeBuffer.c_str()));
-            const unsigned char *sourcePtr =
-            reinterpret_cast<const unsigned char *>(RSTRING_PTR(scriptString));
-            
-            bufferLen = decodeBuffer.length();
-            
-            result = uncompress(bufferPtr, &bufferLen, sourcePtr,
-                                RSTRING_LEN(scriptString));
-            
-            bufferPtr[bufferLen] = '\0';
-            
-            if (result != Z_BUF_ERROR)
-                break;
-            
-            decodeBuffer.resize(decodeBuffer.size() * 2);
-        }
+        inflater.jobs.push_back(job);
+        jobScripts.push_back(i);
+    }
+    
+    inflater.run();
+    
+    for (size_t j = 0; j < inflater.jobs.size(); ++j) {
+        long i = jobScripts[j];
+        VALUE script = rb_ary_entry(scriptArray, i);
+        const ScriptInflater::Job &job = inflater.jobs[j];
         
-        if (result != Z_OK) {
+        if (job.status != Z_OK) {
+            VALUE scriptName = rb_ary_entry(script, 1);
+            
             static char buffer[256];
             snprintf(buffer, sizeof(buffer), "Error decoding script %ld: '%s'", i,
                      RSTRING_PTR(scriptName));
@@ -962,9 +1233,20 @@ static void runRMXPScripts(BacktraceData &btData) {
             break;
         }
         
-        rb_ary_store(script, 3, rb_utf8_str_new_cstr(decodeBuffer.c_str()));
+        rb_ary_store(script, 3, rb_utf8_str_new_cstr(job.result.c_str()));
     }
     
+    double inflateMs = (SDL_GetPerformanceCounter() - inflateStart) * 1000.0 /
+                       SDL_GetPerformanceFrequency();
+    Debug() << "Inflated" << inflater.jobs.size() << "script sections in" << inflateMs << "ms";
+    
+#if RAPI_FULL >= 260
+    VALUE iseqs = Qnil;
+    
+    if (conf.scriptCache)
+        iseqs = prepareScriptCache(scriptArray, scriptCount);
+#endif
+    
     /* Execute preloaded scripts */
     for (std::vector<std::string>::const_iterator i = conf.preloadScripts.begin();
          i != conf.preloadScripts.end(); ++i)
@@ -984,12 +1266,7 @@ static void runRMXPScripts(BacktraceData &btData) {
             VALUE fname;
             const char *scriptName = RSTRING_PTR(rb_ary_entry(script, 1));
             char buf[512];
-            int len;
-            
-            if (conf.useScriptNames)
-                len = snprintf(buf, sizeof(buf), "%03ld:%s", i, scriptName);
-            else
-                len = snprintf(buf, sizeof(buf), SCRIPT_SECTION_FMT, i);
+            int len = scriptSectionName(i, scriptName, buf, sizeof(buf));
             
             fname = newStringUTF8(buf, len);
             btData.scriptNames.insert(buf, scriptName);
@@ -1021,6 +1298,13 @@ static void runRMXPScripts(BacktraceData &btData) {
             
             int state;
             
+#if RAPI_FULL >= 260
+            VALUE iseq = (iseqs != Qnil) ? rb_ary_entry(iseqs, i) : Qnil;
+            
+            if (iseq != Qnil)
+                evalISeq(iseq, &state);
+            else
+#endif
             evalString(string, fname, &state);
             if (state)
                 break;
@@ -1032,6 +1316,10 @@ static void runRMXPScripts(BacktraceData &btData) {
         
         processReset();
     }
+    
+#if RAPI_FULL >= 260
+    RB_GC_GUARD(iseqs);
+#endif
 }
 
 static void showExc(VALUE exc, const BacktraceData &btData) {
@@ -22,6 +22,7 @@
 #include "binding-types.h"
 #include "binding-util.h"
 #include "bitmap.h"
+#include "bitmaploader.h"
 #include "disposable-binding.h"
 #include "exception.h"
 #include "font.h"
@@ -395,6 +396,21 @@ RB_METHOD(bitmapRadialBlur) {
     return Qnil;
 }
 
+RB_METHOD(bitmapSaveToFileAsync) {
+    RB_UNUSED_PARAM;
+    
+    VALUE str;
+    rb_scan_args(argc, argv, "1", &str);
+    SafeStringValue(str);
+    
+    Bitmap *b = getPrivateData<Bitmap>(self);
+    
+    int handle = 0;
+    GFX_GUARD_EXC(handle = b->saveToFileAsync(RSTRING_PTR(str)););
+    
+    return INT2NUM(handle);
+}
+
 RB_METHOD(bitmapGetRawData) {
     RB_UNUSED_PARAM;
     
@@ -715,6 +731,70 @@ RB_METHOD(bitmapGetMaxSize){
     return INT2NUM(Bitmap::maxSize());
 }
 
+RB_METHOD(bitmapPrefetch) {
+    RB_UNUSED_PARAM;
+    
+    for (int i = 0; i < argc; ++i) {
+        VALUE path = argv[i];
+        shState->bitmapLoader().prefetch(StringValueCStr(path));
+    }
+    
+    return Qnil;
+}
+
+/* Drops prefetched images that won't be needed after all;
+ * without arguments, all of them */
+RB_METHOD(bitmapReleasePrefetched) {
+    RB_UNUSED_PARAM;
+    
+    if (argc == 0)
+        shState->bitmapLoader().releaseAll();
+    
+    for (int i = 0; i < argc; ++i) {
+        VALUE path = argv[i];
+        shState->bitmapLoader().release(StringValueCStr(path));
+    }
+    
+    return Qnil;
+}
+
+RB_METHOD(bitmapLoadAsync) {
+    RB_UNUSED_PARAM;
+    
+    char *filename;
+    rb_get_args(argc, argv, "z", &filename RB_ARG_END);
+    
+    return rb_bool_new(shState->bitmapLoader().prefetch(filename));
+}
+
+RB_METHOD(bitmapLoadReady) {
+    RB_UNUSED_PARAM;
+    
+    char *filename;
+    rb_get_args(argc, argv, "z", &filename RB_ARG_END);
+    
+    return rb_bool_new(shState->bitmapLoader().isReady(filename));
+}
+
+RB_METHOD(bitmapCacheStats) {
+    RB_UNUSED_PARAM;
+    
+    rb_check_argc(argc, 0);
+    
+    BitmapCacheStats stats;
+    shState->bitmapLoader().getCacheStats(stats);
+    
+    VALUE ret = rb_hash_new();
+    rb_hash_aset(ret, ID2SYM(rb_intern("hits")), ULL2NUM(stats.hits));
+    rb_hash_aset(ret, ID2SYM(rb_intern("misses")), ULL2NUM(stats.misses));
+    rb_hash_aset(ret, ID2SYM(rb_intern("evictions")), ULL2NUM(stats.evictions));
+    rb_hash_aset(ret, ID2SYM(rb_intern("entries")), SIZET2NUM(stats.entries));
+    rb_hash_aset(ret, ID2SYM(rb_intern("size")), SIZET2NUM(stats.size));
+    rb_hash_aset(ret, ID2SYM(rb_intern("capacity")), SIZET2NUM(stats.capacity));
+    
+    return ret;
+}
+
 RB_METHOD(bitmapInitializeCopy) {
     rb_check_argc(argc, 1);
     VALUE origObj = argv[0];
@@ -766,6 +846,7 @@ void bitmapBindingInit() {
     _rb_define_method(klass, "raw_data", bitmapGetRawData);
     _rb_define_method(klass, "raw_data=", bitmapSetRawData);
     _rb_define_method(klass, "to_file", bitmapSaveToFile);
+    _rb_define_method(klass, "to_file_async", bitmapSaveToFileAsync);
     
     _rb_define_method(klass, "gradient_fill_rect", bitmapGradientFillRect);
     _rb_define_method(klass, "clear_rect", bitmapClearRect);
@@ -774,6 +855,11 @@ void bitmapBindingInit() {
     
     _rb_define_method(klass, "mega?", bitmapGetMega);
     rb_define_singleton_method(klass, "max_size", RUBY_METHOD_FUNC(bitmapGetMaxSize), -1);
+    rb_define_singleton_method(klass, "prefetch", RUBY_METHOD_FUNC(bitmapPrefetch), -1);
+    rb_define_singleton_method(klass, "release_prefetched", RUBY_METHOD_FUNC(bitmapReleasePrefetched), -1);
+    rb_define_singleton_method(klass, "load_async", RUBY_METHOD_FUNC(bitmapLoadAsync), -1);
+    rb_define_singleton_method(klass, "load_ready?", RUBY_METHOD_FUNC(bitmapLoadReady), -1);
+    rb_define_singleton_method(klass, "cache_stats", RUBY_METHOD_FUNC(bitmapCacheStats), -1);
     
     _rb_define_method(klass, "animated?", bitmapGetAnimated);
     _rb_define_method(klass, "playing", bitmapGetPlaying);
@@ -24,6 +24,7 @@
 #include "binding-util.h"
 
 #include "filesystem.h"
+#include "datawriter.h"
 #include "sharedstate.h"
 #include "src/util/util.h"
 
@@ -38,6 +39,8 @@
 #include <ruby/thread.h>
 #endif
 
+#include <errno.h>
+
 static void fileIntFreeInstance(void *inst) {
     SDL_RWops *ops = static_cast<SDL_RWops *>(inst);
     
@@ -162,10 +165,34 @@ RB_METHOD(fileIntPos) {
 }
 #endif
 
+static void waitForSaveData() {
+#if RAPI_MAJOR >= 2
+    rb_thread_call_without_gvl([](void*) -> void* {
+        shState->dataWriter().waitAll();
+        return 0;
+    }, 0, 0, 0);
+#else
+    shState->dataWriter().waitAll();
+#endif
+}
+
+/* Returns nil if 'data' is corrupt */
+static VALUE inflateData(VALUE data) {
+    std::string inflated;
+    
+    if (!DataWriter::decompress(RSTRING_PTR(data), RSTRING_LEN(data), inflated))
+        return Qnil;
+    
+    return rb_str_new(inflated.c_str(), inflated.size());
+}
+
 VALUE
 kernelLoadDataInt(const char *filename, bool rubyExc, bool raw) {
     //rb_gc_start();
     
+    /* Make sure pending save_data_async writes are visible */
+    waitForSaveData();
+    
     VALUE port = fileIntForPath(filename, rubyExc);
     VALUE result;
     if (!raw) {
@@ -173,6 +200,23 @@ kernelLoadDataInt(const char *filename, bool rubyExc, bool raw) {
         
         // FIXME need to catch exceptions here with begin rescue
         VALUE data = fileIntRead(0, 0, port);
+        
+        /* Written by save_data_async with compression */
+        if (DataWriter::compressed(RSTRING_PTR(data), RSTRING_LEN(data))) {
+            data = inflateData(data);
+            
+            if (NIL_P(data)) {
+                rb_funcall2(port, rb_intern("close"), 0, NULL);
+                
+                Exception e(Exception::IOError, "Corrupt compressed data in %s", filename);
+                
+                if (rubyExc)
+                    raiseRbExc(e);
+                else
+                    throw e;
+            }
+        }
+        
         result = rb_funcall2(marsh, rb_intern("load"), 1, &data);
     } else {
         result = fileIntRead(0, 0, port);
@@ -196,6 +240,26 @@ RB_METHOD(kernelLoadData) {
     return kernelLoadDataInt(RSTRING_PTR(filename), true, rawv);
 }
 
+#if RAPI_MAJOR >= 2
+typedef struct {
+    const char *data;
+    size_t size;
+    const char *path;
+    std::string *error;
+    int err;
+} writeDataCbArgs;
+#endif
+
+static VALUE marshalDump(VALUE obj) {
+    VALUE marsh = rb_const_get(rb_cObject, rb_intern("Marshal"));
+    
+    return rb_funcall2(marsh, rb_intern("dump"), 1, &obj);
+}
+
+/* The data is dumped into memory first and then replaces the
+ * file in one go, so a crash midway never leaves a broken save.
+ * Failures raise the matching Errno::* exception, as when the
+ * file was written through File.open */
 RB_METHOD(kernelSaveData) {
     RB_UNUSED_PARAM;
     
@@ -204,14 +268,78 @@ RB_METHOD(kernelSaveData) {
     
     rb_get_args(argc, argv, "oS", &obj, &filename RB_ARG_END);
     
-    VALUE file = rb_file_open_str(filename, "wb");
+    VALUE data = marshalDump(obj);
+    std::string path(RSTRING_PTR(filename), RSTRING_LEN(filename));
+    std::string error;
     
-    VALUE marsh = rb_const_get(rb_cObject, rb_intern("Marshal"));
+    /* Don't let an earlier save_data_async overwrite this */
+    waitForSaveData();
+    
+#if RAPI_MAJOR >= 2
+    writeDataCbArgs cbargs {RSTRING_PTR(data), (size_t)RSTRING_LEN(data), path.c_str(), &error, 0};
+    rb_thread_call_without_gvl([](void* args) -> void* {
+        writeDataCbArgs *a = (writeDataCbArgs*)args;
+        a->err = DataWriter::writeFile(a->data, a->size, a->path, *a->error);
+        return 0;
+    }, (void*)&cbargs, 0, 0);
+    int err = cbargs.err;
+#else
+    int err = DataWriter::writeFile(RSTRING_PTR(data), RSTRING_LEN(data), path.c_str(), error);
+#endif
+    
+    RB_GC_GUARD(data);
+    
+    if (err != 0) {
+#if RAPI_FULL >= 220
+        rb_syserr_fail_str(err, filename);
+#else
+        errno = err;
+        rb_sys_fail(RSTRING_PTR(filename));
+#endif
+    }
+    
+    return Qnil;
+}
+
+/* Like save_data, but only the Marshal dump happens right away;
+ * writing (and optionally compressing) the file is left to a
+ * background thread. Returns a handle for save_data_done? */
+RB_METHOD(kernelSaveDataAsync) {
+    RB_UNUSED_PARAM;
+    
+    VALUE obj;
+    VALUE filename;
+    bool compress = false;
+    
+    rb_get_args(argc, argv, "oS|b", &obj, &filename, &compress RB_ARG_END);
+    
+    VALUE data = marshalDump(obj);
+    std::string bytes(RSTRING_PTR(data), RSTRING_LEN(data));
+    std::string path(RSTRING_PTR(filename), RSTRING_LEN(filename));
+    
+    int handle = 0;
+    GUARD_EXC(handle = shState->dataWriter().save(bytes, path, compress););
+    
+    return INT2NUM(handle);
+}
+
+/* Polls a handle returned by save_data_async; raises if writing failed */
+RB_METHOD(kernelSaveDataDone) {
+    RB_UNUSED_PARAM;
+    
+    int handle;
+    rb_get_args(argc, argv, "i", &handle RB_ARG_END);
+    
+    bool done = false;
+    GUARD_EXC(done = shState->dataWriter().finished(handle););
     
-    VALUE v[] = {obj, file};
-    rb_funcall2(marsh, rb_intern("dump"), ARRAY_SIZE(v), v);
+    return rb_bool_new(done);
+}
+
+RB_METHOD(kernelWaitForSaveData) {
+    RB_UNUSED_PARAM;
     
-    rb_io_close(file);
+    waitForSaveData();
     
     return Qnil;
 }
@@ -287,6 +415,9 @@ void fileIntBindingInit() {
     
     _rb_define_module_function(rb_mKernel, "load_data", kernelLoadData);
     _rb_define_module_function(rb_mKernel, "save_data", kernelSaveData);
+    _rb_define_module_function(rb_mKernel, "save_data_async", kernelSaveDataAsync);
+    _rb_define_module_function(rb_mKernel, "save_data_done?", kernelSaveDataDone);
+    _rb_define_module_function(rb_mKernel, "wait_for_save_data", kernelWaitForSaveData);
     
 #if RAPI_FULL > 187
     /* We overload the built-in 'Marshal::load()' function to silently
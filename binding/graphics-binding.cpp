@@ -21,6 +21,11 @@
 
 #include "config.h"
 #include "graphics.h"
+#include "frameprofiler.h"
+#include "font.h"
+#include "texpool.h"
+#include "bitmaploader.h"
+#include "imagewriter.h"
 #include "sharedstate.h"
 #include "binding-util.h"
 #include "binding-types.h"
@@ -63,6 +68,81 @@ RB_METHOD(graphicsAverageFrameRate)
     return ret;
 }
 
+RB_METHOD(graphicsFrameStats)
+{
+    RB_UNUSED_PARAM;
+    
+    rb_check_argc(argc, 0);
+    
+    VALUE sectionKeys[ProfSectionCount];
+    for (int i = 0; i < ProfSectionCount; ++i)
+        sectionKeys[i] = ID2SYM(rb_intern(FrameProfiler::sectionName((ProfileSection) i)));
+    
+    VALUE totalKey = ID2SYM(rb_intern("total"));
+    
+    size_t count = FrameProfiler::frameCount();
+    VALUE ret = rb_ary_new2(count);
+    
+    for (size_t i = 0; i < count; ++i) {
+        const FrameStats &stats = FrameProfiler::frame(i);
+        VALUE frame = rb_hash_new();
+        
+        rb_hash_aset(frame, totalKey, rb_float_new(stats.total));
+        
+        for (int s = 0; s < ProfSectionCount; ++s)
+            rb_hash_aset(frame, sectionKeys[s], rb_float_new(stats.sections[s]));
+        
+        rb_ary_push(ret, frame);
+    }
+    
+    return ret;
+}
+
+static VALUE cacheStatsHash(const CacheStats &stats)
+{
+    VALUE ret = rb_hash_new();
+    
+    rb_hash_aset(ret, ID2SYM(rb_intern("hits")), ULL2NUM(stats.hits));
+    rb_hash_aset(ret, ID2SYM(rb_intern("misses")), ULL2NUM(stats.misses));
+    rb_hash_aset(ret, ID2SYM(rb_intern("evictions")), ULL2NUM(stats.evictions));
+    rb_hash_aset(ret, ID2SYM(rb_intern("entries")), SIZET2NUM(stats.entries));
+    
+    return ret;
+}
+
+RB_METHOD(graphicsCacheStats)
+{
+    RB_UNUSED_PARAM;
+    
+    rb_check_argc(argc, 0);
+    
+    VALUE ret = rb_hash_new();
+    
+    rb_hash_aset(ret, ID2SYM(rb_intern("text_size")),
+                 cacheStatsHash(shState->fontState().textSizeStats()));
+    rb_hash_aset(ret, ID2SYM(rb_intern("texture_pool")),
+                 cacheStatsHash(shState->texPool().stats()));
+    
+    return ret;
+}
+
+RB_METHOD(graphicsDumpFrameTrace)
+{
+    RB_UNUSED_PARAM;
+    
+    VALUE filename;
+    rb_scan_args(argc, argv, "1", &filename);
+    SafeStringValue(filename);
+    
+    try {
+        shState->graphics().dumpFrameTrace(RSTRING_PTR(filename));
+    } catch (const Exception &e) {
+        raiseRbExc(e);
+    }
+    
+    return Qnil;
+}
+
 RB_METHOD(graphicsFreeze)
 {
     RB_UNUSED_PARAM;
@@ -100,6 +180,21 @@ RB_METHOD(graphicsFrameReset)
     return Qnil;
 }
 
+RB_METHOD(graphicsWaitForLoads)
+{
+    RB_UNUSED_PARAM;
+#if RAPI_MAJOR >= 2
+    rb_thread_call_without_gvl([](void*) -> void* {
+        shState->bitmapLoader().waitAll();
+        return 0;
+    }, 0, 0, 0);
+#else
+    shState->bitmapLoader().waitAll();
+#endif
+    
+    return Qnil;
+}
+
 #define DEF_GRA_PROP_I(PropName) \
 RB_METHOD(graphics##Get##PropName) \
 { \
@@ -359,6 +454,44 @@ RB_METHOD(graphicsScreenshot)
     return Qnil;
 }
 
+RB_METHOD(graphicsScreenshotAsync)
+{
+    RB_UNUSED_PARAM;
+    
+    VALUE filename;
+    rb_scan_args(argc, argv, "1", &filename);
+    SafeStringValue(filename);
+    
+    int handle = 0;
+    GFX_GUARD_EXC(handle = shState->graphics().screenshotAsync(RSTRING_PTR(filename)););
+    
+    return INT2NUM(handle);
+}
+
+/* Polls a handle returned by screenshot_async or Bitmap#to_file_async;
+ * raises if saving failed */
+RB_METHOD(graphicsImageSaved)
+{
+    RB_UNUSED_PARAM;
+    
+    int handle;
+    rb_get_args(argc, argv, "i", &handle RB_ARG_END);
+    
+    bool done = false;
+    GFX_GUARD_EXC(done = shState->imageWriter().finished(handle););
+    
+    return rb_bool_new(done);
+}
+
+RB_METHOD(graphicsWaitForSaves)
+{
+    RB_UNUSED_PARAM;
+    
+    GFX_GUARD_EXC(shState->imageWriter().waitAll(););
+    
+    return Qnil;
+}
+
 DEF_GRA_PROP_I(FrameRate)
 DEF_GRA_PROP_I(FrameCount)
 DEF_GRA_PROP_I(Brightness)
@@ -372,6 +505,8 @@ DEF_GRA_PROP_I(SmoothScaling)
 DEF_GRA_PROP_B(IntegerScaling)
 DEF_GRA_PROP_B(LastMileScaling)
 DEF_GRA_PROP_B(Threadsafe)
+DEF_GRA_PROP_B(FrameProfiler)
+DEF_GRA_PROP_B(FrameProfilerOverlay)
 
 #define INIT_GRA_PROP_BIND(PropName, prop_name_s) \
 { \
@@ -388,13 +523,20 @@ void graphicsBindingInit()
     _rb_define_module_function(module, "freeze", graphicsFreeze);
     _rb_define_module_function(module, "transition", graphicsTransition);
     _rb_define_module_function(module, "frame_reset", graphicsFrameReset);
+    _rb_define_module_function(module, "wait_for_loads", graphicsWaitForLoads);
     _rb_define_module_function(module, "screenshot", graphicsScreenshot);
+    _rb_define_module_function(module, "screenshot_async", graphicsScreenshotAsync);
+    _rb_define_module_function(module, "image_saved?", graphicsImageSaved);
+    _rb_define_module_function(module, "wait_for_saves", graphicsWaitForSaves);
     
     _rb_define_module_function(module, "__reset__", graphicsReset);
     
     INIT_GRA_PROP_BIND( FrameRate,  "frame_rate"  );
     INIT_GRA_PROP_BIND( FrameCount, "frame_count" );
     _rb_define_module_function(module, "average_frame_rate", graphicsAverageFrameRate);
+    _rb_define_module_function(module, "frame_stats", graphicsFrameStats);
+    _rb_define_module_function(module, "dump_frame_trace", graphicsDumpFrameTrace);
+    _rb_define_module_function(module, "cache_stats", graphicsCacheStats);
 
     _rb_define_module_function(module, "width", graphicsWidth);
     _rb_define_module_function(module, "height", graphicsHeight);
@@ -426,4 +568,6 @@ void graphicsBindingInit()
     INIT_GRA_PROP_BIND( IntegerScaling,   "integer_scaling"    );
     INIT_GRA_PROP_BIND( LastMileScaling,  "last_mile_scaling"  );
     INIT_GRA_PROP_BIND( Threadsafe,       "thread_safe"        );
+    INIT_GRA_PROP_BIND( FrameProfiler,    "frame_profiler"     );
+    INIT_GRA_PROP_BIND( FrameProfilerOverlay, "frame_profiler_overlay" );
 }
@@ -20,8 +20,10 @@
 */
 
 #include "binding-util.h"
+#include "binding-types.h"
 #include "serializable-binding.h"
 #include "table.h"
+#include "etc.h"
 #include <algorithm>
 
 static int num2TableSize(VALUE v) {
@@ -147,6 +149,79 @@ RB_METHOD(tableSetAt) {
   return argv[argc - 1];
 }
 
+/* fill(value[, rect][, z]) */
+RB_METHOD(tableFill) {
+  Table *t = getPrivateData<Table>(self);
+
+  if (argc < 1 || argc > 3)
+    rb_error_arity(argc, 1, 3);
+
+  int value = NUM2INT(argv[0]);
+  IntRect area(0, 0, t->xSize(), t->ySize());
+  int z = 0, zCount = t->zSize();
+
+  /* With two arguments, the second one is either */
+  bool hasRect = (argc == 3 || (argc == 2 && !FIXNUM_P(argv[1])));
+  bool hasZ = (argc == 3 || (argc == 2 && FIXNUM_P(argv[1])));
+
+  if (hasRect) {
+    Rect *rect = getPrivateDataCheck<Rect>(argv[1], RectType);
+    area = rect->toIntRect();
+  }
+
+  if (hasZ) {
+    z = NUM2INT(argv[argc - 1]);
+    zCount = 1;
+  }
+
+  GUARD_EXC(t->fill(value, area, z, zCount););
+
+  return self;
+}
+
+/* copy_from(other, src_rect, dst_x, dst_y) */
+RB_METHOD(tableCopyFrom) {
+  Table *t = getPrivateData<Table>(self);
+
+  VALUE otherObj, rectObj;
+  int dstX, dstY;
+
+  rb_get_args(argc, argv, "ooii", &otherObj, &rectObj, &dstX, &dstY RB_ARG_END);
+
+  Table *other = getPrivateDataCheck<Table>(otherObj, TableType);
+  Rect *rect = getPrivateDataCheck<Rect>(rectObj, RectType);
+
+  GUARD_EXC(t->copyFrom(*other, rect->toIntRect(), dstX, dstY););
+
+  return self;
+}
+
+RB_METHOD(tableGetRawData) {
+  RB_UNUSED_PARAM;
+
+  Table *t = getPrivateData<Table>(self);
+  int size = t->rawSize();
+  VALUE ret = rb_str_new(0, size);
+
+  GUARD_EXC(t->getRaw(RSTRING_PTR(ret), size););
+
+  return ret;
+}
+
+RB_METHOD(tableSetRawData) {
+  RB_UNUSED_PARAM;
+
+  VALUE str;
+  rb_scan_args(argc, argv, "1", &str);
+  SafeStringValue(str);
+
+  Table *t = getPrivateData<Table>(self);
+
+  GUARD_EXC(t->replaceRaw(RSTRING_PTR(str), RSTRING_LEN(str)););
+
+  return str;
+}
+
 MARSH_LOAD_FUN(Table)
 INITCOPY_FUN(Table)
 
@@ -170,4 +245,8 @@ void tableBindingInit() {
   _rb_define_method(klass, "zsize", tableZSize);
   _rb_define_method(klass, "[]", tableGetAt);
   _rb_define_method(klass, "[]=", tableSetAt);
+  _rb_define_method(klass, "fill", tableFill);
+  _rb_define_method(klass, "copy_from", tableCopyFrom);
+  _rb_define_method(klass, "raw_data", tableGetRawData);
+  _rb_define_method(klass, "raw_data=", tableSetRawData);
 }
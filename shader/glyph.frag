@@ -0,0 +1,12 @@
+/* Glyphs are stored white in the atlas,
+ * tint them with the vertex color */
+
+uniform sampler2D texture;
+
+varying vec2 v_texCoord;
+varying lowp vec4 v_color;
+
+void main()
+{
+	gl_FragColor = texture2D(texture, v_texCoord) * v_color;
+}
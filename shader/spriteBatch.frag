@@ -0,0 +1,33 @@
+/* Fragment shader for batched sprites; same as sprite.frag
+ * minus bush depth, pattern and inversion, with the per-sprite
+ * effects passed as vertex attributes instead of uniforms */
+
+uniform sampler2D texture;
+
+varying vec2 v_texCoord;
+varying lowp vec4 v_color;
+varying lowp vec4 v_tone;
+varying lowp float v_opacity;
+
+const vec3 lumaF = vec3(.299, .587, .114);
+
+void main()
+{
+	/* Sample source color */
+	vec4 frag = texture2D(texture, v_texCoord);
+
+	/* Apply gray */
+	float luma = dot(frag.rgb, lumaF);
+	frag.rgb = mix(frag.rgb, vec3(luma), v_tone.w);
+
+	/* Apply tone */
+	frag.rgb += v_tone.rgb;
+
+	/* Apply opacity */
+	frag.a *= v_opacity;
+
+	/* Apply color */
+	frag.rgb = mix(frag.rgb, v_color.rgb, v_color.a);
+
+	gl_FragColor = frag;
+}
@@ -0,0 +1,26 @@
+
+uniform mat4 projMat;
+
+uniform vec2 texSizeInv;
+
+attribute vec2 position;
+attribute vec2 texCoord;
+attribute lowp vec4 color;
+attribute lowp vec4 tone;
+attribute lowp float opacity;
+
+varying vec2 v_texCoord;
+varying lowp vec4 v_color;
+varying lowp vec4 v_tone;
+varying lowp float v_opacity;
+
+void main()
+{
+	/* Positions are already transformed into scene space */
+	gl_Position = projMat * vec4(position, 0, 1);
+
+	v_texCoord = texCoord * texSizeInv;
+	v_color = color;
+	v_tone = tone;
+	v_opacity = opacity;
+}
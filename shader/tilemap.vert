@@ -22,6 +22,15 @@ const float atAniOffsetY = tileH;
 
 uniform lowp int atFrames[nAutotiles];
 
+/* Ring buffer origin/size in cells. Positions are encoded as
+ * (ring cell * ringCellSpan + offset within the tile), with the
+ * span larger than a tile so that the right/bottom edge vertices
+ * can't be mistaken for the next cell */
+uniform vec2 ringOrigin;
+uniform vec2 ringSize;
+
+const float ringCellSpan = 64.0;
+
 void main()
 {
     vec2 tex = texCoord;
@@ -34,7 +43,15 @@ void main()
     tex.x += atAniOffsetX * float(col * pred);
     tex.y += atAniOffsetY * float(row * pred);
 
-    gl_Position = projMat * vec4(position + translation, 0, 1);
+    vec2 cell = floor(position / ringCellSpan);
+    vec2 offset = position - cell * ringCellSpan;
+
+    /* Wrap ring cell into viewport cell; 'rel' is positive and
+     * below 2*ringSize, the bias keeps floor() exact */
+    vec2 rel = cell - ringOrigin + ringSize;
+    vec2 viewCell = rel - ringSize * floor((rel + 0.5) / ringSize);
+
+    gl_Position = projMat * vec4(viewCell * vec2(tileW, tileH) + offset + translation, 0, 1);
 
     v_texCoord = tex * texSizeInv;
 }
@@ -93,6 +93,11 @@ namespace Buffer
 	{
 		return getInteger(id, AL_CHANNELS);
 	}
+
+	inline ALint getFrequency(Buffer::ID id)
+	{
+		return getInteger(id, AL_FREQUENCY);
+	}
 }
 
 namespace Source
@@ -249,6 +254,10 @@ inline ALenum chooseALFormat(int sampleSize, int channelCount)
 }
 
 #define AUDIO_SLEEP 10
+/* Longest time the audio scheduler lets a task
+ * that is merely waiting for a state change go
+ * unserviced (ms) */
+#define AUDIO_IDLE_SLEEP 100
 #define STREAM_BUF_SIZE 32768
 #define GLOBAL_VOLUME 0.8f
 
@@ -24,6 +24,10 @@
 
 #include "al-util.h"
 
+#include <string>
+
+class StreamCache;
+
 struct ALDataSource
 {
 	enum Status
@@ -58,8 +62,12 @@ ALDataSource *createSDLSource(SDL_RWops &ops,
 			                  uint32_t maxBufSize,
 			                  bool looped);
 
+/* Keeps the heads of streams in 'cache' under 'cacheKey',
+ * and starts playing from there if they are already in it */
 ALDataSource *createVorbisSource(SDL_RWops &ops,
-                                 bool looped);
+                                 bool looped,
+                                 StreamCache *cache,
+                                 const std::string &cacheKey);
 
 ALDataSource *createMidiSource(SDL_RWops &ops,
                                bool looped);
@@ -32,15 +32,24 @@
 #include "debugwriter.h"
 
 #include <SDL_mutex.h>
-#include <SDL_thread.h>
-#include <SDL_timer.h>
+
+#include <algorithm>
+
+/* Upper bound on how long a playing stream is
+ * left alone before its queue gets checked (ms) */
+#define STREAM_MAX_SLEEP 500
 
 ALStream::ALStream(LoopMode loopMode,
-		           const std::string &threadId)
+		           AudioScheduler &scheduler,
+		           StreamCache &cache)
 	: looped(loopMode == Looped),
 	  state(Closed),
 	  source(0),
-	  thread(0),
+	  scheduler(scheduler),
+	  scheduled(false),
+	  cache(cache),
+	  queueFilled(false),
+	  streamDone(false),
 	  preemptPause(false),
       pitch(1.0f)
 {
@@ -54,8 +63,6 @@ ALStream::ALStream(LoopMode loopMode,
 		alBuf[i] = AL::Buffer::gen();
 
 	pauseMut = SDL_CreateMutex();
-
-	threadName = std::string("al_stream (") + threadId + ")";
 }
 
 ALStream::~ALStream()
@@ -140,6 +147,9 @@ void ALStream::play(float offset)
 		break;
 	case Paused :
 		resumeStream();
+
+		/* Paused streams are only checked on occasion */
+		scheduler.wake(this);
 	}
 
 	state = Playing;
@@ -172,9 +182,11 @@ void ALStream::setPitch(float value)
 	/* If the source supports setting pitch natively,
 	 * we don't have to do it via OpenAL */
 	if (source && source->setPitch(value))
-		AL::Source::setPitch(alSrc, 1.0f);
+		pitch = 1.0f;
 	else
-		AL::Source::setPitch(alSrc, value);
+		pitch = value;
+
+	AL::Source::setPitch(alSrc, pitch);
 }
 
 ALStream::State ALStream::queryState()
@@ -203,11 +215,15 @@ struct ALStreamOpenHandler : FileSystem::OpenHandler
 {
 	SDL_RWops *srcOps;
 	bool looped;
+	StreamCache *cache;
+	std::string cacheKey;
 	ALDataSource *source;
 	std::string errorMsg;
 
-	ALStreamOpenHandler(SDL_RWops &srcOps, bool looped)
-	    : srcOps(&srcOps), looped(looped), source(0)
+	ALStreamOpenHandler(SDL_RWops &srcOps, bool looped,
+	                    StreamCache &cache, const std::string &filename)
+	    : srcOps(&srcOps), looped(looped), cache(&cache),
+	      cacheKey(filename + (looped ? "|looped" : "")), source(0)
 	{}
 
 	bool tryRead(SDL_RWops &ops, const char *ext)
@@ -225,7 +241,7 @@ struct ALStreamOpenHandler : FileSystem::OpenHandler
 		{
 			if (!strcmp(sig, "OggS"))
 			{
-				source = createVorbisSource(*srcOps, looped);
+				source = createVorbisSource(*srcOps, looped, cache, cacheKey);
 				return true;
 			}
 
@@ -256,7 +272,7 @@ struct ALStreamOpenHandler : FileSystem::OpenHandler
 
 void ALStream::openSource(const std::string &filename)
 {
-	ALStreamOpenHandler handler(srcOps, looped);
+	ALStreamOpenHandler handler(srcOps, looped, cache, filename);
 	shState->fileSystem().openRead(handler, filename.c_str());
 	source = handler.source;
 	needsRewind.clear();
@@ -273,18 +289,16 @@ void ALStream::openSource(const std::string &filename)
 
 void ALStream::stopStream()
 {
-	threadTermReq.set();
-
-	if (thread)
+	if (scheduled)
 	{
-		SDL_WaitThread(thread, 0);
-		thread = 0;
+		scheduler.remove(this);
+		scheduled = false;
 		needsRewind.set();
 	}
 
-	/* Need to stop the source _after_ the thread has terminated,
-	 * because it might have accidentally started it again before
-	 * seeing the term request */
+	/* Need to stop the source _after_ the task has been removed,
+	 * because it might have accidentally started it again while
+	 * it was still being serviced */
 	AL::Source::stop(alSrc);
 
 	procFrames = 0;
@@ -297,13 +311,15 @@ void ALStream::startStream(float offset)
 	preemptPause = false;
 	streamInited.clear();
 	sourceExhausted.clear();
-	threadTermReq.clear();
+
+	queueFilled = false;
+	streamDone = false;
 
 	startOffset = offset;
 	procFrames = offset * source->sampleRate();
 
-	thread = createSDLThread
-		<ALStream, &ALStream::streamData>(this, threadName);
+	scheduler.add(this);
+	scheduled = true;
 }
 
 void ALStream::pauseStream()
@@ -357,30 +373,24 @@ void ALStream::checkStopped()
 	state = Stopped;
 }
 
-/* thread func */
-void ALStream::streamData()
+/* Initial fill of the buffer queue; returns false
+ * if the data source errored out */
+bool ALStream::fillQueue()
 {
-	/* Fill up queue */
 	bool firstBuffer = true;
 	ALDataSource::Status status;
 
-	if (threadTermReq)
-		return;
-
 	//if (needsRewind)
 		source->seekToOffset(startOffset);
 
 	for (int i = 0; i < STREAM_BUFS; ++i)
 	{
-		if (threadTermReq)
-			return;
-
 		AL::Buffer::ID buf = alBuf[i];
 
 		status = source->fillBuffer(buf);
 
 		if (status == ALDataSource::Error)
-			return;
+			return false;
 
 		AL::Source::queueBuffer(alSrc, buf);
 
@@ -392,9 +402,6 @@ void ALStream::streamData()
 			streamInited.set();
 		}
 
-		if (threadTermReq)
-			return;
-
 		if (status == ALDataSource::EndOfStream)
 		{
 			sourceExhausted.set();
@@ -402,76 +409,127 @@ void ALStream::streamData()
 		}
 	}
 
-	/* Wait for buffers to be consumed, then
-	 * refill and queue them up again */
-	while (true)
+	return true;
+}
+
+/* Unqueue consumed buffers, then refill
+ * and queue them up again */
+void ALStream::refillQueue()
+{
+	ALDataSource::Status status;
+	ALint procBufs = AL::Source::getProcBufferCount(alSrc);
+
+	while (procBufs--)
 	{
-		shState->rtData().syncPoint.passSecondarySync();
+		AL::Buffer::ID buf = AL::Source::unqueueBuffer(alSrc);
 
-		ALint procBufs = AL::Source::getProcBufferCount(alSrc);
+		/* If something went wrong, try again later */
+		if (buf == AL::Buffer::ID(0))
+			break;
 
-		while (procBufs--)
+		if (buf == lastBuf)
+		{
+			/* Reset the processed sample count so
+			 * querying the playback offset returns 0.0 again */
+			procFrames = source->loopStartFrames();
+			lastBuf = AL::Buffer::ID(0);
+		}
+		else
 		{
-			if (threadTermReq)
-				break;
+			/* Add the frame count contained in this
+			 * buffer to the total count */
+			ALint bits = AL::Buffer::getBits(buf);
+			ALint size = AL::Buffer::getSize(buf);
+			ALint chan = AL::Buffer::getChannels(buf);
+
+			if (bits != 0 && chan != 0)
+				procFrames += ((size / (bits / 8)) / chan);
+		}
 
-			AL::Buffer::ID buf = AL::Source::unqueueBuffer(alSrc);
+		if (sourceExhausted)
+			continue;
 
-			/* If something went wrong, try again later */
-			if (buf == AL::Buffer::ID(0))
-				break;
+		status = source->fillBuffer(buf);
 
-			if (buf == lastBuf)
-			{
-				/* Reset the processed sample count so
-				 * querying the playback offset returns 0.0 again */
-				procFrames = source->loopStartFrames();
-				lastBuf = AL::Buffer::ID(0);
-			}
-			else
-			{
-				/* Add the frame count contained in this
-				 * buffer to the total count */
-				ALint bits = AL::Buffer::getBits(buf);
-				ALint size = AL::Buffer::getSize(buf);
-				ALint chan = AL::Buffer::getChannels(buf);
-
-				if (bits != 0 && chan != 0)
-					procFrames += ((size / (bits / 8)) / chan);
-			}
+		if (status == ALDataSource::Error)
+		{
+			sourceExhausted.set();
+			streamDone = true;
+			return;
+		}
 
-			if (sourceExhausted)
-				continue;
+		AL::Source::queueBuffer(alSrc, buf);
 
-			status = source->fillBuffer(buf);
+		/* In case of buffer underrun,
+		 * start playing again */
+		if (AL::Source::getState(alSrc) == AL_STOPPED)
+			AL::Source::play(alSrc);
 
-			if (status == ALDataSource::Error)
-			{
-				sourceExhausted.set();
-				return;
-			}
+		/* If this was the last buffer before the data
+		 * source loop wrapped around again, mark it as
+		 * such so we can catch it and reset the processed
+		 * sample count once it gets unqueued */
+		if (status == ALDataSource::WrapAround)
+			lastBuf = buf;
 
-			AL::Source::queueBuffer(alSrc, buf);
+		if (status == ALDataSource::EndOfStream)
+			sourceExhausted.set();
+	}
+}
 
-			/* In case of buffer underrun,
-			 * start playing again */
-			if (AL::Source::getState(alSrc) == AL_STOPPED)
-				AL::Source::play(alSrc);
+/* Time until the buffer that is playing right now
+ * will have been consumed, which is when the next
+ * refill can happen */
+uint32_t ALStream::nextServiceDelay()
+{
+	if (streamDone)
+		return AUDIO_IDLE_SLEEP;
 
-			/* If this was the last buffer before the data
-			 * source loop wrapped around again, mark it as
-			 * such so we can catch it and reset the processed
-			 * sample count once it gets unqueued */
-			if (status == ALDataSource::WrapAround)
-				lastBuf = buf;
+	ALenum alState = AL::Source::getState(alSrc);
 
-			if (status == ALDataSource::EndOfStream)
-				sourceExhausted.set();
-		}
+	/* Paused (or not yet started); nothing is being
+	 * consumed, so just keep an eye on the state */
+	if (alState == AL_PAUSED || alState == AL_INITIAL)
+		return AUDIO_IDLE_SLEEP;
 
-		if (threadTermReq)
-			break;
+	/* Underrun; come back soon to get it going again */
+	if (alState != AL_PLAYING)
+		return sourceExhausted ? AUDIO_IDLE_SLEEP : AUDIO_SLEEP;
+
+	AL::Buffer::ID buf(AL::Source::getInteger(alSrc, AL_BUFFER));
+
+	ALint bits = AL::Buffer::getBits(buf);
+	ALint size = AL::Buffer::getSize(buf);
+	ALint chan = AL::Buffer::getChannels(buf);
+	ALint freq = AL::Buffer::getFrequency(buf);
+
+	if (buf == AL::Buffer::ID(0) || bits == 0 || chan == 0 || freq == 0 || pitch <= 0)
+		return AUDIO_SLEEP;
+
+	/* All processed buffers were just unqueued, so the
+	 * source offset is relative to the playing one */
+	float bufSecs = (float) ((size / (bits / 8)) / chan) / freq;
+	float remaining = (bufSecs - AL::Source::getSecOffset(alSrc)) / pitch;
+
+	int delay = (int) (remaining * 1000) + 1;
+
+	return std::max(AUDIO_SLEEP, std::min(delay, STREAM_MAX_SLEEP));
+}
+
+/* scheduler task */
+uint32_t ALStream::service()
+{
+	if (!queueFilled)
+	{
+		queueFilled = true;
 
-		SDL_Delay(AUDIO_SLEEP);
+		if (!fillQueue())
+			streamDone = true;
 	}
+	else if (!streamDone)
+	{
+		refillQueue();
+	}
+
+	return nextServiceDelay();
 }
@@ -23,18 +23,22 @@
 #define ALSTREAM_H
 
 #include "al-util.h"
+#include "audioscheduler.h"
 #include "sdl-util.h"
 
 #include <string>
 #include <SDL_rwops.h>
 
 struct ALDataSource;
+class StreamCache;
 
 #define STREAM_BUFS 3
 
 /* State-machine like audio playback stream.
+ * Buffers are refilled as a task of the shared
+ * AudioScheduler while the stream is running.
  * This class is NOT thread safe */
-struct ALStream
+struct ALStream : AudioScheduler::Task
 {
 	enum State
 	{
@@ -48,9 +52,17 @@ struct ALStream
 	State state;
 
 	ALDataSource *source;
-	SDL_Thread *thread;
 
-	std::string threadName;
+	AudioScheduler &scheduler;
+	bool scheduled;
+
+	StreamCache &cache;
+
+	/* Only touched by the scheduler task while it's scheduled.
+	 * 'queueFilled' is set once the initial buffers are queued,
+	 * 'streamDone' once there's nothing left for the task to do */
+	bool queueFilled;
+	bool streamDone;
 
 	SDL_mutex *pauseMut;
 	bool preemptPause;
@@ -61,11 +73,10 @@ struct ALStream
 	AtomicFlag streamInited;
 	AtomicFlag sourceExhausted;
 
-	AtomicFlag threadTermReq;
-
 	AtomicFlag needsRewind;
 	float startOffset;
 
+	/* Pitch currently applied on the AL side */
 	float pitch;
 
 	AL::Source::ID alSrc;
@@ -89,7 +100,8 @@ struct ALStream
 	};
 
 	ALStream(LoopMode loopMode,
-	         const std::string &threadId);
+	         AudioScheduler &scheduler,
+	         StreamCache &cache);
 	~ALStream();
 
 	void close();
@@ -115,8 +127,12 @@ private:
 
 	void checkStopped();
 
-	/* thread func */
-	void streamData();
+	bool fillQueue();
+	void refillQueue();
+	uint32_t nextServiceDelay();
+
+	/* scheduler task */
+	uint32_t service();
 };
 
 #endif // ALSTREAM_H
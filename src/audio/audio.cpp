@@ -21,7 +21,9 @@
 
 #include "audio.h"
 
+#include "audioscheduler.h"
 #include "audiostream.h"
+#include "streamcache.h"
 #include "soundemitter.h"
 #include "sharedstate.h"
 #include "sharedmidistate.h"
@@ -32,19 +34,20 @@
 #include <string>
 #include <vector>
 
-#include <SDL_thread.h>
-#include <SDL_timer.h>
-
-struct AudioPrivate
+struct AudioPrivate : AudioScheduler::Task
 {
+	/* Services all streams below,
+	 * as well as the MeWatch */
+	AudioScheduler scheduler;
+
+	/* Heads of recently played tracks, shared by all streams */
+	StreamCache streamCache;
     
     std::vector<AudioStream*> bgmTracks;
 	AudioStream bgs;
 	AudioStream me;
 
 	SoundEmitter se;
-
-	SyncPoint &syncPoint;
     
     float volumeRatio;
 
@@ -63,32 +66,29 @@ struct AudioPrivate
 
 	struct
 	{
-		SDL_Thread *thread;
-		AtomicFlag termReq;
 		MeWatchState state;
 	} meWatch;
 
 	AudioPrivate(RGSSThreadData &rtData)
-	    : bgs(ALStream::Looped, "bgs"),
-	      me(ALStream::NotLooped, "me"),
+	    : scheduler(rtData.syncPoint),
+	      streamCache(rtData.config),
+	      bgs(ALStream::Looped, "bgs", scheduler, streamCache),
+	      me(ALStream::NotLooped, "me", scheduler, streamCache),
 	      se(rtData.config),
-	      syncPoint(rtData.syncPoint),
           volumeRatio(1)
 	{
         for (int i = 0; i < rtData.config.BGM.trackCount; i++) {
             std::string id = std::string("bgm" + std::to_string(i));
-            bgmTracks.push_back(new AudioStream(ALStream::Looped, id.c_str()));
+            bgmTracks.push_back(new AudioStream(ALStream::Looped, id.c_str(), scheduler, streamCache));
         }
         
 		meWatch.state = MeNotPlaying;
-		meWatch.thread = createSDLThread
-			<AudioPrivate, &AudioPrivate::meWatchFun>(this, "audio_mewatch");
+		scheduler.add(this);
 	}
 
 	~AudioPrivate()
 	{
-		meWatch.termReq.set();
-		SDL_WaitThread(meWatch.thread, 0);
+		scheduler.remove(this);
         for (auto track : bgmTracks)
             delete track;
 	}
@@ -101,186 +101,185 @@ struct AudioPrivate
         return bgmTracks[index];
     }
 
-	void meWatchFun()
+	/* MeWatch task */
+	uint32_t service()
 	{
 		const float fadeOutStep = 1.f / (200  / AUDIO_SLEEP);
 		const float fadeInStep  = 1.f / (1000 / AUDIO_SLEEP);
 
-		while (true)
+		switch (meWatch.state)
 		{
-			syncPoint.passSecondarySync();
-
-			if (meWatch.termReq)
-				return;
+		case MeNotPlaying:
+		{
+			me.lockStream();
 
-			switch (meWatch.state)
+			if (me.stream.queryState() == ALStream::Playing)
 			{
-			case MeNotPlaying:
-			{
-				me.lockStream();
+				/* ME playing detected. -> FadeOutBGM */
+                for (auto track : bgmTracks)
+                    track->extPaused = true;
+                
+				meWatch.state = BgmFadingOut;
+			}
 
-				if (me.stream.queryState() == ALStream::Playing)
-				{
-					/* ME playing detected. -> FadeOutBGM */
-                    for (auto track : bgmTracks)
-                        track->extPaused = true;
-                    
-					meWatch.state = BgmFadingOut;
-				}
+			me.unlockStream();
 
-				me.unlockStream();
+			break;
+		}
 
-				break;
-			}
+		case BgmFadingOut :
+		{
+			me.lockStream();
 
-			case BgmFadingOut :
+			if (me.stream.queryState() != ALStream::Playing)
 			{
-				me.lockStream();
-
-				if (me.stream.queryState() != ALStream::Playing)
-				{
-					/* ME has ended while fading OUT BGM. -> FadeInBGM */
-					me.unlockStream();
-					meWatch.state = BgmFadingIn;
+				/* ME has ended while fading OUT BGM. -> FadeInBGM */
+				me.unlockStream();
+				meWatch.state = BgmFadingIn;
 
-					break;
-				}
+				break;
+			}
+            
+            bool shouldBreak = false;
+            
+            for (int i = 0; i < (int)(bgmTracks.size()); i++) {
+                AudioStream *track = bgmTracks[i];
+                
+                track->lockStream();
                 
-                bool shouldBreak = false;
+                float vol = track->getVolume(AudioStream::External);
+                vol -= fadeOutStep;
                 
-                for (int i = 0; i < (int)(bgmTracks.size()); i++) {
-                    AudioStream *track = bgmTracks[i];
+                if (vol < 0 || track->stream.queryState() != ALStream::Playing) {
+                    /* Either BGM has fully faded out, or stopped midway. -> MePlaying */
+                    track->setVolume(AudioStream::External, 0);
+                    track->stream.pause();
+                    track->unlockStream();
+                    
+                    // check to see if there are any tracks still playing,
+                    // and if the last one was ended this round, this branch should exit
+                    std::vector<AudioStream*> playingTracks;
+                    for (auto t : bgmTracks)
+                        if (t->stream.queryState() == ALStream::Playing)
+                            playingTracks.push_back(t);
+                    
                     
+                    if (playingTracks.size() <= 0 && !shouldBreak) shouldBreak = true;
+                    continue;
+                }
+                
+                track->setVolume(AudioStream::External, vol);
+                track->unlockStream();
+                
+            }
+            if (shouldBreak) {
+                meWatch.state = MePlaying;
+                me.unlockStream();
+                break;
+            }
+            
+			me.unlockStream();
+
+			break;
+		}
+
+		case MePlaying :
+		{
+			me.lockStream();
+
+			if (me.stream.queryState() != ALStream::Playing)
+            {
+                /* ME has ended */
+                for (auto track : bgmTracks) {
                     track->lockStream();
+                    track->extPaused = false;
                     
-                    float vol = track->getVolume(AudioStream::External);
-                    vol -= fadeOutStep;
+                    ALStream::State sState = track->stream.queryState();
                     
-                    if (vol < 0 || track->stream.queryState() != ALStream::Playing) {
-                        /* Either BGM has fully faded out, or stopped midway. -> MePlaying */
-                        track->setVolume(AudioStream::External, 0);
-                        track->stream.pause();
-                        track->unlockStream();
-                        
-                        // check to see if there are any tracks still playing,
-                        // and if the last one was ended this round, this branch should exit
-                        std::vector<AudioStream*> playingTracks;
-                        for (auto t : bgmTracks)
-                            if (t->stream.queryState() == ALStream::Playing)
-                                playingTracks.push_back(t);
+                    if (sState == ALStream::Paused) {
+                        /* BGM is paused. -> FadeInBGM */
+                        track->stream.play();
+                        meWatch.state = BgmFadingIn;
+                    }
+                    else {
+                        /* BGM is stopped. -> MeNotPlaying */
+                        track->setVolume(AudioStream::External, 1.0f);
                         
+                        if (!track->noResumeStop)
+                            track->stream.play();
                         
-                        if (playingTracks.size() <= 0 && !shouldBreak) shouldBreak = true;
-                        continue;
+                        meWatch.state = MeNotPlaying;
                     }
                     
-                    track->setVolume(AudioStream::External, vol);
                     track->unlockStream();
-                    
                 }
-                if (shouldBreak) {
-                    meWatch.state = MePlaying;
-                    me.unlockStream();
-                    break;
-                }
-                
-				me.unlockStream();
-
-				break;
 			}
 
-			case MePlaying :
-			{
-				me.lockStream();
-
-				if (me.stream.queryState() != ALStream::Playing)
-                {
-                    /* ME has ended */
-                    for (auto track : bgmTracks) {
-                        track->lockStream();
-                        track->extPaused = false;
-                        
-                        ALStream::State sState = track->stream.queryState();
-                        
-                        if (sState == ALStream::Paused) {
-                            /* BGM is paused. -> FadeInBGM */
-                            track->stream.play();
-                            meWatch.state = BgmFadingIn;
-                        }
-                        else {
-                            /* BGM is stopped. -> MeNotPlaying */
-                            track->setVolume(AudioStream::External, 1.0f);
-                            
-                            if (!track->noResumeStop)
-                                track->stream.play();
-                            
-                            meWatch.state = MeNotPlaying;
-                        }
-                        
-                        track->unlockStream();
-                    }
-				}
+            me.unlockStream();
 
-                me.unlockStream();
+			break;
+		}
 
-				break;
-			}
+		case BgmFadingIn :
+		{
+            for (auto track : bgmTracks)
+                track->lockStream();
 
-			case BgmFadingIn :
+			if (bgmTracks[0]->stream.queryState() == ALStream::Stopped)
 			{
+				/* BGM stopped midway fade in. -> MeNotPlaying */
                 for (auto track : bgmTracks)
-                    track->lockStream();
+                    track->setVolume(AudioStream::External, 1.0f);
+				meWatch.state = MeNotPlaying;
+                for (auto track : bgmTracks)
+                    track->unlockStream();
 
-				if (bgmTracks[0]->stream.queryState() == ALStream::Stopped)
-				{
-					/* BGM stopped midway fade in. -> MeNotPlaying */
-                    for (auto track : bgmTracks)
-                        track->setVolume(AudioStream::External, 1.0f);
-					meWatch.state = MeNotPlaying;
-                    for (auto track : bgmTracks)
-                        track->unlockStream();
-
-					break;
-				}
-
-				me.lockStream();
-
-				if (me.stream.queryState() == ALStream::Playing)
-				{
-					/* ME started playing midway BGM fade in. -> FadeOutBGM */
-                    for (auto track : bgmTracks)
-                        track->extPaused = true;
-					meWatch.state = BgmFadingOut;
-					me.unlockStream();
-                    for (auto track : bgmTracks)
-                        track->unlockStream();
-
-					break;
-				}
-
-				float vol = bgmTracks[0]->getVolume(AudioStream::External);
-				vol += fadeInStep;
-
-				if (vol >= 1)
-				{
-					/* BGM fully faded in. -> MeNotPlaying */
-					vol = 1.0f;
-					meWatch.state = MeNotPlaying;
-				}
+				break;
+			}
 
-                for (auto track : bgmTracks)
-                    track->setVolume(AudioStream::External, vol);
+			me.lockStream();
 
+			if (me.stream.queryState() == ALStream::Playing)
+			{
+				/* ME started playing midway BGM fade in. -> FadeOutBGM */
+                for (auto track : bgmTracks)
+                    track->extPaused = true;
+				meWatch.state = BgmFadingOut;
 				me.unlockStream();
                 for (auto track : bgmTracks)
                     track->unlockStream();
 
 				break;
 			}
+
+			float vol = bgmTracks[0]->getVolume(AudioStream::External);
+			vol += fadeInStep;
+
+			if (vol >= 1)
+			{
+				/* BGM fully faded in. -> MeNotPlaying */
+				vol = 1.0f;
+				meWatch.state = MeNotPlaying;
 			}
 
-			SDL_Delay(AUDIO_SLEEP);
+            for (auto track : bgmTracks)
+                track->setVolume(AudioStream::External, vol);
+
+			me.unlockStream();
+            for (auto track : bgmTracks)
+                track->unlockStream();
+
+			break;
 		}
+		}
+
+		/* Fades step once per AUDIO_SLEEP. Otherwise we're
+		 * only waiting for the ME to start or end; mePlay()
+		 * wakes us up for the former */
+		if (meWatch.state == BgmFadingOut || meWatch.state == BgmFadingIn)
+			return AUDIO_SLEEP;
+
+		return AUDIO_IDLE_SLEEP;
 	}
 };
 
@@ -377,6 +376,7 @@ void Audio::mePlay(const char *filename,
                    int pitch)
 {
 	p->me.play(filename, volume, pitch);
+	p->scheduler.wake(p);
 }
 
 void Audio::meStop()
@@ -402,6 +402,16 @@ void Audio::seStop()
 	p->se.stop();
 }
 
+void Audio::sePreload(const char *filename)
+{
+	p->se.preload(filename);
+}
+
+void Audio::seCacheStats(SECacheStats &out)
+{
+	p->se.getCacheStats(out);
+}
+
 void Audio::setupMidi()
 {
 	shState->midiState().initIfNeeded(shState->config());
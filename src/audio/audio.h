@@ -34,6 +34,7 @@
 
 struct AudioPrivate;
 struct RGSSThreadData;
+struct SECacheStats;
 
 class Audio
 {
@@ -65,6 +66,8 @@ public:
 	            int volume = 100,
 	            int pitch = 100);
 	void seStop();
+	void sePreload(const char *filename);
+	void seCacheStats(SECacheStats &out);
 
 	void setupMidi();
 	float bgmPos(int track = 0);
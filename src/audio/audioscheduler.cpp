@@ -0,0 +1,219 @@
+/*
+** audioscheduler.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "audioscheduler.h"
+
+#include "eventthread.h"
+#include "sdl-util.h"
+
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#include <SDL_timer.h>
+
+#include <vector>
+
+struct AudioSchedulerPrivate
+{
+	struct Entry
+	{
+		AudioScheduler::Task *task;
+
+		/* SDL ticks at which the task is due */
+		uint32_t due;
+	};
+
+	SyncPoint &syncPoint;
+
+	SDL_Thread *thread;
+	AtomicFlag termReq;
+
+	/* Guards everything below */
+	SDL_mutex *mut;
+
+	/* Signalled when the schedule changes */
+	SDL_cond *wakeCond;
+
+	/* Signalled when a task is done being serviced */
+	SDL_cond *doneCond;
+
+	std::vector<Entry> entries;
+	AudioScheduler::Task *running;
+
+	/* Set if the running task was woken up mid-service,
+	 * so its own choice of delay gets overridden */
+	bool rerun;
+
+	AudioSchedulerPrivate(SyncPoint &syncPoint)
+	    : syncPoint(syncPoint),
+	      running(0),
+	      rerun(false)
+	{
+		mut = SDL_CreateMutex();
+		wakeCond = SDL_CreateCond();
+		doneCond = SDL_CreateCond();
+
+		thread = createSDLThread
+			<AudioSchedulerPrivate, &AudioSchedulerPrivate::threadFun>(this, "audio_scheduler");
+	}
+
+	~AudioSchedulerPrivate()
+	{
+		SDL_LockMutex(mut);
+		termReq.set();
+		SDL_CondSignal(wakeCond);
+		SDL_UnlockMutex(mut);
+
+		SDL_WaitThread(thread, 0);
+
+		SDL_DestroyCond(doneCond);
+		SDL_DestroyCond(wakeCond);
+		SDL_DestroyMutex(mut);
+	}
+
+	Entry *find(AudioScheduler::Task *task)
+	{
+		for (size_t i = 0; i < entries.size(); ++i)
+			if (entries[i].task == task)
+				return &entries[i];
+
+		return 0;
+	}
+
+	static bool isDue(uint32_t due, uint32_t now)
+	{
+		/* Robust against the tick counter wrapping around */
+		return (int32_t) (due - now) <= 0;
+	}
+
+	void threadFun()
+	{
+		SDL_LockMutex(mut);
+
+		while (!termReq)
+		{
+			SDL_UnlockMutex(mut);
+			syncPoint.passSecondarySync();
+			SDL_LockMutex(mut);
+
+			if (termReq)
+				break;
+
+			if (entries.empty())
+			{
+				SDL_CondWait(wakeCond, mut);
+				continue;
+			}
+
+			Entry *next = &entries[0];
+
+			for (size_t i = 1; i < entries.size(); ++i)
+				if ((int32_t) (entries[i].due - next->due) < 0)
+					next = &entries[i];
+
+			uint32_t now = SDL_GetTicks();
+
+			if (!isDue(next->due, now))
+			{
+				SDL_CondWaitTimeout(wakeCond, mut, next->due - now);
+				continue;
+			}
+
+			AudioScheduler::Task *task = next->task;
+			running = task;
+			rerun = false;
+
+			SDL_UnlockMutex(mut);
+			uint32_t delay = task->service();
+			SDL_LockMutex(mut);
+
+			running = 0;
+
+			/* The task might have been removed while it ran */
+			if (Entry *entry = find(task))
+				entry->due = SDL_GetTicks() + (rerun ? 0 : delay);
+
+			SDL_CondBroadcast(doneCond);
+		}
+
+		SDL_UnlockMutex(mut);
+	}
+};
+
+AudioScheduler::AudioScheduler(SyncPoint &syncPoint)
+	: p(new AudioSchedulerPrivate(syncPoint))
+{}
+
+AudioScheduler::~AudioScheduler()
+{
+	delete p;
+}
+
+void AudioScheduler::add(Task *task)
+{
+	SDL_LockMutex(p->mut);
+
+	if (AudioSchedulerPrivate::Entry *entry = p->find(task))
+	{
+		entry->due = SDL_GetTicks();
+	}
+	else
+	{
+		AudioSchedulerPrivate::Entry newEntry = { task, SDL_GetTicks() };
+		p->entries.push_back(newEntry);
+	}
+
+	p->rerun |= (p->running == task);
+	SDL_CondSignal(p->wakeCond);
+	SDL_UnlockMutex(p->mut);
+}
+
+void AudioScheduler::remove(Task *task)
+{
+	SDL_LockMutex(p->mut);
+
+	for (size_t i = 0; i < p->entries.size(); ++i)
+	{
+		if (p->entries[i].task != task)
+			continue;
+
+		p->entries.erase(p->entries.begin() + i);
+		break;
+	}
+
+	while (p->running == task)
+		SDL_CondWait(p->doneCond, p->mut);
+
+	SDL_UnlockMutex(p->mut);
+}
+
+void AudioScheduler::wake(Task *task)
+{
+	SDL_LockMutex(p->mut);
+
+	if (AudioSchedulerPrivate::Entry *entry = p->find(task))
+	{
+		entry->due = SDL_GetTicks();
+		p->rerun |= (p->running == task);
+		SDL_CondSignal(p->wakeCond);
+	}
+
+	SDL_UnlockMutex(p->mut);
+}
@@ -0,0 +1,66 @@
+/*
+** audioscheduler.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIOSCHEDULER_H
+#define AUDIOSCHEDULER_H
+
+#include <stdint.h>
+
+struct SyncPoint;
+struct AudioSchedulerPrivate;
+
+/* A single thread servicing every audio stream (and the
+ * MeWatch). Instead of each of them polling on a fixed
+ * interval, tasks say how long they can go until they need
+ * to be looked at again, and the thread sleeps until the
+ * earliest of those deadlines (or until it is woken up) */
+struct AudioScheduler
+{
+	struct Task
+	{
+		virtual ~Task() {}
+
+		/* Called on the scheduler thread. Returns the number
+		 * of ms until the task wants to be serviced again */
+		virtual uint32_t service() = 0;
+	};
+
+	AudioScheduler(SyncPoint &syncPoint);
+	~AudioScheduler();
+
+	/* Schedules 'task' to be serviced as soon as possible.
+	 * Adding an already scheduled task is the same as wake() */
+	void add(Task *task);
+
+	/* Unschedules 'task'. If it is being serviced right now,
+	 * waits for that to finish, so once this returns the
+	 * scheduler thread won't touch the task anymore.
+	 * Must not be called by a task on itself */
+	void remove(Task *task);
+
+	/* Moves 'task' up to be serviced as soon as possible */
+	void wake(Task *task);
+
+private:
+	AudioSchedulerPrivate *p;
+};
+
+#endif // AUDIOSCHEDULER_H
@@ -29,10 +29,12 @@
 #include <SDL_timer.h>
 
 AudioStream::AudioStream(ALStream::LoopMode loopMode,
-                         const std::string &threadId)
+                         const std::string &threadId,
+                         AudioScheduler &scheduler,
+                         StreamCache &cache)
 	: extPaused(false),
 	  noResumeStop(false),
-	  stream(loopMode, threadId)
+	  stream(loopMode, scheduler, cache)
 {
 	current.volume = 1.0f;
 	current.pitch = 1.0f;
@@ -121,7 +121,9 @@ struct AudioStream
 	} fadeIn;
 
 	AudioStream(ALStream::LoopMode loopMode,
-	            const std::string &threadId);
+	            const std::string &threadId,
+	            AudioScheduler &scheduler,
+	            StreamCache &cache);
 	~AudioStream();
 
 	void play(const std::string &filename,
@@ -0,0 +1,437 @@
+/*
+** midicache.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "midicache.h"
+
+#include "sharedmidistate.h"
+#include "config.h"
+#include "filesystem.h"
+#include "boost-hash.h"
+#include "sdl-util.h"
+#include "debugwriter.h"
+
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#include <SDL_timer.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <deque>
+#include <stdio.h>
+#include <string.h>
+
+/* Bump whenever the renderer output or file layout changes */
+#define MIDI_CACHE_VERSION 1
+
+/* Songs that don't loop within this are left to live synthesis */
+#define MIDI_CACHE_MAX_SECONDS 600
+
+static const char cacheMagic[8] = { 'M', 'K', 'X', 'P', 'M', 'I', 'D', 'I' };
+
+/* File layout (native byte order, the cache is machine local):
+ *   magic[8]
+ *   uint32_t keyLen, char key[keyLen]
+ *   uint32_t introFrames, totalFrames, looped
+ *   int16_t pcm[totalFrames * 2] */
+
+struct RenderJob
+{
+	std::string key;
+	std::vector<uint8_t> data;
+	bool looped;
+	int8_t pitchShift;
+};
+
+struct RWSink : MidiPCMSink
+{
+	SDL_RWops *ops;
+
+	RWSink(SDL_RWops *ops)
+	    : ops(ops)
+	{}
+
+	bool write(const int16_t *frames, uint32_t count)
+	{
+		return SDL_RWwrite(ops, frames, sizeof(int16_t) * 2, count) == count;
+	}
+};
+
+static bool olderFile(const mkxp_fs::FileInfo &a, const mkxp_fs::FileInfo &b)
+{
+	return a.modified < b.modified;
+}
+
+struct MidiPCMCachePrivate
+{
+	std::string dir;
+	std::string settingsKey;
+
+	fluid_settings_t *settings;
+	std::string soundFont;
+
+	/* Disk budget of all renderings, in bytes */
+	uint64_t budget;
+
+	/* Only touched by the render thread */
+	fluid_synth_t *synth;
+	bool fontLoaded;
+
+	SDL_Thread *thread;
+
+	/* Guards everything below */
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+
+	std::deque<RenderJob*> queue;
+
+	/* Queued, rendering, or failed this session */
+	BoostSet<std::string> known;
+
+	bool quit;
+
+	MidiPCMCachePrivate()
+	    : budget(0),
+	      synth(0),
+	      fontLoaded(false),
+	      thread(0),
+	      quit(false)
+	{
+		mutex = SDL_CreateMutex();
+		cond = SDL_CreateCond();
+	}
+
+	~MidiPCMCachePrivate()
+	{
+		if (thread)
+		{
+			SDL_LockMutex(mutex);
+			quit = true;
+			SDL_CondSignal(cond);
+			SDL_UnlockMutex(mutex);
+
+			SDL_WaitThread(thread, 0);
+		}
+
+		for (size_t i = 0; i < queue.size(); ++i)
+			delete queue[i];
+
+		if (synth)
+			fluid.delete_synth(synth);
+
+		SDL_DestroyCond(cond);
+		SDL_DestroyMutex(mutex);
+	}
+
+	std::string pathFor(const std::string &key)
+	{
+		uLong crc = crc32(0L, Z_NULL, 0);
+		crc = crc32(crc, (const Bytef*) key.c_str(), key.size());
+
+		char name[16];
+		snprintf(name, sizeof(name), "%08lx", (unsigned long) crc);
+
+		return dir + "/" + name + ".pcm";
+	}
+
+	bool loadSynth()
+	{
+		if (synth)
+			return fontLoaded;
+
+		synth = fluid.new_synth(settings);
+
+		/* Without its soundfont the synth renders silence,
+		 * which mustn't end up in the cache */
+		fontLoaded = fluid.synth_sfload(synth, soundFont.c_str(), 1) >= 0;
+
+		if (!fontLoaded)
+			Debug() << "MIDI cache: unable to load" << soundFont << "- songs won't be cached";
+
+		return fontLoaded;
+	}
+
+	/* Deletes the renderings that went unplayed the
+	 * longest until the cache fits its budget again */
+	void trim()
+	{
+		std::vector<mkxp_fs::FileInfo> files;
+		std::vector<mkxp_fs::FileInfo> renderings;
+		uint64_t total = 0;
+
+		if (!mkxp_fs::listFiles(dir.c_str(), files))
+			return;
+
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			const std::string &path = files[i].path;
+
+			if (path.size() < 4 || path.compare(path.size() - 4, 4, ".pcm") != 0)
+				continue;
+
+			renderings.push_back(files[i]);
+			total += files[i].size;
+		}
+
+		if (total <= budget)
+			return;
+
+		std::sort(renderings.begin(), renderings.end(), olderFile);
+
+		for (size_t i = 0; i < renderings.size() && total > budget; ++i)
+			if (mkxp_fs::removeFile(renderings[i].path.c_str()))
+				total -= renderings[i].size;
+	}
+
+	bool render(const RenderJob &job)
+	{
+		if (!loadSynth())
+			return false;
+
+		std::string path = pathFor(job.key);
+		std::string tmpPath = path + ".tmp";
+
+		SDL_RWops *ops = SDL_RWFromFile(tmpPath.c_str(), "wb");
+
+		if (!ops)
+			return false;
+
+		/* Header is filled in once the layout is known */
+		uint32_t keyLen = job.key.size();
+		uint32_t layout[3] = { 0, 0, 0 };
+
+		SDL_RWwrite(ops, cacheMagic, 1, sizeof(cacheMagic));
+		SDL_RWwrite(ops, &keyLen, sizeof(keyLen), 1);
+		SDL_RWwrite(ops, job.key.c_str(), 1, keyLen);
+		Sint64 layoutPos = SDL_RWtell(ops);
+		SDL_RWwrite(ops, layout, sizeof(layout), 1);
+
+		RWSink sink(ops);
+		MidiPCMInfo info;
+
+		/* A song bigger than the whole cache would never be kept */
+		uint32_t maxFrames = std::min<uint64_t>(MIDI_CACHE_MAX_SECONDS * SYNTH_SAMPLERATE,
+		                                        budget / (sizeof(int16_t) * 2));
+
+		bool ok = renderMidiPCM(job.data, job.looped, job.pitchShift, synth,
+		                        maxFrames, sink, info);
+
+		if (ok)
+		{
+			layout[0] = info.introFrames;
+			layout[1] = info.totalFrames;
+			layout[2] = info.looped;
+
+			ok = SDL_RWseek(ops, layoutPos, RW_SEEK_SET) == layoutPos
+			  && SDL_RWwrite(ops, layout, sizeof(layout), 1) == 1;
+		}
+
+		ok = (SDL_RWclose(ops) == 0) && ok;
+
+		if (ok)
+		{
+			remove(path.c_str());
+			ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+		}
+
+		if (!ok)
+			remove(tmpPath.c_str());
+
+		return ok;
+	}
+
+	void worker()
+	{
+		/* The budget may have shrunk since the last session */
+		trim();
+
+		SDL_LockMutex(mutex);
+
+		while (true)
+		{
+			while (queue.empty() && !quit)
+				SDL_CondWait(cond, mutex);
+
+			if (quit)
+				break;
+
+			RenderJob *job = queue.front();
+			queue.pop_front();
+
+			SDL_UnlockMutex(mutex);
+
+			uint32_t start = SDL_GetTicks();
+			bool ok = render(*job);
+
+			if (ok)
+			{
+				Debug() << "MIDI cache: rendered song in" << (SDL_GetTicks() - start) << "ms";
+				trim();
+			}
+			else
+				Debug() << "MIDI cache: failed to render song, it will be synthesized live";
+
+			SDL_LockMutex(mutex);
+
+			/* Successful renders are found on disk from now on */
+			if (ok)
+				known.remove(job->key);
+
+			delete job;
+		}
+
+		SDL_UnlockMutex(mutex);
+	}
+};
+
+MidiPCMCache::MidiPCMCache(const Config &conf, fluid_settings_t *settings)
+{
+	p = new MidiPCMCachePrivate;
+	p->settings = settings;
+	p->soundFont = conf.midi.soundFont;
+	p->budget = (uint64_t) conf.midi.cacheSize * 1024 * 1024;
+	p->dir = conf.customDataPath + "/MidiCache";
+
+	/* Anything that changes what the synth outputs */
+	long sfSize = -1;
+
+	if (SDL_RWops *sf = SDL_RWFromFile(p->soundFont.c_str(), "rb"))
+	{
+		sfSize = (long) SDL_RWsize(sf);
+		SDL_RWclose(sf);
+	}
+
+	char buf[64];
+	snprintf(buf, sizeof(buf), "|%ld|%d|%d|%d|%d", sfSize, SYNTH_SAMPLERATE,
+	         (int) conf.midi.chorus, (int) conf.midi.reverb, MIDI_CACHE_VERSION);
+
+	p->settingsKey = p->soundFont + buf;
+
+	/* Nothing worth rendering, or nowhere to keep it */
+	if (p->soundFont.empty() || p->budget == 0)
+		return;
+
+	if (!mkxp_fs::createDirectory(p->dir.c_str()))
+	{
+		Debug() << "MIDI cache: unable to create" << p->dir;
+		return;
+	}
+
+	p->thread = createSDLThread
+		<MidiPCMCachePrivate, &MidiPCMCachePrivate::worker>(p, "midi_render");
+}
+
+MidiPCMCache::~MidiPCMCache()
+{
+	delete p;
+}
+
+std::string MidiPCMCache::makeKey(const std::vector<uint8_t> &data,
+                                  bool looped, int8_t pitchShift)
+{
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, data.data(), data.size());
+
+	uLong adler = adler32(0L, Z_NULL, 0);
+	adler = adler32(adler, data.data(), data.size());
+
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%lu|%08lx|%08lx|%d|%d|", (unsigned long) data.size(),
+	         (unsigned long) crc, (unsigned long) adler, (int) looped, (int) pitchShift);
+
+	return buf + p->settingsKey;
+}
+
+SDL_RWops *MidiPCMCache::open(const std::string &key, MidiPCMInfo &info)
+{
+	std::string path = p->pathFor(key);
+	SDL_RWops *ops = SDL_RWFromFile(path.c_str(), "rb");
+
+	if (!ops)
+		return 0;
+
+	char magic[sizeof(cacheMagic)];
+	uint32_t keyLen = 0;
+	uint32_t layout[3];
+	std::string fileKey;
+
+	bool ok = SDL_RWread(ops, magic, 1, sizeof(magic)) == sizeof(magic)
+	       && !memcmp(magic, cacheMagic, sizeof(magic))
+	       && SDL_RWread(ops, &keyLen, sizeof(keyLen), 1) == 1
+	       && keyLen == key.size();
+
+	if (ok)
+	{
+		fileKey.resize(keyLen);
+		ok = SDL_RWread(ops, &fileKey[0], 1, keyLen) == keyLen
+		  && fileKey == key
+		  && SDL_RWread(ops, layout, sizeof(layout), 1) == 1
+		  && layout[1] > 0 && layout[0] < layout[1];
+	}
+
+	/* Truncated files (eg. from a crash mid-write) can't be trusted */
+	if (ok)
+	{
+		Sint64 expected = SDL_RWtell(ops) + (Sint64) layout[1] * sizeof(int16_t) * 2;
+		ok = SDL_RWsize(ops) == expected;
+	}
+
+	if (!ok)
+	{
+		SDL_RWclose(ops);
+		return 0;
+	}
+
+	info.introFrames = layout[0];
+	info.totalFrames = layout[1];
+	info.looped = layout[2];
+
+	/* Renderings are evicted least recently played first */
+	mkxp_fs::touchFile(path.c_str());
+
+	return ops;
+}
+
+void MidiPCMCache::requestRender(const std::string &key,
+                                 const std::vector<uint8_t> &data,
+                                 bool looped, int8_t pitchShift)
+{
+	if (!p->thread)
+		return;
+
+	SDL_LockMutex(p->mutex);
+
+	if (!p->known.contains(key))
+	{
+		p->known.insert(key);
+
+		RenderJob *job = new RenderJob;
+		job->key = key;
+		job->data = data;
+		job->looped = looped;
+		job->pitchShift = pitchShift;
+
+		p->queue.push_back(job);
+		SDL_CondSignal(p->cond);
+	}
+
+	SDL_UnlockMutex(p->mutex);
+}
@@ -0,0 +1,95 @@
+/*
+** midicache.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MIDICACHE_H
+#define MIDICACHE_H
+
+#include "fluid-fun.h"
+
+#include <SDL_rwops.h>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct Config;
+
+/* Layout of a song rendered to interleaved stereo s16 PCM.
+ * Looped songs play [0, totalFrames) once, then repeat
+ * [introFrames, totalFrames) forever */
+struct MidiPCMInfo
+{
+	uint32_t introFrames;
+	uint32_t totalFrames;
+	bool looped;
+};
+
+/* Receives the PCM of a song being rendered */
+struct MidiPCMSink
+{
+	virtual ~MidiPCMSink() {}
+
+	virtual bool write(const int16_t *frames, uint32_t count) = 0;
+};
+
+/* Implemented in midisource.cpp. Synthesizes the whole song
+ * through 'synth', exactly as a playing MidiSource would, up
+ * to the end of its second pass through the loop (or the end
+ * of the song if it doesn't loop). Returns false on error or
+ * if the song is longer than 'maxFrames' */
+bool renderMidiPCM(const std::vector<uint8_t> &data,
+                   bool looped, int8_t pitchShift,
+                   fluid_synth_t *synth, uint32_t maxFrames,
+                   MidiPCMSink &sink, MidiPCMInfo &info);
+
+struct MidiPCMCachePrivate;
+
+/* Disk cache of MIDI songs pre-rendered to PCM, so that they
+ * don't have to be synthesized live every time they play.
+ * Missing songs are rendered on a background thread with a
+ * synth of their own, while the first play happens live.
+ * Entries are keyed by the MIDI data, the soundfont, and
+ * every synth setting that affects the output. Once the cache
+ * outgrows its budget, the least recently played entries go */
+class MidiPCMCache
+{
+public:
+	MidiPCMCache(const Config &conf, fluid_settings_t *settings);
+	~MidiPCMCache();
+
+	std::string makeKey(const std::vector<uint8_t> &data,
+	                    bool looped, int8_t pitchShift);
+
+	/* Opens the rendering for 'key', positioned at its first
+	 * frame. Returns 0 if there isn't one (yet) */
+	SDL_RWops *open(const std::string &key, MidiPCMInfo &info);
+
+	/* Queues a background render of 'data', unless it's
+	 * already cached, queued, or failed before */
+	void requestRender(const std::string &key,
+	                   const std::vector<uint8_t> &data,
+	                   bool looped, int8_t pitchShift);
+
+private:
+	MidiPCMCachePrivate *p;
+};
+
+#endif // MIDICACHE_H
@@ -25,6 +25,7 @@
 #include "exception.h"
 #include "sharedstate.h"
 #include "sharedmidistate.h"
+#include "midicache.h"
 #include "util.h"
 #include "debugwriter.h"
 #include "fluid-fun.h"
@@ -54,6 +55,8 @@
 
 #define TICK_FRAMES 32
 #define BUF_TICKS (STREAM_BUF_SIZE / TICK_FRAMES)
+#define BUF_FRAMES (BUF_TICKS * TICK_FRAMES)
+#define FRAME_BYTES (sizeof(int16_t) * 2)
 #define DEFAULT_BPM 120
 #define MAX_CHANNELS 16
 
@@ -586,7 +589,12 @@ struct MidiSource : ALDataSource, MidiReadHandler
 	const uint16_t freq;
 	fluid_synth_t *synth;
 
-	int16_t synthBuf[BUF_TICKS*TICK_FRAMES*2];
+	/* False if the synth was lent to us by a pre-renderer */
+	bool pooledSynth;
+
+	int16_t synthBuf[BUF_FRAMES*2];
+
+	std::vector<uint8_t> midiData;
 
 	std::vector<Track> tracks;
 	CCResetter<CC_CTRL_VOLUME>     volReset;
@@ -613,19 +621,45 @@ struct MidiSource : ALDataSource, MidiReadHandler
 	/* MidiReadHandler (track that's currently being read) */
 	int16_t curTrack;
 
+	/* Frames synthesized since the last rewind */
+	uint64_t renderedFrames;
+
+	/* Frame positions at which the song looped back, as
+	 * far as a pre-render needs to know them */
+	uint64_t wrapFrames[2];
+	uint8_t wrapCount;
+
+	/* Pre-rendered PCM of this song, if there is one,
+	 * which is then played back instead of synthesizing */
+	SDL_RWops *pcm;
+	MidiPCMInfo pcmInfo;
+	Sint64 pcmBase;
+	uint32_t pcmPos;
+
+	/* Cache key for 'pcmKeyShift', hashing the song is
+	 * not free so it's only redone when the pitch changes */
+	std::string pcmKey;
+	int8_t pcmKeyShift;
+
 	MidiSource(SDL_RWops &ops,
 	           bool looped)
 	    : freq(SYNTH_SAMPLERATE),
+	      synth(0),
+	      pooledSynth(true),
 	      looped(looped),
+	      loopDelta(0),
 	      dpb(480),
 	      pitchShift(0),
 	      genDeltasCarry(0),
-	      curTrack(-1)
+	      curTrack(-1),
+	      renderedFrames(0),
+	      wrapCount(0),
+	      pcm(0)
 	{
 		size_t dataLen = SDL_RWsize(&ops);
-		std::vector<uint8_t> data(dataLen);
+		midiData.resize(dataLen);
 
-		if (SDL_RWread(&ops, &data[0], 1, dataLen) < dataLen)
+		if (SDL_RWread(&ops, &midiData[0], 1, dataLen) < dataLen)
 		{
 			SDL_RWclose(&ops);
 			throw Exception(Exception::MKXPError, "Reading midi data failed");
@@ -633,7 +667,7 @@ struct MidiSource : ALDataSource, MidiReadHandler
 
 		try
 		{
-			readMidi(this, data);
+			init();
 		}
 		catch (const Exception &)
 		{
@@ -642,6 +676,32 @@ struct MidiSource : ALDataSource, MidiReadHandler
 		}
 
 		synth = shState->midiState().allocateSynth();
+	}
+
+	/* Used for pre-rendering, outside of any stream */
+	MidiSource(const std::vector<uint8_t> &data,
+	           bool looped,
+	           fluid_synth_t *synth)
+	    : freq(SYNTH_SAMPLERATE),
+	      synth(synth),
+	      pooledSynth(false),
+	      midiData(data),
+	      looped(looped),
+	      loopDelta(0),
+	      dpb(480),
+	      pitchShift(0),
+	      genDeltasCarry(0),
+	      curTrack(-1),
+	      renderedFrames(0),
+	      wrapCount(0),
+	      pcm(0)
+	{
+		init();
+	}
+
+	void init()
+	{
+		readMidi(this, midiData);
 
 		uint64_t longest = 0;
 
@@ -693,7 +753,19 @@ struct MidiSource : ALDataSource, MidiReadHandler
 
 	~MidiSource()
 	{
-		shState->midiState().releaseSynth(synth);
+		closePCM();
+
+		if (pooledSynth)
+			shState->midiState().releaseSynth(synth);
+	}
+
+	void closePCM()
+	{
+		if (!pcm)
+			return;
+
+		SDL_RWclose(pcm);
+		pcm = 0;
 	}
 
 
@@ -788,8 +860,8 @@ struct MidiSource : ALDataSource, MidiReadHandler
 			loopDelta = absDelta;
 	}
 
-	/* ALDataSource */
-	Status fillBuffer(AL::Buffer::ID buf)
+	/* Synthesizes the next BUF_FRAMES into 'synthBuf' */
+	void render()
 	{
 		/* In case there is no currently scheduled one */
 		for (size_t i = 0; i < tracks.size(); ++i)
@@ -817,6 +889,11 @@ struct MidiSource : ALDataSource, MidiReadHandler
 
 					int32_t prevOffset = track.remDeltas;
 
+					/* The song's last event, after which it loops back */
+					if (i == longestI && track.wrapAroundFlag && wrapCount < 2)
+						wrapFrames[wrapCount++] = renderedFrames
+							+ (BUF_TICKS - remTicks) * TICK_FRAMES;
+
 					activateEvent(track.event);
 
 					track.valid = false;
@@ -876,6 +953,58 @@ struct MidiSource : ALDataSource, MidiReadHandler
 					tracks[i].remDeltas -= intDeltas;
 		}
 
+		renderedFrames += BUF_FRAMES;
+	}
+
+	Status fillFromPCM(AL::Buffer::ID buf)
+	{
+		Status status = NoError;
+		uint32_t filled = 0;
+
+		while (filled < BUF_FRAMES)
+		{
+			if (pcmPos == pcmInfo.totalFrames)
+			{
+				if (!pcmInfo.looped)
+				{
+					status = EndOfStream;
+					break;
+				}
+
+				SDL_RWseek(pcm, pcmBase + pcmInfo.introFrames * FRAME_BYTES, RW_SEEK_SET);
+				pcmPos = pcmInfo.introFrames;
+			}
+
+			uint32_t count = std::min<uint32_t>(BUF_FRAMES - filled,
+			                                    pcmInfo.totalFrames - pcmPos);
+			size_t read = SDL_RWread(pcm, &synthBuf[filled*2], FRAME_BYTES, count);
+
+			if (read < count)
+			{
+				Debug() << "Midi: reading pre-rendered PCM failed";
+				return Error;
+			}
+
+			filled += count;
+			pcmPos += count;
+		}
+
+		/* The tail end of a song is padded out like a synthesized one */
+		memset(&synthBuf[filled*2], 0, (BUF_FRAMES - filled) * FRAME_BYTES);
+
+		AL::Buffer::uploadData(buf, AL_FORMAT_STEREO16, synthBuf, sizeof(synthBuf), freq);
+
+		return status;
+	}
+
+	/* ALDataSource */
+	Status fillBuffer(AL::Buffer::ID buf)
+	{
+		if (pcm)
+			return fillFromPCM(buf);
+
+		render();
+
 		/* Fill AL buffer */
 		AL::Buffer::uploadData(buf, AL_FORMAT_STEREO16, synthBuf, sizeof(synthBuf), freq);
 
@@ -892,6 +1021,35 @@ struct MidiSource : ALDataSource, MidiReadHandler
 
 	/* Midi sources cannot seek, and so always reset to beginning */
 	void seekToOffset(float)
+	{
+		closePCM();
+
+		if (MidiPCMCache *cache = shState->midiState().pcmCache)
+		{
+			if (pcmKey.empty() || pcmKeyShift != pitchShift)
+			{
+				pcmKey = cache->makeKey(midiData, looped, pitchShift);
+				pcmKeyShift = pitchShift;
+			}
+
+			pcm = cache->open(pcmKey, pcmInfo);
+
+			if (pcm)
+			{
+				pcmBase = SDL_RWtell(pcm);
+				pcmPos = 0;
+
+				return;
+			}
+
+			/* Synthesize live this time around */
+			cache->requestRender(pcmKey, midiData, looped, pitchShift);
+		}
+
+		rewind();
+	}
+
+	void rewind()
 	{
 		/* Reset synth */
 		fluid.synth_system_reset(synth);
@@ -900,6 +1058,9 @@ struct MidiSource : ALDataSource, MidiReadHandler
 		genDeltasCarry = 0;
 		updatePlaybackSpeed(DEFAULT_BPM);
 
+		renderedFrames = 0;
+		wrapCount = 0;
+
 		/* Reset tracks */
 		for (size_t i = 0; i < tracks.size(); ++i)
 			tracks[i].reset();
@@ -921,3 +1082,62 @@ ALDataSource *createMidiSource(SDL_RWops &ops,
 {
 	return new MidiSource(ops, looped);
 }
+
+bool renderMidiPCM(const std::vector<uint8_t> &data,
+                   bool looped, int8_t pitchShift,
+                   fluid_synth_t *synth, uint32_t maxFrames,
+                   MidiPCMSink &sink, MidiPCMInfo &info)
+{
+	try
+	{
+		MidiSource source(data, looped, synth);
+		source.pitchShift = pitchShift;
+		source.rewind();
+
+		while (true)
+		{
+			source.render();
+
+			uint64_t start = source.renderedFrames - BUF_FRAMES;
+			uint32_t count = BUF_FRAMES;
+
+			/* The second pass through the loop is what gets repeated,
+			 * so notes ringing out over the loop point carry over
+			 * exactly like they do when synthesizing live */
+			bool loopDone = looped && source.wrapCount == 2;
+
+			if (loopDone)
+				count = source.wrapFrames[1] - start;
+
+			if (start + count > maxFrames)
+				return false;
+
+			if (!sink.write(source.synthBuf, count))
+				return false;
+
+			if (loopDone)
+			{
+				info.introFrames = source.wrapFrames[0];
+				info.totalFrames = source.wrapFrames[1];
+				info.looped = true;
+
+				return true;
+			}
+
+			if (source.tracks[source.longestI].atEnd)
+			{
+				info.introFrames = 0;
+				info.totalFrames = start + count;
+				info.looped = false;
+
+				return true;
+			}
+		}
+	}
+	catch (const Exception &e)
+	{
+		Debug() << "Midi: pre-rendering failed:" << e.msg;
+	}
+
+	return false;
+}
@@ -25,6 +25,7 @@
 #include "config.h"
 #include "debugwriter.h"
 #include "fluid-fun.h"
+#include "midicache.h"
 
 #include <assert.h>
 #include <vector>
@@ -46,9 +47,13 @@ struct SharedMidiState
 	const std::string &soundFont;
 	fluid_settings_t *flSettings;
 
+	/* Only set up if pre-rendering is enabled */
+	MidiPCMCache *pcmCache;
+
 	SharedMidiState(const Config &conf)
 	    : inited(false),
-	      soundFont(conf.midi.soundFont)
+	      soundFont(conf.midi.soundFont),
+	      pcmCache(0)
 	{}
 
 	~SharedMidiState()
@@ -58,6 +63,9 @@ struct SharedMidiState
 		if (!inited || !HAVE_FLUID)
 			return;
 
+		/* Its render thread still uses the settings */
+		delete pcmCache;
+
 		fluid.delete_settings(flSettings);
 
 		for (size_t i = 0; i < synths.size(); ++i)
@@ -87,6 +95,9 @@ struct SharedMidiState
 
 		for (size_t i = 0; i < SYNTH_INIT_COUNT; ++i)
 			addSynth(false);
+
+		if (conf.midi.prerender)
+			pcmCache = new MidiPCMCache(conf, flSettings);
 	}
 
 	fluid_synth_t *allocateSynth()
@@ -27,10 +27,11 @@
 #include "config.h"
 #include "util.h"
 #include "debugwriter.h"
+#include "sdl-util.h"
 
 #include <SDL_sound.h>
-
-#define SE_CACHE_MEM (10*1024*1024) // 10 MB
+#include <SDL_mutex.h>
+#include <SDL_timer.h>
 
 struct SoundBuffer
 {
@@ -90,10 +91,17 @@ arrayPushBack(std::vector<size_t> &array, size_t size, size_t index)
 
 SoundEmitter::SoundEmitter(const Config &conf)
     : bufferBytes(0),
+      cacheCapacity((uint32_t) conf.SE.cacheSize * 1024 * 1024),
+      maxLatency(conf.SE.maxLatency),
+      hits(0),
+      misses(0),
+      evictions(0),
       srcCount(conf.SE.sourceCount),
       alSrcs(srcCount),
       atchBufs(srcCount),
-      srcPrio(srcCount)
+      srcPrio(srcCount),
+      decoding(false),
+      decodeQuit(false)
 {
 	for (size_t i = 0; i < srcCount; ++i)
 	{
@@ -101,10 +109,32 @@ SoundEmitter::SoundEmitter(const Config &conf)
 		atchBufs[i] = 0;
 		srcPrio[i] = i;
 	}
+
+	mutex = SDL_CreateMutex();
+	decodeCond = SDL_CreateCond();
+
+	decodeThread = createSDLThread
+		<SoundEmitter, &SoundEmitter::decodeWorker>(this, "se_decode");
+
+	if (!decodeThread)
+		Debug() << "Failed to start SE decoding thread:" << SDL_GetError();
 }
 
 SoundEmitter::~SoundEmitter()
 {
+	if (decodeThread)
+	{
+		SDL_LockMutex(mutex);
+		decodeQuit = true;
+		SDL_CondSignal(decodeCond);
+		SDL_UnlockMutex(mutex);
+
+		SDL_WaitThread(decodeThread, 0);
+	}
+
+	SDL_DestroyCond(decodeCond);
+	SDL_DestroyMutex(mutex);
+
 	for (size_t i = 0; i < srcCount; ++i)
 	{
 		AL::Source::stop(alSrcs[i]);
@@ -119,6 +149,91 @@ SoundEmitter::~SoundEmitter()
 		SoundBuffer::deref(iter->second);
 }
 
+struct SoundOpenHandler : FileSystem::OpenHandler
+{
+	SoundBuffer *buffer;
+
+	SoundOpenHandler()
+	    : buffer(0)
+	{}
+
+	bool tryRead(SDL_RWops &ops, const char *ext)
+	{
+		Sound_Sample *sample = Sound_NewSample(&ops, ext, 0, STREAM_BUF_SIZE);
+
+		if (!sample)
+		{
+			SDL_RWclose(&ops);
+			return false;
+		}
+
+		/* Do all of the decoding in the handler so we don't have
+		 * to keep the source ops around */
+		uint32_t decBytes = Sound_DecodeAll(sample);
+		uint8_t sampleSize = formatSampleSize(sample->actual.format);
+		uint32_t sampleCount = decBytes / sampleSize;
+
+		buffer = new SoundBuffer;
+		buffer->bytes = sampleSize * sampleCount;
+
+		ALenum alFormat = chooseALFormat(sampleSize, sample->actual.channels);
+
+		AL::Buffer::uploadData(buffer->alBuffer, alFormat, sample->buffer,
+							   buffer->bytes, sample->actual.rate);
+
+		Sound_FreeSample(sample);
+
+		return true;
+	}
+};
+
+/* Accepts the first candidate without opening it */
+struct SoundExistsHandler : FileSystem::OpenHandler
+{
+	bool tryRead(SDL_RWops &ops, const char *)
+	{
+		SDL_RWclose(&ops);
+		return false;
+	}
+
+	bool tryPath(const char *)
+	{
+		return true;
+	}
+};
+
+/* Decoding on the worker can't report a missing file to
+ * the caller anymore, so look for it on the calling thread */
+static void checkExists(const std::string &filename)
+{
+	SoundExistsHandler handler;
+
+	if (!shState->fileSystem().tryOpenRead(handler, filename.c_str()))
+		throw Exception(Exception::NoFileError, "%s", filename.c_str());
+}
+
+/* Thread safe; doesn't touch the cache */
+static SoundBuffer *decodeBuffer(const std::string &filename)
+{
+	SoundOpenHandler handler;
+	shState->fileSystem().openRead(handler, filename.c_str());
+	SoundBuffer *buffer = handler.buffer;
+
+	if (!buffer)
+	{
+		char buf[512];
+		snprintf(buf, sizeof(buf), "Unable to decode sound: %s: %s",
+		         filename.c_str(), Sound_GetError());
+		Debug() << buf;
+
+		return 0;
+	}
+
+	buffer->key = filename;
+
+	return buffer;
+}
+
 void SoundEmitter::play(const std::string &filename,
                         int volume,
                         int pitch)
@@ -126,11 +241,62 @@ void SoundEmitter::play(const std::string &filename,
 	float _volume = clamp<int>(volume, 0, 100) / 100.0f;
 	float _pitch  = clamp<int>(pitch, 50, 150) / 100.0f;
 
-	SoundBuffer *buffer = allocateBuffer(filename);
+	SDL_LockMutex(mutex);
 
-	if (!buffer)
-		return;
+	SoundBuffer *buffer = lookupBuffer(filename);
+
+	if (buffer)
+	{
+		++hits;
+	}
+	else
+	{
+		++misses;
+
+		if (maxLatency > 0 && decodeThread)
+		{
+			SDL_UnlockMutex(mutex);
+			checkExists(filename);
+			SDL_LockMutex(mutex);
+
+			/* Let the worker start it once it's decoded. Repeated
+			 * requests meanwhile would all start at the same time,
+			 * so they collapse into the latest one */
+			PendingPlay pending = { filename, _volume, _pitch, SDL_GetTicks() };
+			size_t i;
+
+			for (i = 0; i < pendingPlays.size(); ++i)
+				if (pendingPlays[i].filename == filename)
+					break;
+
+			if (i < pendingPlays.size())
+				pendingPlays[i] = pending;
+			else
+				pendingPlays.push_back(pending);
+
+			enqueueDecode(filename);
+
+			SDL_UnlockMutex(mutex);
+
+			return;
+		}
 
+		SDL_UnlockMutex(mutex);
+		buffer = decodeBuffer(filename);
+		SDL_LockMutex(mutex);
+
+		if (buffer)
+			buffer = insertBuffer(buffer);
+	}
+
+	if (buffer)
+		playBuffer(buffer, _volume, _pitch);
+
+	SDL_UnlockMutex(mutex);
+}
+
+void SoundEmitter::playBuffer(SoundBuffer *buffer, float volume, float pitch)
+{
 	/* Try to find first free source */
 	size_t i;
 	for (i = 0; i < srcCount; ++i)
@@ -172,57 +338,69 @@ void SoundEmitter::play(const std::string &filename,
 	if (switchBuffer)
 		AL::Source::attachBuffer(src, buffer->alBuffer);
 
-	AL::Source::setVolume(src, _volume * GLOBAL_VOLUME);
-	AL::Source::setPitch(src, _pitch);
+	AL::Source::setVolume(src, volume * GLOBAL_VOLUME);
+	AL::Source::setPitch(src, pitch);
 
 	AL::Source::play(src);
 }
 
 void SoundEmitter::stop()
 {
+	SDL_LockMutex(mutex);
+
 	for (size_t i = 0; i < srcCount; i++)
 		AL::Source::stop(alSrcs[i]);
+
+	/* Sounds still being decoded shouldn't start anymore either */
+	pendingPlays.clear();
+
+	SDL_UnlockMutex(mutex);
 }
 
-struct SoundOpenHandler : FileSystem::OpenHandler
+void SoundEmitter::preload(const std::string &filename)
 {
-	SoundBuffer *buffer;
-
-	SoundOpenHandler()
-	    : buffer(0)
-	{}
+	SDL_LockMutex(mutex);
 
-	bool tryRead(SDL_RWops &ops, const char *ext)
+	if (!bufferHash.contains(filename))
 	{
-		Sound_Sample *sample = Sound_NewSample(&ops, ext, 0, STREAM_BUF_SIZE);
-
-		if (!sample)
+		if (decodeThread)
 		{
-			SDL_RWclose(&ops);
-			return false;
-		}
+			SDL_UnlockMutex(mutex);
+			checkExists(filename);
+			SDL_LockMutex(mutex);
 
-		/* Do all of the decoding in the handler so we don't have
-		 * to keep the source ops around */
-		uint32_t decBytes = Sound_DecodeAll(sample);
-		uint8_t sampleSize = formatSampleSize(sample->actual.format);
-		uint32_t sampleCount = decBytes / sampleSize;
+			enqueueDecode(filename);
+		}
+		else
+		{
+			SDL_UnlockMutex(mutex);
+			SoundBuffer *buffer = decodeBuffer(filename);
+			SDL_LockMutex(mutex);
 
-		buffer = new SoundBuffer;
-		buffer->bytes = sampleSize * sampleCount;
+			if (buffer)
+				insertBuffer(buffer);
+		}
+	}
 
-		ALenum alFormat = chooseALFormat(sampleSize, sample->actual.channels);
+	SDL_UnlockMutex(mutex);
+}
 
-		AL::Buffer::uploadData(buffer->alBuffer, alFormat, sample->buffer,
-							   buffer->bytes, sample->actual.rate);
+void SoundEmitter::getCacheStats(SECacheStats &out)
+{
+	SDL_LockMutex(mutex);
 
-		Sound_FreeSample(sample);
+	out.hits = hits;
+	out.misses = misses;
+	out.evictions = evictions;
+	out.entries = buffers.getSize();
+	out.size = bufferBytes;
+	out.capacity = cacheCapacity;
+	out.pending = decodeQueue.size() + (decoding ? 1 : 0);
 
-		return true;
-	}
-};
+	SDL_UnlockMutex(mutex);
+}
 
-SoundBuffer *SoundEmitter::allocateBuffer(const std::string &filename)
+SoundBuffer *SoundEmitter::lookupBuffer(const std::string &filename)
 {
 	SoundBuffer *buffer = bufferHash.value(filename, 0);
 
@@ -232,47 +410,113 @@ SoundBuffer *SoundEmitter::allocateBuffer(const std::string &filename)
 		 * Move to front of priority list */
 		buffers.remove(buffer->link);
 		buffers.append(buffer->link);
+	}
 
-		return buffer;
+	return buffer;
+}
+
+SoundBuffer *SoundEmitter::insertBuffer(SoundBuffer *buffer)
+{
+	/* Someone else decoded the same file in the meantime */
+	if (SoundBuffer *existing = bufferHash.value(buffer->key, 0))
+	{
+		SoundBuffer::deref(buffer);
+
+		return existing;
 	}
-	else
+
+	uint32_t wouldBeBytes = bufferBytes + buffer->bytes;
+
+	/* If memory limit is reached, delete lowest priority buffer
+	 * until there is room or no buffers left */
+	while (wouldBeBytes > cacheCapacity && !buffers.isEmpty())
 	{
-		/* Buffer not in cache, needs to be loaded */
-		SoundOpenHandler handler;
-		shState->fileSystem().openRead(handler, filename.c_str());
-		buffer = handler.buffer;
+		SoundBuffer *last = buffers.tail();
+		bufferHash.remove(last->key);
+		buffers.remove(last->link);
 
-		if (!buffer)
-		{
-			char buf[512];
-			snprintf(buf, sizeof(buf), "Unable to decode sound: %s: %s",
-			         filename.c_str(), Sound_GetError());
-			Debug() << buf;
+		wouldBeBytes -= last->bytes;
+		++evictions;
 
-			return 0;
-		}
+		SoundBuffer::deref(last);
+	}
 
-		buffer->key = filename;
-		uint32_t wouldBeBytes = bufferBytes + buffer->bytes;
+	bufferHash.insert(buffer->key, buffer);
+	buffers.prepend(buffer->link);
 
-		/* If memory limit is reached, delete lowest priority buffer
-		 * until there is room or no buffers left */
-		while (wouldBeBytes > SE_CACHE_MEM && !buffers.isEmpty())
-		{
-			SoundBuffer *last = buffers.tail();
-			bufferHash.remove(last->key);
-			buffers.remove(last->link);
+	bufferBytes = wouldBeBytes;
+
+	return buffer;
+}
 
-			wouldBeBytes -= last->bytes;
+void SoundEmitter::enqueueDecode(const std::string &filename)
+{
+	if (decodeJobs.contains(filename))
+		return;
+
+	decodeJobs.insert(filename);
+	decodeQueue.push_back(filename);
+
+	SDL_CondSignal(decodeCond);
+}
 
-			SoundBuffer::deref(last);
+void SoundEmitter::decodeWorker()
+{
+	SDL_LockMutex(mutex);
+
+	while (true)
+	{
+		while (decodeQueue.empty() && !decodeQuit)
+			SDL_CondWait(decodeCond, mutex);
+
+		if (decodeQuit)
+			break;
+
+		std::string filename = decodeQueue.front();
+		decodeQueue.pop_front();
+		decoding = true;
+
+		SDL_UnlockMutex(mutex);
+
+		SoundBuffer *buffer = 0;
+
+		try
+		{
+			buffer = decodeBuffer(filename);
+		}
+		catch (const Exception &e)
+		{
+			/* Drop the job; sounds waiting on it won't play */
+			Debug() << "Unable to load sound:" << e.msg;
 		}
 
-		bufferHash.insert(filename, buffer);
-		buffers.prepend(buffer->link);
+		SDL_LockMutex(mutex);
 
-		bufferBytes = wouldBeBytes;
+		decodeJobs.remove(filename);
+		decoding = false;
 
-		return buffer;
+		if (buffer)
+			buffer = insertBuffer(buffer);
+
+		uint32_t now = SDL_GetTicks();
+
+		for (size_t i = 0; i < pendingPlays.size();)
+		{
+			PendingPlay &pending = pendingPlays[i];
+
+			if (pending.filename != filename)
+			{
+				++i;
+				continue;
+			}
+
+			/* A sound effect arriving too late is worse than none */
+			if (buffer && now - pending.ticks <= maxLatency)
+				playBuffer(buffer, pending.volume, pending.pitch);
+
+			pendingPlays.erase(pendingPlays.begin() + i);
+		}
 	}
+
+	SDL_UnlockMutex(mutex);
 }
@@ -25,13 +25,34 @@
 #include "intrulist.h"
 #include "al-util.h"
 #include "boost-hash.h"
+#include "cachestats.h"
 
 #include <string>
 #include <vector>
+#include <deque>
 
 struct SoundBuffer;
 struct Config;
+struct SDL_mutex;
+struct SDL_cond;
+struct SDL_Thread;
 
+struct SECacheStats : CacheStats
+{
+	/* Bytes of decoded audio currently held */
+	size_t size;
+	size_t capacity;
+
+	/* Files queued for or being decoded */
+	size_t pending;
+};
+
+/* Sounds not in the cache are decoded on a worker thread,
+ * so the first play of a long SE doesn't stall the game.
+ * The sound starts once its decode finishes, provided that
+ * is within 'maxLatency' ms of the play request; otherwise
+ * it's dropped (but stays cached for the next request).
+ * All members are guarded by 'mutex' */
 struct SoundEmitter
 {
 	typedef BoostHash<std::string, SoundBuffer*> BufferHash;
@@ -41,6 +62,14 @@ struct SoundEmitter
 
 	/* Byte count sum of all cached / playing buffers */
 	uint32_t bufferBytes;
+	const uint32_t cacheCapacity;
+
+	/* 0 means decode on the calling thread */
+	const uint32_t maxLatency;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
 
 	const size_t srcCount;
 	std::vector<AL::Source::ID> alSrcs;
@@ -49,6 +78,27 @@ struct SoundEmitter
 	/* Indices of sources, sorted by priority (lowest first) */
 	std::vector<size_t> srcPrio;
 
+	/* Plays waiting for their buffer to be decoded */
+	struct PendingPlay
+	{
+		std::string filename;
+		float volume;
+		float pitch;
+		uint32_t ticks;
+	};
+
+	std::vector<PendingPlay> pendingPlays;
+
+	std::deque<std::string> decodeQueue;
+	/* Queued or being decoded */
+	BoostSet<std::string> decodeJobs;
+	bool decoding;
+
+	SDL_mutex *mutex;
+	SDL_cond *decodeCond;
+	SDL_Thread *decodeThread;
+	bool decodeQuit;
+
 	SoundEmitter(const Config &conf);
 	~SoundEmitter();
 
@@ -58,8 +108,19 @@ struct SoundEmitter
 
 	void stop();
 
+	/* Decodes 'filename' into the cache ahead of time */
+	void preload(const std::string &filename);
+
+	void getCacheStats(SECacheStats &out);
+
 private:
-	SoundBuffer *allocateBuffer(const std::string &filename);
+	/* These require the lock */
+	SoundBuffer *lookupBuffer(const std::string &filename);
+	SoundBuffer *insertBuffer(SoundBuffer *buffer);
+	void enqueueDecode(const std::string &filename);
+	void playBuffer(SoundBuffer *buffer, float volume, float pitch);
+
+	void decodeWorker();
 };
 
 #endif // SOUNDEMITTER_H
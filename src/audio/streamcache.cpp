@@ -0,0 +1,198 @@
+/*
+** streamcache.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "streamcache.h"
+
+#include "config.h"
+
+#include <utility>
+
+static void
+derefHead(StreamHead *head)
+{
+	if (--head->refCount == 0)
+		delete head;
+}
+
+static bool
+sameFormat(const StreamFormat &a, const StreamFormat &b)
+{
+	return a.channels == b.channels && a.rate == b.rate
+	    && a.loopStart == b.loopStart && a.loopLength == b.loopLength;
+}
+
+static bool
+overlaps(const StreamSegment &a, const StreamSegment &b)
+{
+	return a.start < b.start + b.frames && b.start < a.start + a.frames;
+}
+
+const StreamSegment *StreamHead::segmentAt(uint32_t frame) const
+{
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		const StreamSegment &seg = segments[i];
+
+		if (frame >= seg.start && frame - seg.start < seg.frames)
+			return &seg;
+	}
+
+	return 0;
+}
+
+StreamCache::StreamCache(const Config &conf)
+    : bytes(0),
+      capacity((uint32_t) conf.BGM.cacheSize * 1024 * 1024),
+      headSeconds(conf.BGM.cacheHeadLength)
+{
+	mutex = SDL_CreateMutex();
+}
+
+StreamCache::~StreamCache()
+{
+	while (StreamHead *head = priorityList.tail())
+		evict(head);
+
+	SDL_DestroyMutex(mutex);
+}
+
+bool StreamCache::enabled() const
+{
+	return capacity > 0;
+}
+
+uint32_t StreamCache::headFrames(int rate) const
+{
+	return headSeconds * rate;
+}
+
+StreamHead *StreamCache::lookup(const std::string &key)
+{
+	SDL_LockMutex(mutex);
+
+	StreamHead *head = heads.value(key, 0);
+
+	if (head)
+	{
+		/* Move to front of priority list */
+		priorityList.remove(head->link);
+		priorityList.prepend(head->link);
+
+		++head->refCount;
+	}
+
+	SDL_UnlockMutex(mutex);
+
+	return head;
+}
+
+void StreamCache::release(StreamHead *head)
+{
+	SDL_LockMutex(mutex);
+	derefHead(head);
+	SDL_UnlockMutex(mutex);
+}
+
+void StreamCache::store(const std::string &key, const StreamFormat &format,
+                        StreamSegment &segment, bool complete)
+{
+	if (segment.frames == 0)
+		return;
+
+	SDL_LockMutex(mutex);
+
+	StreamHead *old = heads.value(key, 0);
+
+	StreamHead *head = new StreamHead;
+	head->key = key;
+	head->format = format;
+	head->complete = complete;
+
+	/* Keep the other cached segments, unless the
+	 * stream has changed underneath us */
+	if (old && sameFormat(old->format, format))
+	{
+		for (size_t i = 0; i < old->segments.size(); ++i)
+		{
+			const StreamSegment &seg = old->segments[i];
+
+			if (!overlaps(seg, segment))
+			{
+				head->segments.push_back(seg);
+				continue;
+			}
+
+			/* Nothing new to add */
+			if (seg.start <= segment.start
+			&&  seg.start + seg.frames >= segment.start + segment.frames)
+			{
+				SDL_UnlockMutex(mutex);
+				delete head;
+
+				return;
+			}
+		}
+
+		head->complete |= old->complete;
+	}
+
+	head->segments.push_back(StreamSegment());
+	head->segments.back().start = segment.start;
+	head->segments.back().frames = segment.frames;
+	head->segments.back().samples.swap(segment.samples);
+
+	/* Keep the stream's beginning first */
+	if (head->segments.size() > 1 && head->segments[0].start > head->segments[1].start)
+		std::swap(head->segments[0], head->segments[1]);
+
+	for (size_t i = 0; i < head->segments.size(); ++i)
+		head->bytes += head->segments[i].samples.size() * sizeof(int16_t);
+
+	if (old)
+		evict(old);
+
+	/* If memory limit is reached, drop lowest priority
+	 * heads until there is room or no heads left */
+	while (bytes + head->bytes > capacity && !priorityList.isEmpty())
+		evict(priorityList.tail());
+
+	if (bytes + head->bytes > capacity)
+	{
+		derefHead(head);
+	}
+	else
+	{
+		heads.insert(key, head);
+		priorityList.prepend(head->link);
+		bytes += head->bytes;
+	}
+
+	SDL_UnlockMutex(mutex);
+}
+
+void StreamCache::evict(StreamHead *head)
+{
+	heads.remove(head->key);
+	priorityList.remove(head->link);
+	bytes -= head->bytes;
+
+	derefHead(head);
+}
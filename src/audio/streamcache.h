@@ -0,0 +1,132 @@
+/*
+** streamcache.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STREAMCACHE_H
+#define STREAMCACHE_H
+
+#include "intrulist.h"
+#include "boost-hash.h"
+
+#include <SDL_mutex.h>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct Config;
+
+struct StreamFormat
+{
+	int channels;
+	int rate;
+
+	/* In frames, both 0 if the stream doesn't loop */
+	uint32_t loopStart;
+	uint32_t loopLength;
+};
+
+/* A decoded run of frames, starting at frame 'start' */
+struct StreamSegment
+{
+	uint32_t start;
+	uint32_t frames;
+	std::vector<int16_t> samples;
+
+	StreamSegment()
+	    : start(0),
+	      frames(0)
+	{}
+};
+
+/* The decoded parts of a stream that are kept around:
+ * its beginning, and (if it isn't covered by that) the
+ * beginning of its loop region. Immutable once cached */
+struct StreamHead
+{
+	std::string key;
+
+	StreamFormat format;
+	std::vector<StreamSegment> segments;
+
+	/* Set if segment 0 holds the entire stream,
+	 * ie. it ends right where the stream does */
+	bool complete;
+
+	uint32_t bytes;
+
+	/* Guarded by the cache mutex */
+	uint32_t refCount;
+
+	IntruListLink<StreamHead> link;
+
+	StreamHead()
+	    : complete(false),
+	      bytes(0),
+	      refCount(1),
+	      link(this)
+	{}
+
+	/* Segment containing 'frame', or 0 */
+	const StreamSegment *segmentAt(uint32_t frame) const;
+};
+
+/* Bounded LRU cache of the heads of recently streamed
+ * tracks, so that replaying one of them can start from
+ * memory while the decoder is (re)opened in the background.
+ * Shared by all streams, safe to use from any thread */
+class StreamCache
+{
+public:
+	StreamCache(const Config &conf);
+	~StreamCache();
+
+	bool enabled() const;
+
+	/* How many frames of a stream's beginning (or
+	 * loop region) are worth keeping at 'rate' */
+	uint32_t headFrames(int rate) const;
+
+	/* Returns a reference to the cached head of 'key',
+	 * or 0. Has to be given back via release() */
+	StreamHead *lookup(const std::string &key);
+	void release(StreamHead *head);
+
+	/* Adds a freshly decoded segment of 'key', merging it
+	 * with what is already cached for it. Takes over the
+	 * samples in 'segment'. 'complete' means that the
+	 * segment starts at 0 and spans the whole stream */
+	void store(const std::string &key, const StreamFormat &format,
+	           StreamSegment &segment, bool complete);
+
+private:
+	void evict(StreamHead *head);
+
+	BoostHash<std::string, StreamHead*> heads;
+	IntruList<StreamHead> priorityList;
+
+	uint32_t bytes;
+	uint32_t capacity;
+	uint32_t headSeconds;
+
+	SDL_mutex *mutex;
+};
+
+#endif // STREAMCACHE_H
@@ -20,7 +20,9 @@
 */
 
 #include "aldatasource.h"
+#include "streamcache.h"
 #include "exception.h"
+#include "debugwriter.h"
 
 #define OV_EXCLUDE_STATIC_CALLBACKS
 #include <vorbis/vorbisfile.h>
@@ -57,8 +59,15 @@ struct VorbisSource : ALDataSource
 
 	OggVorbis_File vf;
 
+	/* Opening the decoder is put off for as long
+	 * as we're playing from a cached head */
+	bool opened;
+
 	uint32_t currentFrame;
 
+	/* Whether 'vf' is positioned at 'currentFrame' */
+	bool decoderSynced;
+
 	struct
 	{
 		uint32_t start;
@@ -78,30 +87,58 @@ struct VorbisSource : ALDataSource
 
 	std::vector<int16_t> sampleBuf;
 
+	StreamCache *cache;
+	std::string cacheKey;
+
+	/* What the cache had of this stream when we last looked */
+	StreamHead *head;
+
+	/* Segment being recorded while decoding live */
+	StreamSegment rec;
+	bool recording;
+
 	VorbisSource(SDL_RWops &ops,
-	             bool looped)
+	             bool looped,
+	             StreamCache *cache,
+	             const std::string &cacheKey)
 	    : src(ops),
-	      currentFrame(0)
+	      opened(false),
+	      currentFrame(0),
+	      decoderSynced(false),
+	      cache(cache),
+	      cacheKey(cacheKey),
+	      head(0),
+	      recording(false)
 	{
-		int error = ov_open_callbacks(&src, &vf, 0, 0, OvCallbacks);
+		loop.requested = looped;
+		loop.valid = false;
+		loop.start = loop.length = 0;
 
-		if (error)
+		if (cache && cache->enabled())
+			head = cache->lookup(cacheKey);
+		else
+			this->cache = 0;
+
+		if (head)
 		{
-			SDL_RWclose(&src);
-			throw Exception(Exception::MKXPError,
-			                "Vorbisfile: Cannot read ogg file");
+			/* Everything we'd otherwise learn from the headers */
+			info.channels = head->format.channels;
+			info.rate = head->format.rate;
+			loop.start = head->format.loopStart;
+			loop.length = head->format.loopLength;
 		}
+		else
+		{
+			if (const char *error = openDecoder())
+			{
+				if (opened)
+					ov_clear(&vf);
 
-		/* Extract bitstream info */
-		info.channels = vf.vi->channels;
-		info.rate = vf.vi->rate;
+				SDL_RWclose(&src);
+				throw Exception(Exception::MKXPError, "%s", error);
+			}
 
-		if (info.channels > 2)
-		{
-			ov_clear(&vf);
-			SDL_RWclose(&src);
-			throw Exception(Exception::MKXPError,
-			                "Cannot handle audio with more than 2 channels");
+			readLoopInfo();
 		}
 
 		info.alFormat = chooseALFormat(sizeof(int16_t), info.channels);
@@ -109,10 +146,52 @@ struct VorbisSource : ALDataSource
 
 		sampleBuf.resize(STREAM_BUF_SIZE);
 
-		loop.requested = looped;
-		loop.valid = false;
-		loop.start = loop.length = 0;
+		loop.end = loop.start + loop.length;
+		loop.valid = (loop.start && loop.length);
+	}
+
+	~VorbisSource()
+	{
+		finishRecording(false);
+
+		if (head)
+			cache->release(head);
+
+		if (opened)
+			ov_clear(&vf);
 
+		SDL_RWclose(&src);
+	}
+
+	/* Returns an error message on failure */
+	const char *openDecoder()
+	{
+		if (ov_open_callbacks(&src, &vf, 0, 0, OvCallbacks))
+			return "Vorbisfile: Cannot read ogg file";
+
+		opened = true;
+
+		if (head)
+		{
+			/* The file changed since it was cached */
+			if (vf.vi->channels != info.channels || vf.vi->rate != info.rate)
+				return "Vorbisfile: Stream differs from cached one";
+
+			return 0;
+		}
+
+		/* Extract bitstream info */
+		info.channels = vf.vi->channels;
+		info.rate = vf.vi->rate;
+
+		if (info.channels > 2)
+			return "Cannot handle audio with more than 2 channels";
+
+		return 0;
+	}
+
+	void readLoopInfo()
+	{
 		if (!loop.requested)
 			return;
 
@@ -140,15 +219,76 @@ struct VorbisSource : ALDataSource
 
 			*sep = '=';
 		}
+	}
 
-		loop.end = loop.start + loop.length;
-		loop.valid = (loop.start && loop.length);
+	/* Starts recording the live decode from 'currentFrame'
+	 * on, if that part isn't in the cache yet */
+	void beginRecording()
+	{
+		finishRecording(false);
+
+		if (!cache)
+			return;
+
+		if (head && head->segmentAt(currentFrame))
+			return;
+
+		/* Only the beginning and the loop start are worth it */
+		if (currentFrame != 0 && !(loop.valid && currentFrame == loop.start))
+			return;
+
+		rec.start = currentFrame;
+		rec.frames = 0;
+		rec.samples.reserve(cache->headFrames(info.rate) * info.channels);
+		recording = true;
 	}
 
-	~VorbisSource()
+	void finishRecording(bool reachedEOF)
 	{
-		ov_clear(&vf);
-		SDL_RWclose(&src);
+		if (!recording)
+			return;
+
+		recording = false;
+
+		StreamFormat format;
+		format.channels = info.channels;
+		format.rate = info.rate;
+		format.loopStart = loop.start;
+		format.loopLength = loop.length;
+
+		cache->store(cacheKey, format, rec, reachedEOF && rec.start == 0);
+
+		rec.samples.clear();
+		rec.frames = 0;
+
+		/* Pick up what we just stored (and anything
+		 * other streams might have added) */
+		if (head)
+			cache->release(head);
+
+		head = cache->lookup(cacheKey);
+	}
+
+	void record(const int16_t *samples, uint32_t frame, uint32_t count)
+	{
+		if (!recording)
+			return;
+
+		/* Decoding jumped somewhere else */
+		if (frame != rec.start + rec.frames)
+		{
+			finishRecording(false);
+			return;
+		}
+
+		uint32_t room = cache->headFrames(info.rate) - rec.frames;
+		count = std::min(count, room);
+
+		rec.samples.insert(rec.samples.end(), samples, samples + count * info.channels);
+		rec.frames += count;
+
+		if (rec.frames == cache->headFrames(info.rate))
+			finishRecording(false);
 	}
 
 	int sampleRate()
@@ -159,23 +299,91 @@ struct VorbisSource : ALDataSource
 	void seekToOffset(float seconds)
 	{
 		if (seconds <= 0)
-		{
-			ov_raw_seek(&vf, 0);
 			currentFrame = 0;
-		}
-
-		currentFrame = seconds * info.rate;
+		else
+			currentFrame = seconds * info.rate;
 
-		if (loop.valid && currentFrame > loop.end)
+		if (loop.valid && currentFrame >= loop.end)
 			currentFrame = loop.start;
 
+		/* The decoder catches up once it's needed */
+		decoderSynced = false;
+
+		beginRecording();
+	}
+
+	/* Positions the decoder at 'currentFrame' */
+	bool syncDecoder()
+	{
+		if (!opened)
+		{
+			if (const char *error = openDecoder())
+			{
+				Debug() << error;
+				return false;
+			}
+		}
+
 		/* If seeking fails, just seek back to start */
 		if (ov_pcm_seek(&vf, currentFrame) != 0)
+		{
 			ov_raw_seek(&vf, 0);
+			currentFrame = 0;
+		}
+
+		decoderSynced = true;
+
+		return true;
+	}
+
+	Status fillFromHead(AL::Buffer::ID alBuffer, const StreamSegment &seg)
+	{
+		/* Same amount per buffer as decoding live */
+		uint32_t offset = currentFrame - seg.start;
+		uint32_t count = std::min<uint32_t>(sampleBuf.size() / info.frameSize,
+		                                    seg.frames - offset);
+
+		decoderSynced = false;
+
+		Status retStatus = ALDataSource::NoError;
+
+		if (loop.valid && currentFrame + count >= loop.end)
+		{
+			count = loop.end - currentFrame;
+			retStatus = ALDataSource::WrapAround;
+		}
+		else if (head->complete && seg.start == 0 && offset + count == seg.frames)
+		{
+			retStatus = loop.requested ? ALDataSource::WrapAround
+			                           : ALDataSource::EndOfStream;
+		}
+
+		AL::Buffer::uploadData(alBuffer, info.alFormat, &seg.samples[offset * info.channels],
+		                       count * info.frameSize, info.rate);
+
+		if (retStatus == ALDataSource::WrapAround)
+		{
+			currentFrame = loop.valid ? loop.start : 0;
+			decoderSynced = false;
+			beginRecording();
+		}
+		else
+		{
+			currentFrame += count;
+		}
+
+		return retStatus;
 	}
 
 	Status fillBuffer(AL::Buffer::ID alBuffer)
 	{
+		if (head)
+			if (const StreamSegment *seg = head->segmentAt(currentFrame))
+				return fillFromHead(alBuffer, *seg);
+
+		if (!decoderSynced && !syncDecoder())
+			return ALDataSource::Error;
+
 		void *bufPtr = sampleBuf.data();
 		int availBuf = sampleBuf.size();
 		int bufUsed  = 0;
@@ -209,10 +417,13 @@ struct VorbisSource : ALDataSource
 			if (res == 0)
 			{
 				/* EOF */
+				finishRecording(true);
+
 				if (loop.requested)
 				{
 					retStatus = ALDataSource::WrapAround;
 					seekToOffset(0);
+					syncDecoder();
 				}
 				else
 				{
@@ -237,6 +448,8 @@ struct VorbisSource : ALDataSource
 				readAgain = true;
 			}
 
+			record(static_cast<int16_t*>(bufPtr), currentFrame, res / info.frameSize);
+
 			bufUsed += (res / sizeof(int16_t));
 			bufPtr = &sampleBuf[bufUsed];
 			currentFrame += (res / info.frameSize);
@@ -255,6 +468,8 @@ struct VorbisSource : ALDataSource
 				if (ov_pcm_seek(&vf, currentFrame) != 0)
 					retStatus = ALDataSource::Error;
 
+				beginRecording();
+
 				break;
 			}
 
@@ -283,7 +498,9 @@ struct VorbisSource : ALDataSource
 };
 
 ALDataSource *createVorbisSource(SDL_RWops &ops,
-                                 bool looped)
+                                 bool looped,
+                                 StreamCache *cache,
+                                 const std::string &cacheKey)
 {
-	return new VorbisSource(ops, looped);
+	return new VorbisSource(ops, looped, cache, cacheKey);
 }
@@ -131,6 +131,8 @@ void Config::read(int argc, char *argv[]) {
         {"debugMode", false},
         {"displayFPS", false},
         {"printFPS", false},
+        {"frameProfiler", false},
+        {"frameProfilerOverlay", false},
         {"winResizable", true},
         {"fullscreen", false},
         {"fixedAspectRatio", true},
@@ -146,6 +148,7 @@ void Config::read(int argc, char *argv[]) {
         {"windowTitle", ""},
         {"fixedFramerate", 0},
         {"frameSkip", false},
+        {"skipUnchangedFrames", 1},
         {"syncToRefreshrate", false},
         {"solidFonts", json::array({})},
 #if defined(__APPLE__) && defined(__aarch64__)
@@ -162,11 +165,19 @@ void Config::read(int argc, char *argv[]) {
         {"integerScalingActive", false},
         {"integerScalingLastMile", true},
         {"maxTextureSize", 0},
+        {"bitmapLoaderThreads", 0},
+        {"bitmapCacheSize", 64},
+        {"texturePoolSize", 20},
+        {"headless", false},
+        {"headlessFrameLimit", false},
+        {"headlessFrameDumpDir", ""},
+        {"headlessFrameDumpInterval", 60},
         {"gameFolder", ""},
         {"anyAltToggleFS", false},
         {"enableReset", true},
         {"enableSettings", true},
         {"allowSymlinks", false},
+        {"mmapArchives", true},
         {"dataPathOrg", ""},
         {"dataPathApp", ""},
         {"iconPath", ""},
@@ -174,11 +185,18 @@ void Config::read(int argc, char *argv[]) {
         {"midiSoundFont", ""},
         {"midiChorus", false},
         {"midiReverb", false},
+        {"midiPrerender", false},
+        {"midiCacheSize", 512},
         {"SESourceCount", 6},
+        {"SECacheSize", 10},
+        {"SEMaxLatency", 100},
         {"BGMTrackCount", 1},
+        {"BGMCacheSize", 32},
+        {"BGMCacheHeadLength", 10},
         {"customScript", ""},
         {"pathCache", true},
         {"useScriptNames", true},
+        {"scriptCache", false},
         {"preloadScript", json::array({})},
         {"RTP", json::array({})},
         {"patches", json::array({})},
@@ -211,6 +229,8 @@ try { exp } catch (...) {}
     editor.debug = false;
     editor.battleTest = false;
     
+    bool headlessArg = false;
+    
     if (argc > 1) {
         if (!strcmp(argv[1], "debug") || !strcmp(argv[1], "test"))
             editor.debug = true;
@@ -218,7 +238,9 @@ try { exp } catch (...) {}
             editor.battleTest = true;
         
         for (int i = 1; i < argc; i++) {
-            if (strcmp(argv[i], "debug"))
+            if (!strcmp(argv[i], "--headless"))
+                headlessArg = true;
+            else if (strcmp(argv[i], "debug"))
                 launchArgs.push_back(argv[i]);
         }
     }
@@ -237,6 +259,7 @@ try { exp } catch (...) {}
     SET_STRINGOPT(iconPath, iconPath);
     SET_STRINGOPT(execName, execName);
     SET_OPT(allowSymlinks, boolean);
+    SET_OPT(mmapArchives, boolean);
     SET_OPT(pathCache, boolean);
     SET_OPT_CUSTOMKEY(jit.enabled, JITEnable, boolean);
     SET_OPT_CUSTOMKEY(jit.verboseLevel, JITVerboseLevel, integer);
@@ -264,6 +287,8 @@ try { exp } catch (...) {}
     SET_OPT(debugMode, boolean);
     SET_OPT(displayFPS, boolean);
     SET_OPT(printFPS, boolean);
+    SET_OPT(frameProfiler, boolean);
+    SET_OPT(frameProfilerOverlay, boolean);
     SET_OPT(fullscreen, boolean);
     SET_OPT(fixedAspectRatio, boolean);
     SET_OPT(smoothScaling, integer);
@@ -277,6 +302,7 @@ try { exp } catch (...) {}
     SET_STRINGOPT(windowTitle, windowTitle);
     SET_OPT(fixedFramerate, integer);
     SET_OPT(frameSkip, boolean);
+    SET_OPT(skipUnchangedFrames, integer);
     SET_OPT(syncToRefreshrate, boolean);
     fillStringVec(opts["solidFonts"], solidFonts);
     for (std::string & solidFont : solidFonts)
@@ -290,16 +316,30 @@ try { exp } catch (...) {}
     SET_OPT_CUSTOMKEY(integerScaling.active, integerScalingActive, boolean);
     SET_OPT_CUSTOMKEY(integerScaling.lastMileScaling, integerScalingLastMile, boolean);
     SET_OPT(maxTextureSize, integer);
+    SET_OPT(bitmapLoaderThreads, integer);
+    SET_OPT(bitmapCacheSize, integer);
+    SET_OPT(texturePoolSize, integer);
+    SET_OPT_CUSTOMKEY(headless.enabled, headless, boolean);
+    SET_OPT_CUSTOMKEY(headless.frameLimit, headlessFrameLimit, boolean);
+    SET_STRINGOPT(headless.frameDumpDir, headlessFrameDumpDir);
+    SET_OPT_CUSTOMKEY(headless.frameDumpInterval, headlessFrameDumpInterval, integer);
     SET_OPT(anyAltToggleFS, boolean);
     SET_OPT(enableReset, boolean);
     SET_OPT(enableSettings, boolean);
     SET_STRINGOPT(midi.soundFont, midiSoundFont);
     SET_OPT_CUSTOMKEY(midi.chorus, midiChorus, boolean);
     SET_OPT_CUSTOMKEY(midi.reverb, midiReverb, boolean);
+    SET_OPT_CUSTOMKEY(midi.prerender, midiPrerender, boolean);
+    SET_OPT_CUSTOMKEY(midi.cacheSize, midiCacheSize, integer);
     SET_OPT_CUSTOMKEY(SE.sourceCount, SESourceCount, integer);
+    SET_OPT_CUSTOMKEY(SE.cacheSize, SECacheSize, integer);
+    SET_OPT_CUSTOMKEY(SE.maxLatency, SEMaxLatency, integer);
     SET_OPT_CUSTOMKEY(BGM.trackCount, BGMTrackCount, integer);
+    SET_OPT_CUSTOMKEY(BGM.cacheSize, BGMCacheSize, integer);
+    SET_OPT_CUSTOMKEY(BGM.cacheHeadLength, BGMCacheHeadLength, integer);
     SET_STRINGOPT(customScript, customScript);
     SET_OPT(useScriptNames, boolean);
+    SET_OPT(scriptCache, boolean);
     SET_OPT(dumpAtlas, boolean);
     
     fillStringVec(opts["preloadScript"], preloadScripts);
@@ -325,8 +365,27 @@ try { exp } catch (...) {}
     BINDING_NAME(r);
     
     rgssVersion = clamp(rgssVersion, 0, 3);
+    midi.cacheSize = clamp(midi.cacheSize, 0, 65536);
     SE.sourceCount = clamp(SE.sourceCount, 1, 64);
+    SE.cacheSize = clamp(SE.cacheSize, 0, 1024);
+    SE.maxLatency = clamp(SE.maxLatency, 0, 1000);
     BGM.trackCount = clamp(BGM.trackCount, 1, 16);
+    BGM.cacheSize = clamp(BGM.cacheSize, 0, 1024);
+    BGM.cacheHeadLength = clamp(BGM.cacheHeadLength, 1, 120);
+    bitmapLoaderThreads = clamp(bitmapLoaderThreads, 0, 16);
+    bitmapCacheSize = clamp(bitmapCacheSize, 0, 4096);
+    texturePoolSize = clamp(texturePoolSize, 0, 4096);
+    skipUnchangedFrames = clamp(skipUnchangedFrames, 0, 2);
+    headless.frameDumpInterval = clamp(headless.frameDumpInterval, 1, 1000000);
+    
+    if (headlessArg)
+        headless.enabled = true;
+    
+    // There is no window to resize or make fullscreen
+    if (headless.enabled) {
+        winResizable = false;
+        fullscreen = false;
+    }
     
     // Determine whether to open a console window on... Windows
     winConsole = getEnvironmentBool("MKXPZ_WINDOWS_CONSOLE", editor.debug);
@@ -39,6 +39,8 @@ struct Config {
     bool preferMetalRenderer;
     bool displayFPS;
     bool printFPS;
+    bool frameProfiler;
+    bool frameProfilerOverlay;
     
     bool winResizable;
     bool fullscreen;
@@ -57,6 +59,7 @@ struct Config {
     
     int fixedFramerate;
     bool frameSkip;
+    int skipUnchangedFrames;
     bool syncToRefreshrate;
     
     std::vector<std::string> solidFonts;
@@ -65,6 +68,17 @@ struct Config {
     bool enableBlitting;
     int maxTextureSize;
     
+    int bitmapLoaderThreads;
+    int bitmapCacheSize;
+    int texturePoolSize;
+    
+    struct {
+        bool enabled;
+        bool frameLimit;
+        std::string frameDumpDir;
+        int frameDumpInterval;
+    } headless;
+    
     struct {
         bool active;
         bool lastMileScaling;
@@ -77,6 +91,7 @@ struct Config {
     bool enableReset;
     bool enableSettings;
     bool allowSymlinks;
+    bool mmapArchives;
     bool pathCache;
     
     std::string dataPathOrg;
@@ -90,17 +105,24 @@ struct Config {
         std::string soundFont;
         bool chorus;
         bool reverb;
+        bool prerender;
+        int cacheSize;
     } midi;
     
     struct {
         int sourceCount;
+        int cacheSize;
+        int maxLatency;
     } SE;
     
     struct {
         int trackCount;
+        int cacheSize;
+        int cacheHeadLength;
     } BGM;
     
     bool useScriptNames;
+    bool scriptCache;
     
     std::string customScript;
     
@@ -0,0 +1,286 @@
+/*
+** rgssad-xor.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rgssad-xor.h"
+
+#include <SDL_cpuinfo.h>
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RGSSAD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RGSSAD_NEON
+#include <arm_neon.h>
+#endif
+
+/* The key stream is the LCG magic' = magic * 7 + 3. Advancing it
+ * by n steps is again an LCG, magic' = magic * A(n) + C(n) (see
+ * LCG_TABLE in rgssad.cpp), so every SIMD lane can run its own
+ * copy of the generator, staggered by one step each. The vector
+ * paths keep two registers of lanes in flight to hide the
+ * multiply latency, so each lane advances by twice the width. */
+
+/* A(8), C(8) */
+#define LCG8_MUL 0x0057f6c1
+#define LCG8_ADD 0x002bfb60
+
+/* A(16), C(16) */
+#define LCG16_MUL 0xa5057d81
+#define LCG16_ADD 0xd282bec0
+
+static inline void
+initLanes(uint32_t *lanes, int count, uint32_t magic)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		lanes[i] = magic;
+		magic = magic * 7 + 3;
+	}
+}
+
+void rgssadXorDwordsScalar(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint32_t dword;
+		memcpy(&dword, src + i*4, 4);
+
+		dword ^= magic;
+		magic = magic * 7 + 3;
+
+		memcpy(dst + i*4, &dword, 4);
+	}
+}
+
+#ifdef RGSSAD_X86
+/* SSE2 has no 32 bit lane multiply (that came with SSE4.1) */
+static inline __m128i
+mulLo32(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+	                          _mm_shuffle_epi32(odd,  _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+void rgssadXorDwordsSSE2(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic)
+{
+	size_t blocks = count / 8;
+
+	if (blocks > 0)
+	{
+		uint32_t lanes[8];
+		initLanes(lanes, 8, magic);
+
+		__m128i m0 = _mm_loadu_si128((const __m128i*) &lanes[0]);
+		__m128i m1 = _mm_loadu_si128((const __m128i*) &lanes[4]);
+
+		const __m128i mul = _mm_set1_epi32((int) LCG8_MUL);
+		const __m128i add = _mm_set1_epi32((int) LCG8_ADD);
+
+		for (size_t i = 0; i < blocks; ++i)
+		{
+			const __m128i *in = (const __m128i*) (src + i*32);
+			__m128i *out = (__m128i*) (dst + i*32);
+
+			__m128i d0 = _mm_loadu_si128(in);
+			__m128i d1 = _mm_loadu_si128(in + 1);
+
+			_mm_storeu_si128(out,     _mm_xor_si128(d0, m0));
+			_mm_storeu_si128(out + 1, _mm_xor_si128(d1, m1));
+
+			m0 = _mm_add_epi32(mulLo32(m0, mul), add);
+			m1 = _mm_add_epi32(mulLo32(m1, mul), add);
+		}
+
+		magic = (uint32_t) _mm_cvtsi128_si32(m0);
+	}
+
+	rgssadXorDwordsScalar(dst + blocks*32, src + blocks*32, count - blocks*8, magic);
+}
+
+TARGET_AVX2
+static void xorDwordsAVX2(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic)
+{
+	size_t blocks = count / 16;
+
+	if (blocks > 0)
+	{
+		uint32_t lanes[16];
+		initLanes(lanes, 16, magic);
+
+		__m256i m0 = _mm256_loadu_si256((const __m256i*) &lanes[0]);
+		__m256i m1 = _mm256_loadu_si256((const __m256i*) &lanes[8]);
+
+		const __m256i mul = _mm256_set1_epi32((int) LCG16_MUL);
+		const __m256i add = _mm256_set1_epi32((int) LCG16_ADD);
+
+		for (size_t i = 0; i < blocks; ++i)
+		{
+			const __m256i *in = (const __m256i*) (src + i*64);
+			__m256i *out = (__m256i*) (dst + i*64);
+
+			__m256i d0 = _mm256_loadu_si256(in);
+			__m256i d1 = _mm256_loadu_si256(in + 1);
+
+			_mm256_storeu_si256(out,     _mm256_xor_si256(d0, m0));
+			_mm256_storeu_si256(out + 1, _mm256_xor_si256(d1, m1));
+
+			m0 = _mm256_add_epi32(_mm256_mullo_epi32(m0, mul), add);
+			m1 = _mm256_add_epi32(_mm256_mullo_epi32(m1, mul), add);
+		}
+
+		magic = (uint32_t) _mm_cvtsi128_si32(_mm256_castsi256_si128(m0));
+	}
+
+	rgssadXorDwordsScalar(dst + blocks*64, src + blocks*64, count - blocks*16, magic);
+}
+
+void rgssadXorDwordsAVX2(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic)
+{
+	if (SDL_HasAVX2())
+		xorDwordsAVX2(dst, src, count, magic);
+	else
+		rgssadXorDwordsScalar(dst, src, count, magic);
+}
+#else
+void rgssadXorDwordsSSE2(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic)
+{
+	rgssadXorDwordsScalar(dst, src, count, magic);
+}
+
+void rgssadXorDwordsAVX2(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic)
+{
+	rgssadXorDwordsScalar(dst, src, count, magic);
+}
+#endif
+
+#ifdef RGSSAD_NEON
+void rgssadXorDwordsNEON(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic)
+{
+	size_t blocks = count / 8;
+
+	if (blocks > 0)
+	{
+		uint32_t lanes[8];
+		initLanes(lanes, 8, magic);
+
+		uint32x4_t m0 = vld1q_u32(&lanes[0]);
+		uint32x4_t m1 = vld1q_u32(&lanes[4]);
+
+		const uint32x4_t mul = vdupq_n_u32(LCG8_MUL);
+		const uint32x4_t add = vdupq_n_u32(LCG8_ADD);
+
+		for (size_t i = 0; i < blocks; ++i)
+		{
+			const uint8_t *in = src + i*32;
+			uint8_t *out = dst + i*32;
+
+			uint8x16_t d0 = vld1q_u8(in);
+			uint8x16_t d1 = vld1q_u8(in + 16);
+
+			vst1q_u8(out,      veorq_u8(d0, vreinterpretq_u8_u32(m0)));
+			vst1q_u8(out + 16, veorq_u8(d1, vreinterpretq_u8_u32(m1)));
+
+			m0 = vmlaq_u32(add, m0, mul);
+			m1 = vmlaq_u32(add, m1, mul);
+		}
+
+		magic = vgetq_lane_u32(m0, 0);
+	}
+
+	rgssadXorDwordsScalar(dst + blocks*32, src + blocks*32, count - blocks*8, magic);
+}
+#else
+void rgssadXorDwordsNEON(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic)
+{
+	rgssadXorDwordsScalar(dst, src, count, magic);
+}
+#endif
+
+typedef void (*XorFunc)(uint8_t *, const uint8_t *, size_t, uint32_t &);
+
+struct XorImpl
+{
+	XorFunc func;
+	const char *name;
+};
+
+static XorImpl pickImpl()
+{
+	XorImpl impl = { rgssadXorDwordsScalar, "scalar" };
+
+#ifdef RGSSAD_X86
+	if (SDL_HasAVX2())
+	{
+		impl.func = xorDwordsAVX2;
+		impl.name = "AVX2";
+	}
+	else if (SDL_HasSSE2())
+	{
+		impl.func = rgssadXorDwordsSSE2;
+		impl.name = "SSE2";
+	}
+#endif
+
+#ifdef RGSSAD_NEON
+	if (SDL_HasNEON())
+	{
+		impl.func = rgssadXorDwordsNEON;
+		impl.name = "NEON";
+	}
+#endif
+
+	return impl;
+}
+
+static const XorImpl &getImpl()
+{
+	static const XorImpl impl = pickImpl();
+
+	return impl;
+}
+
+void rgssadXorDwords(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic)
+{
+	/* Not worth setting up the lanes for */
+	if (count < 16)
+		return rgssadXorDwordsScalar(dst, src, count, magic);
+
+	getImpl().func(dst, src, count, magic);
+}
+
+const char *rgssadXorImplName()
+{
+	return getImpl().name;
+}
@@ -0,0 +1,45 @@
+/*
+** rgssad-xor.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2014 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RGSSADXOR_H
+#define RGSSADXOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* XORs 'count' little endian dwords at 'src' with the RGSSAD
+ * key stream starting at 'magic', writes them to 'dst' and
+ * advances 'magic' past them. 'dst' and 'src' may be the same
+ * (but not otherwise overlap) and need no alignment. Uses
+ * the widest SIMD path the CPU supports */
+void rgssadXorDwords(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic);
+
+/* Individual implementations, exposed for benchmarking.
+ * Unsupported ones fall back to the scalar path */
+void rgssadXorDwordsScalar(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic);
+void rgssadXorDwordsSSE2(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic);
+void rgssadXorDwordsAVX2(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic);
+void rgssadXorDwordsNEON(uint8_t *dst, const uint8_t *src, size_t count, uint32_t &magic);
+
+/* Name of the path picked by rgssadXorDwords() */
+const char *rgssadXorImplName();
+
+#endif // RGSSADXOR_H
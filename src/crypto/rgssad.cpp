@@ -20,6 +20,7 @@
 */
 
 #include "rgssad.h"
+#include "rgssad-xor.h"
 #include "boost-hash.h"
 
 #include <stdint.h>
@@ -27,6 +28,19 @@
 
 #include <string>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static bool useMmap = true;
+
 /* Equivalent Linear Congruential Generator (LCG) constants for iteration 2^n
  * all the way up to 2^32/4 (the largest dword offset possible in
  * RGSS{AD,[23]A}).
@@ -65,19 +79,60 @@ struct RGSS_entryHandle
 	const RGSS_entryData data;
 	uint32_t currentMagic;
 	uint64_t currentOffset;
+
+	/* Exactly one of these is set: entry contents
+	 * within the archive mapping, or a private
+	 * duplicate of the archive io to read them from */
+	const uint8_t *mapping;
 	PHYSFS_Io *io;
 
-	RGSS_entryHandle(const RGSS_entryData &data, PHYSFS_Io *archIo)
+	RGSS_entryHandle(const RGSS_entryData &data, PHYSFS_Io *archIo,
+	                 const uint8_t *archMapping)
 	    : data(data),
 	      currentMagic(data.startMagic),
-	      currentOffset(0)
+	      currentOffset(0),
+	      mapping(0),
+	      io(0)
 	{
+		if (archMapping)
+		{
+			mapping = archMapping + data.offset;
+			return;
+		}
+
 		io = archIo->duplicate(archIo);
+		io->seek(io, data.offset);
+	}
+
+	RGSS_entryHandle(const RGSS_entryHandle &other)
+	    : data(other.data),
+	      currentMagic(other.currentMagic),
+	      currentOffset(other.currentOffset),
+	      mapping(other.mapping),
+	      io(0)
+	{
+		if (mapping)
+			return;
+
+		io = other.io->duplicate(other.io);
+		io->seek(io, data.offset + currentOffset);
 	}
 
 	~RGSS_entryHandle()
 	{
-		io->destroy(io);
+		if (io)
+			io->destroy(io);
+	}
+
+	/* Reads 'size' raw (still encrypted) bytes
+	 * from entry offset 'pos' into 'dest' */
+	void readRaw(void *dest, uint64_t pos, uint64_t size)
+	{
+		if (mapping)
+			memcpy(dest, mapping + pos, size);
+		else
+			/* io is always positioned at 'pos' */
+			io->read(io, dest, size);
 	}
 };
 
@@ -85,6 +140,11 @@ struct RGSS_archiveData
 {
 	PHYSFS_Io *archiveIo;
 
+	/* The whole archive file mapped into memory,
+	 * or null if it couldn't be mapped */
+	const uint8_t *mapping;
+	uint64_t mappingSize;
+
 	/* Maps: file path
 	 * to:   entry data */
 	BoostHash<std::string, RGSS_entryData> entryHash;
@@ -147,12 +207,11 @@ RGSS_ioRead(PHYSFS_Io *self, void *buffer, PHYSFS_uint64 len)
 {
 	RGSS_entryHandle *entry = static_cast<RGSS_entryHandle*>(self->opaque);
 
-	PHYSFS_Io *io = entry->io;
-
 	uint64_t toRead = std::min<uint64_t>(entry->data.size - entry->currentOffset, len);
 	uint64_t offs = entry->currentOffset;
 
-	io->seek(io, entry->data.offset + offs);
+	/* Never read past the end of the entry */
+	len = toRead;
 
 	/* We divide up the bytes to be read in 3 categories:
 	 *
@@ -189,7 +248,7 @@ RGSS_ioRead(PHYSFS_Io *self, void *buffer, PHYSFS_uint64 len)
 	if (preAlign > 0)
 	{
 		uint32_t dword;
-		io->read(io, &dword, preAlign);
+		entry->readRaw(&dword, offs, preAlign);
 
 		/* Need to align the bytes with the
 		 * magic before xoring */
@@ -210,15 +269,21 @@ RGSS_ioRead(PHYSFS_Io *self, void *buffer, PHYSFS_uint64 len)
 
 	if (align > 0)
 	{
-		/* Double word buffer pointer */
-		uint32_t *dwBufferP = reinterpret_cast<uint32_t*>(bBufferP);
+		uint64_t pos = offs + preAlign;
 
-		/* Read aligned dwords in one go */
-		io->read(io, bBufferP, align);
+		if (entry->mapping)
+		{
+			/* Decrypt straight out of the mapping */
+			rgssadXorDwords(bBufferP, entry->mapping + pos, align / 4, entry->currentMagic);
+		}
+		else
+		{
+			/* Read aligned dwords in one go */
+			entry->readRaw(bBufferP, pos, align);
 
-		/* Then xor them */
-		for (uint64_t i = 0; i < (align / 4); ++i)
-			dwBufferP[i] ^= advanceMagic(entry->currentMagic);
+			/* Then xor them */
+			rgssadXorDwords(bBufferP, bBufferP, align / 4, entry->currentMagic);
+		}
 
 		bBufferP += align;
 	}
@@ -226,7 +291,7 @@ RGSS_ioRead(PHYSFS_Io *self, void *buffer, PHYSFS_uint64 len)
 	if (postAlign > 0)
 	{
 		uint32_t dword;
-		io->read(io, &dword, postAlign);
+		entry->readRaw(&dword, offs + preAlign + align, postAlign);
 
 		/* Bytes are already aligned with magic */
 		dword ^= entry->currentMagic;
@@ -264,7 +329,9 @@ RGSS_ioSeek(PHYSFS_Io *self, PHYSFS_uint64 offset)
 	advanceMagicN(entry->currentMagic, (uint32_t) dwordsSought);
 
 	entry->currentOffset = offset;
-	entry->io->seek(entry->io, entry->data.offset + entry->currentOffset);
+
+	if (entry->io)
+		entry->io->seek(entry->io, entry->data.offset + entry->currentOffset);
 
 	return 1;
 }
@@ -375,8 +442,115 @@ verifyHeader(PHYSFS_Io *io, char version)
 	return true;
 }
 
+static void
+unmapArchive(const uint8_t *mapping, uint64_t size)
+{
+#ifdef _WIN32
+	(void) size;
+	UnmapViewOfFile(mapping);
+#else
+	munmap(const_cast<uint8_t*>(mapping), size);
+#endif
+}
+
+/* Maps the archive at 'path' into memory, so entries can be
+ * decrypted straight from it without any syscalls. This only works
+ * if the archive is a plain file on disk; if it lives inside another
+ * mount (or was opened through SDL_RWops), 'path' either can't be
+ * opened or won't match what 'io' reads, and entries keep
+ * being read through duplicates of 'io' instead. */
+static void
+mapArchive(RGSS_archiveData *data, PHYSFS_Io *io, const char *path)
+{
+	data->mapping = 0;
+	data->mappingSize = 0;
+
+	if (!useMmap || !path)
+		return;
+
+	PHYSFS_sint64 length = io->length(io);
+
+	if (length <= 0 || (uint64_t) length > SIZE_MAX)
+		return;
+
+	void *mem = 0;
+
+#ifdef _WIN32
+	int wlen = MultiByteToWideChar(CP_UTF8, 0, path, -1, 0, 0);
+
+	if (wlen <= 0)
+		return;
+
+	std::wstring wpath(wlen, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path, -1, &wpath[0], wlen);
+
+	HANDLE file = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+	                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER size;
+
+	if (GetFileSizeEx(file, &size) && size.QuadPart == length)
+	{
+		HANDLE map = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+
+		/* The view keeps the mapping alive */
+		if (map)
+		{
+			mem = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(map);
+		}
+	}
+
+	CloseHandle(file);
+#else
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return;
+
+	struct stat st;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == length)
+	{
+		mem = mmap(0, (size_t) length, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (mem == MAP_FAILED)
+			mem = 0;
+	}
+
+	close(fd);
+#endif
+
+	if (!mem)
+		return;
+
+	/* Make sure we actually mapped the file 'io' reads from
+	 * by comparing the beginning of both */
+	uint8_t sample[4096];
+	size_t sampleSize = std::min<uint64_t>(sizeof(sample), length);
+	PHYSFS_sint64 pos = io->tell(io);
+
+	bool same = io->seek(io, 0) &&
+	            IO_READ(io, sample, (PHYSFS_sint64) sampleSize) &&
+	            memcmp(sample, mem, sampleSize) == 0;
+
+	io->seek(io, pos);
+
+	if (!same)
+	{
+		unmapArchive(static_cast<const uint8_t*>(mem), length);
+		return;
+	}
+
+	data->mapping = static_cast<const uint8_t*>(mem);
+	data->mappingSize = length;
+}
+
 static void*
-RGSS_openArchive(PHYSFS_Io *io, const char *, int forWrite, int *claimed)
+RGSS_openArchive(PHYSFS_Io *io, const char *name, int forWrite, int *claimed)
 {
 	if (forWrite)
 		return NULL;
@@ -433,6 +607,8 @@ RGSS_openArchive(PHYSFS_Io *io, const char *, int forWrite, int *claimed)
 		io->seek(io, entry.offset + entry.size);
 	}
 
+	mapArchive(data, io, name);
+
 	return data;
 }
 
@@ -465,8 +641,17 @@ RGSS_openRead(void *opaque, const char *filename)
 	if (!data->entryHash.contains(filename))
 		return 0;
 
+	const RGSS_entryData &entryData = data->entryHash[filename];
+
+	/* Entries reaching past the end of the file
+	 * are left to fail reading through the io */
+	const uint8_t *mapping = data->mapping;
+
+	if (entryData.offset < 0 || entryData.offset + entryData.size > data->mappingSize)
+		mapping = 0;
+
 	RGSS_entryHandle *entry =
-	        new RGSS_entryHandle(data->entryHash[filename], data->archiveIo);
+	        new RGSS_entryHandle(entryData, data->archiveIo, mapping);
 
 	PHYSFS_Io *io = PHYSFS_ALLOC(PHYSFS_Io);
 
@@ -516,6 +701,9 @@ RGSS_closeArchive(void *opaque)
 {
 	RGSS_archiveData *data = static_cast<RGSS_archiveData*>(opaque);
 
+	if (data->mapping)
+		unmapArchive(data->mapping, data->mappingSize);
+
 	delete data;
 }
 
@@ -585,7 +773,7 @@ readUint32AndXor(PHYSFS_Io *io, uint32_t &result, uint32_t key)
 }
 
 static void*
-RGSS3_openArchive(PHYSFS_Io *io, const char *, int forWrite, int *claimed)
+RGSS3_openArchive(PHYSFS_Io *io, const char *name, int forWrite, int *claimed)
 {
 	if (forWrite)
 		return NULL;
@@ -659,6 +847,8 @@ RGSS3_openArchive(PHYSFS_Io *io, const char *, int forWrite, int *claimed)
 		return NULL;
 	}
 
+	mapArchive(data, io, name);
+
 	return data;
 }
 
@@ -682,3 +872,8 @@ const PHYSFS_Archiver RGSS3_Archiver =
 	RGSS_stat,
 	RGSS_closeArchive
 };
+
+void RGSS_setUseMmap(bool enabled)
+{
+	useMmap = enabled;
+}
@@ -28,4 +28,9 @@ extern const PHYSFS_Archiver RGSS1_Archiver;
 extern const PHYSFS_Archiver RGSS2_Archiver;
 extern const PHYSFS_Archiver RGSS3_Archiver;
 
+/* Serve entries of archives that are plain files on disk
+ * from a memory mapping of the archive (default: true).
+ * Affects archives mounted afterwards */
+void RGSS_setUseMmap(bool enabled);
+
 #endif // RGSSAD_H
@@ -41,7 +41,12 @@
 #include "texpool.h"
 #include "shader.h"
 #include "filesystem.h"
+#include "bitmaploader.h"
+#include "imagewriter.h"
 #include "font.h"
+#include "glyphatlas.h"
+#include "frameprofiler.h"
+#include "screendamage.h"
 #include "eventthread.h"
 #include "graphics.h"
 #include "system.h"
@@ -53,6 +58,7 @@
 
 #include <math.h>
 #include <algorithm>
+#include <vector>
 
 extern "C" {
 #include "libnsgif/libnsgif.h"
@@ -103,54 +109,6 @@ static IntRect normalizedRect(const IntRect &rect)
 }
 
 
-// libnsgif loading callbacks, taken pretty much straight from their tests
-
-static void *gif_bitmap_create(int width, int height)
-{
-    /* ensure a stupidly large bitmap is not created */
-    return calloc(width * height, 4);
-}
-
-
-static void gif_bitmap_set_opaque(void *bitmap, bool opaque)
-{
-    (void) opaque;  /* unused */
-    (void) bitmap;  /* unused */
-    assert(bitmap);
-}
-
-
-static bool gif_bitmap_test_opaque(void *bitmap)
-{
-    (void) bitmap;  /* unused */
-    assert(bitmap);
-    return false;
-}
-
-
-static unsigned char *gif_bitmap_get_buffer(void *bitmap)
-{
-    assert(bitmap);
-    return (unsigned char *)bitmap;
-}
-
-
-static void gif_bitmap_destroy(void *bitmap)
-{
-    assert(bitmap);
-    free(bitmap);
-}
-
-
-static void gif_bitmap_modified(void *bitmap)
-{
-    (void) bitmap;  /* unused */
-    assert(bitmap);
-    return;
-}
-
-// --------------------
-
 struct BitmapPrivate
 {
     Bitmap *self;
@@ -225,11 +183,17 @@ struct BitmapPrivate
     SDL_Surface *megaSurface;
     
     /* A cached version of the bitmap in client memory, for
-     * getPixel calls. Is invalidated any time the bitmap
-     * is modified */
+     * getPixel calls. Once created it is kept in sync with the
+     * texture: ops that can be done on the CPU (fills, clears,
+     * setPixel) are applied to both copies, everything else
+     * marks its area in 'surfaceStale' to be read back later */
     SDL_Surface *surface;
     SDL_PixelFormat *format;
     
+    /* Parts of 'surface' that were drawn to on the GPU since
+     * they were last read back */
+    pixman_region16_t surfaceStale;
+    
     /* The 'tainted' area describes which parts of the
      * bitmap are not cleared, ie. don't have 0 opacity.
      * If we're blitting / drawing text to a cleared part
@@ -267,13 +231,16 @@ struct BitmapPrivate
         
         font = &shState->defaultFont();
         pixman_region_init(&tainted);
+        pixman_region_init(&surfaceStale);
     }
     
     ~BitmapPrivate()
     {
         prepareCon.disconnect();
+        freeSurface();
         SDL_FreeFormat(format);
         pixman_region_fini(&tainted);
+        pixman_region_fini(&surfaceStale);
     }
     
     TEXFBO &getGLTypes() {
@@ -285,6 +252,10 @@ struct BitmapPrivate
         if (!animation.enabled || !animation.playing) return;
         
         animation.updateTimer();
+        
+        /* Keep the screen redrawing until the animation is over */
+        if (animation.loop || animation.currentFrameIRaw() < animation.frames.size())
+            ScreenDamage::mark();
     }
     
     void allocSurface()
@@ -292,6 +263,88 @@ struct BitmapPrivate
         surface = SDL_CreateRGBSurface(0, gl.width, gl.height, format->BitsPerPixel,
                                        format->Rmask, format->Gmask,
                                        format->Bmask, format->Amask);
+        
+        /* Nothing has been read back yet */
+        pixman_region_fini(&surfaceStale);
+        pixman_region_init_rect(&surfaceStale, 0, 0, gl.width, gl.height);
+    }
+    
+    void freeSurface()
+    {
+        if (surface)
+            SDL_FreeSurface(surface);
+        surface = 0;
+        
+        pixman_region_clear(&surfaceStale);
+    }
+    
+    void invalidateSurface(const IntRect &rect)
+    {
+        if (!surface)
+            return;
+        
+        IntRect norm = normalizedRect(rect);
+        pixman_region_union_rect
+        (&surfaceStale, &surfaceStale, norm.x, norm.y, norm.w, norm.h);
+        pixman_region_intersect_rect
+        (&surfaceStale, &surfaceStale, 0, 0, surface->w, surface->h);
+    }
+    
+    bool surfaceStaleAt(int x, int y)
+    {
+        return pixman_region_contains_point(&surfaceStale, x, y, 0);
+    }
+    
+    void readBackRect(const pixman_box16_t &box)
+    {
+        int w = box.x2 - box.x1;
+        int h = box.y2 - box.y1;
+        uint8_t *dst = (uint8_t*) surface->pixels
+                     + box.y1*surface->pitch + box.x1*format->BytesPerPixel;
+        
+        /* Full rows can go straight into the surface */
+        if (w == surface->w && surface->pitch == w*format->BytesPerPixel)
+        {
+            gl.ReadPixels(box.x1, box.y1, w, h, GL_RGBA, GL_UNSIGNED_BYTE, dst);
+            return;
+        }
+        
+        size_t rowSize = w*format->BytesPerPixel;
+        std::vector<uint8_t> buffer(rowSize*h);
+        
+        gl.ReadPixels(box.x1, box.y1, w, h, GL_RGBA, GL_UNSIGNED_BYTE, buffer.data());
+        
+        for (int i = 0; i < h; ++i)
+            memcpy(dst + i*surface->pitch, &buffer[i*rowSize], rowSize);
+    }
+    
+    /* Brings every stale part of the cached surface up to date
+     * with the texture, in as few readbacks as reasonable */
+    void syncSurface()
+    {
+        if (!surface || !pixman_region_not_empty(&surfaceStale))
+            return;
+        
+        int count;
+        pixman_box16_t *boxes = pixman_region_rectangles(&surfaceStale, &count);
+        
+        /* Past a handful of boxes the per-call overhead outweighs
+         * the bytes saved; just read back the bounding box */
+        if (count > 8)
+        {
+            boxes = pixman_region_extents(&surfaceStale);
+            count = 1;
+        }
+        
+        FBO::bind(gl.fbo);
+        glState.viewport.pushSet(IntRect(0, 0, gl.width, gl.height));
+        
+        for (int i = 0; i < count; ++i)
+            readBackRect(boxes[i]);
+        
+        glState.viewport.pop();
+        
+        pixman_region_clear(&surfaceStale);
     }
     
     void clearTaintedArea()
@@ -397,6 +450,29 @@ struct BitmapPrivate
         glState.clearColor.pop();
         glState.scissorBox.pop();
         glState.scissorTest.pop();
+        
+        /* Apply the same fill to the cached surface; the
+         * area then matches the texture whatever it held */
+        if (surface)
+        {
+            IntRect norm = normalizedRect(rect);
+            SDL_Rect sdlRect = { norm.x, norm.y, norm.w, norm.h };
+            
+            SDL_FillRect(surface, &sdlRect,
+                         SDL_MapRGBA(format, toUnorm8(color.x), toUnorm8(color.y),
+                                     toUnorm8(color.z), toUnorm8(color.w)));
+            
+            pixman_region16_t m_reg;
+            pixman_region_init_rect(&m_reg, norm.x, norm.y, norm.w, norm.h);
+            pixman_region_subtract(&surfaceStale, &surfaceStale, &m_reg);
+            pixman_region_fini(&m_reg);
+        }
+    }
+    
+    /* Same conversion GL applies to a float clear color */
+    static uint8_t toUnorm8(float value)
+    {
+        return (uint8_t) lrintf(clamp(value, 0.0f, 1.0f) * 255.0f);
     }
     
     static void ensureFormat(SDL_Surface *&surf, Uint32 format)
@@ -409,82 +485,22 @@ struct BitmapPrivate
         surf = surfConv;
     }
     
-    void onModified(bool freeSurface = true)
+    /* 'dirty' is the area that was drawn to on the GPU only */
+    void onModified(const IntRect &dirty)
     {
-        if (surface && freeSurface)
-        {
-            SDL_FreeSurface(surface);
-            surface = 0;
-        }
+        invalidateSurface(dirty);
         
+        ScreenDamage::mark();
         self->modified();
     }
-};
-
-struct BitmapOpenHandler : FileSystem::OpenHandler
-{
-    // Non-GIF
-    SDL_Surface *surface;
     
-    // GIF
-    std::string error;
-    gif_animation *gif;
-    unsigned char *gif_data;
-    size_t gif_data_size;
-    
-    
-    BitmapOpenHandler()
-    : surface(0), gif(0), gif_data(0), gif_data_size(0)
-    {}
-    
-    bool tryRead(SDL_RWops &ops, const char *ext)
+    void onModified(bool surfaceChanged = true)
     {
-        if (IMG_isGIF(&ops)) {
-            // Use libnsgif to initialise the gif data
-            gif = new gif_animation;
-            
-            gif_bitmap_callback_vt gif_bitmap_callbacks = {
-                gif_bitmap_create,
-                gif_bitmap_destroy,
-                gif_bitmap_get_buffer,
-                gif_bitmap_set_opaque,
-                gif_bitmap_test_opaque,
-                gif_bitmap_modified
-            };
-            
-            gif_create(gif, &gif_bitmap_callbacks);
-            
-            gif_data_size = ops.size(&ops);
-            
-            gif_data = new unsigned char[gif_data_size];
-            ops.seek(&ops, 0, RW_SEEK_SET);
-            ops.read(&ops, gif_data, gif_data_size, 1);
-            
-            int status;
-            do {
-                status = gif_initialise(gif, gif_data_size, gif_data);
-                if (status != GIF_OK && status != GIF_WORKING) {
-                    gif_finalise(gif);
-                    delete gif;
-                    delete gif_data;
-                    error = "Failed to initialize GIF (Error " + std::to_string(status) + ")";
-                    return false;
-                }
-            } while (status != GIF_OK);
-            
-            // Decode the first frame
-            status = gif_decode_frame(gif, 0);
-            if (status != GIF_OK && status != GIF_WORKING) {
-                error = "Failed to decode first GIF frame. (Error " + std::to_string(status) + ")";
-                gif_finalise(gif);
-                delete gif;
-                delete gif_data;
-                return false;
-            }
-        } else {
-            surface = IMG_LoadTyped_RW(&ops, 1, ext);
-        }
-        return (surface || gif);
+        if (surfaceChanged)
+            invalidateSurface(IntRect(0, 0, gl.width, gl.height));
+        
+        ScreenDamage::mark();
+        self->modified();
     }
 };
 
@@ -497,59 +513,67 @@ Bitmap::Bitmap(const char *filename)
     if (shState->config().enableHires && filenameStd.compare(0, hiresPrefix.size(), hiresPrefix) != 0) {
         // Look for a high-res version of the file.
         std::string hiresFilename = hiresPrefix + filenameStd;
-        try {
-            hiresBitmap = new Bitmap(hiresFilename.c_str());
-            hiresBitmap->setLores(this);
-        }
-        catch (const Exception &e)
-        {
+        DecodedImage hiresImage;
+        shState->bitmapLoader().load(hiresFilename.c_str(), hiresImage);
+        
+        if (hiresImage.failed) {
             Debug() << "No high-res Bitmap found at" << hiresFilename;
-            hiresBitmap = nullptr;
+        }
+        else {
+            try {
+                hiresBitmap = new Bitmap(hiresImage, hiresFilename.c_str());
+                hiresBitmap->setLores(this);
+            }
+            catch (const Exception &e)
+            {
+                Debug() << "No high-res Bitmap found at" << hiresFilename;
+                hiresBitmap = nullptr;
+            }
         }
     }
 
-    BitmapOpenHandler handler;
-    shState->fileSystem().openRead(handler, filename);
+    DecodedImage image;
+    shState->bitmapLoader().load(filename, image);
     
-    if (!handler.error.empty()) {
-        // Not loaded with SDL, but I want it to be caught with the same exception type
-        throw Exception(Exception::SDLError, "Error loading image '%s': %s", filename, handler.error.c_str());
-    }
-    else if (!handler.gif && !handler.surface) {
-        throw Exception(Exception::SDLError, "Error loading image '%s': %s",
-                        filename, SDL_GetError());
-    }
+    initFromImage(image, hiresBitmap, filename);
+}
+
+Bitmap::Bitmap(DecodedImage &image, const char *filename)
+{
+    initFromImage(image, nullptr, filename);
+}
+
+void Bitmap::initFromImage(DecodedImage &image, Bitmap *hiresBitmap, const char *filename)
+{
+    if (image.failed)
+        throw Exception(image.errorType, "%s", image.error.c_str());
     
-    if (handler.gif) {
+    if (image.gif) {
         p = new BitmapPrivate(this);
 
         p->selfHires = hiresBitmap;
         
-        if (handler.gif->width >= (uint32_t)glState.caps.maxTexSize || handler.gif->height > (uint32_t)glState.caps.maxTexSize)
+        if (image.gif->width >= (uint32_t)glState.caps.maxTexSize || image.gif->height > (uint32_t)glState.caps.maxTexSize)
         {
             throw new Exception(Exception::MKXPError, "Animation too large (%ix%i, max %ix%i)",
-                                handler.gif->width, handler.gif->height, glState.caps.maxTexSize, glState.caps.maxTexSize);
+                                image.gif->width, image.gif->height, glState.caps.maxTexSize, glState.caps.maxTexSize);
         }
         
-        if (handler.gif->frame_count == 1) {
+        if (image.gif->frame_count == 1) {
             TEXFBO texfbo;
             try {
-                texfbo = shState->texPool().request(handler.gif->width, handler.gif->height);
+                texfbo = shState->texPool().request(image.gif->width, image.gif->height);
             }
             catch (const Exception &e)
             {
-                gif_finalise(handler.gif);
-                delete handler.gif;
-                delete handler.gif_data;
+                image.release();
                 
                 throw e;
             }
             
             TEX::bind(texfbo.tex);
-            TEX::uploadImage(handler.gif->width, handler.gif->height, handler.gif->frame_image, GL_RGBA);
-            gif_finalise(handler.gif);
-            delete handler.gif;
-            delete handler.gif_data;
+            TEX::uploadImage(image.gif->width, image.gif->height, image.gif->frame_image, GL_RGBA);
+            image.release();
             
             p->gl = texfbo;
             if (p->selfHires != nullptr) {
@@ -560,31 +584,29 @@ Bitmap::Bitmap(const char *filename)
         }
         
         p->animation.enabled = true;
-        p->animation.width = handler.gif->width;
-        p->animation.height = handler.gif->height;
+        p->animation.width = image.gif->width;
+        p->animation.height = image.gif->height;
         
         // Guess framerate based on the first frame's delay
-        p->animation.fps = 1 / ((float)handler.gif->frames[handler.gif->decoded_frame].frame_delay / 100);
+        p->animation.fps = 1 / ((float)image.gif->frames[image.gif->decoded_frame].frame_delay / 100);
         if (p->animation.fps < 0) p->animation.fps = shState->graphics().getFrameRate();
         
         // Loop gif (Either it's looping or it's not, at the moment)
-        p->animation.loop = handler.gif->loop_count >= 0;
+        p->animation.loop = image.gif->loop_count >= 0;
         
-        int fcount = handler.gif->frame_count;
-        int fcount_partial = handler.gif->frame_count_partial;
+        int fcount = image.gif->frame_count;
+        int fcount_partial = image.gif->frame_count_partial;
         if (fcount > fcount_partial) {
             Debug() << "Non-fatal error reading" << filename << ": Only decoded" << fcount_partial << "out of" << fcount << "frames";
         }
         for (int i = 0; i < fcount_partial; i++) {
             if (i > 0) {
-                int status = gif_decode_frame(handler.gif, i);
+                int status = gif_decode_frame(image.gif, i);
                 if (status != GIF_OK && status != GIF_WORKING) {
                     for (TEXFBO &frame : p->animation.frames)
                         shState->texPool().release(frame);
                     
-                    gif_finalise(handler.gif);
-                    delete handler.gif;
-                    delete handler.gif_data;
+                    image.release();
                     
                     throw Exception(Exception::MKXPError, "Failed to decode GIF frame %i out of %i (Status %i)",
                                     i + 1, fcount_partial, status);
@@ -600,26 +622,23 @@ Bitmap::Bitmap(const char *filename)
                 for (TEXFBO &frame : p->animation.frames)
                     shState->texPool().release(frame);
                 
-                gif_finalise(handler.gif);
-                delete handler.gif;
-                delete handler.gif_data;
+                image.release();
                 
                 throw e;
             }
             
             TEX::bind(texfbo.tex);
-            TEX::uploadImage(p->animation.width, p->animation.height, handler.gif->frame_image, GL_RGBA);
+            TEX::uploadImage(p->animation.width, p->animation.height, image.gif->frame_image, GL_RGBA);
             p->animation.frames.push_back(texfbo);
         }
         
-        gif_finalise(handler.gif);
-        delete handler.gif;
-        delete handler.gif_data;
+        image.release();
         p->addTaintedArea(rect());
         return;
     }
 
-    SDL_Surface *imgSurf = handler.surface;
+    SDL_Surface *imgSurf = image.surface;
+    image.surface = 0;
 
     initFromSurface(imgSurf, hiresBitmap, false);
 }
@@ -844,6 +863,8 @@ void Bitmap::initFromSurface(SDL_Surface *imgSurf, Bitmap *hiresBitmap, bool for
         
         TEX::bind(p->gl.tex);
         TEX::uploadImage(p->gl.width, p->gl.height, imgSurf->pixels, GL_RGBA);
+        
+        SDL_FreeSurface(imgSurf);
     }
     
     p->addTaintedArea(rect());
@@ -1207,7 +1228,7 @@ void Bitmap::stretchBlt(IntRect destRect,
         SDL_FreeSurface(blitTemp);
     
     p->addTaintedArea(destRect);
-    p->onModified();
+    p->onModified(destRect);
 }
 
 void Bitmap::fillRect(int x, int y,
@@ -1243,7 +1264,7 @@ void Bitmap::fillRect(const IntRect &rect, const Vec4 &color)
     /* Fill op */
         p->addTaintedArea(rect);
     
-    p->onModified();
+    p->onModified(false);
 }
 
 void Bitmap::gradientFillRect(int x, int y,
@@ -1305,7 +1326,7 @@ void Bitmap::gradientFillRect(const IntRect &rect,
     
     p->addTaintedArea(rect);
     
-    p->onModified();
+    p->onModified(rect);
 }
 
 void Bitmap::clearRect(int x, int y, int width, int height)
@@ -1332,7 +1353,7 @@ void Bitmap::clearRect(const IntRect &rect)
 
     p->fillRect(rect, Vec4());
     
-    p->onModified();
+    p->onModified(false);
 }
 
 void Bitmap::blur()
@@ -1509,7 +1530,13 @@ void Bitmap::clear()
     
     p->clearTaintedArea();
     
-    p->onModified();
+    if (p->surface)
+    {
+        memset(p->surface->pixels, 0, p->surface->pitch * p->surface->h);
+        pixman_region_clear(&p->surfaceStale);
+    }
+    
+    p->onModified(false);
 }
 
 static uint32_t &getPixelAt(SDL_Surface *surf, SDL_PixelFormat *form, int x, int y)
@@ -1574,17 +1601,12 @@ Color Bitmap::getPixel(int x, int y) const
         return Vec4();
 
     if (!p->surface)
-    {
         p->allocSurface();
-        
-        FBO::bind(p->gl.fbo);
-        
-        glState.viewport.pushSet(IntRect(0, 0, width(), height()));
-        
-        gl.ReadPixels(0, 0, width(), height(), GL_RGBA, GL_UNSIGNED_BYTE, p->surface->pixels);
-        
-        glState.viewport.pop();
-    }
+    
+    /* Only go to the GPU if this pixel was drawn to since the
+     * last readback, and then catch up on everything at once */
+    if (p->surfaceStaleAt(x, y))
+        p->syncSurface();
     
     uint32_t pixel = getPixelAt(p->surface, p->format, x, y);
     
@@ -1655,6 +1677,7 @@ bool Bitmap::getRaw(void *output, int output_size)
     }
 
     if (!p->animation.enabled && (p->surface || p->megaSurface)) {
+        p->syncSurface();
         void *src = (p->megaSurface) ? p->megaSurface->pixels : p->surface->pixels;
         memcpy(output, src, output_size);
     }
@@ -1686,7 +1709,15 @@ void Bitmap::replaceRaw(void *pixel_data, int size)
     TEX::uploadImage(w, h, pixel_data, GL_RGBA);
     
     taintArea(IntRect(0,0,w,h));
-    p->onModified();
+    
+    if (p->surface && !p->animation.enabled)
+    {
+        memcpy(p->surface->pixels, pixel_data, requiredsize);
+        pixman_region_clear(&p->surfaceStale);
+        p->onModified(false);
+    }
+    else
+        p->onModified();
 }
 
 void Bitmap::saveToFile(const char *filename)
@@ -1700,6 +1731,7 @@ void Bitmap::saveToFile(const char *filename)
     SDL_Surface *surf;
     
     if (p->surface || p->megaSurface) {
+        p->syncSurface();
         surf = (p->surface) ? p->surface : p->megaSurface;
     }
     else {
@@ -1711,37 +1743,8 @@ void Bitmap::saveToFile(const char *filename)
         getRaw(surf->pixels, surf->w * surf->h * 4);
     }
     
-    // Try and determine the intended image format from the filename extension
-    const char *period = strrchr(filename, '.');
-    int filetype = 0;
-    if (period) {
-        period++;
-        std::string ext;
-        for (int i = 0; i < (int)strlen(period); i++) {
-            ext += tolower(period[i]);
-        }
-        
-        if (!ext.compare("png")) {
-            filetype = 1;
-        }
-        else if (!ext.compare("jpg") || !ext.compare("jpeg")) {
-            filetype = 2;
-        }
-    }
-    
     std::string fn_normalized = shState->fileSystem().normalize(filename, 1, 1);
-    int rc;
-    switch (filetype) {
-        case 2:
-            rc = IMG_SaveJPG(surf, fn_normalized.c_str(), 90);
-            break;
-        case 1:
-            rc = IMG_SavePNG(surf, fn_normalized.c_str());
-            break;
-        case 0: default:
-            rc = SDL_SaveBMP(surf, fn_normalized.c_str());
-            break;
-    }
+    int rc = ImageWriter::writeFile(surf, fn_normalized.c_str());
     
     if (!p->surface && !p->megaSurface)
         SDL_FreeSurface(surf);
@@ -1749,6 +1752,25 @@ void Bitmap::saveToFile(const char *filename)
     if (rc) throw Exception(Exception::SDLError, "%s", SDL_GetError());
 }
 
+int Bitmap::saveToFileAsync(const char *filename)
+{
+    guardDisposed();
+    
+    if (hasHires()) {
+        Debug() << "GAME BUG: Game is calling saveToFileAsync on low-res Bitmap; you may want to patch the game to improve graphics quality.";
+    }
+    
+    std::string fn_normalized = shState->fileSystem().normalize(filename, 1, 1);
+    ImageWriter &writer = shState->imageWriter();
+    
+    if (p->surface || p->megaSurface) {
+        p->syncSurface();
+        return writer.save((p->surface) ? p->surface : p->megaSurface, fn_normalized);
+    }
+    
+    return writer.save(getGLTypes().fbo, width(), height(), fn_normalized);
+}
+
 void Bitmap::hueChange(int hue)
 {
     guardDisposed();
@@ -1902,10 +1924,50 @@ static void applyShadow(SDL_Surface *&in, const SDL_PixelFormat &fm, const SDL_C
     in = out;
 }
 
+/* Positions text of the given size within 'rect', and
+ * returns the factor it has to be squeezed by to fit */
+static float alignText(const IntRect &rect, int align, int txtW, int txtH,
+                       int doubleOutlineSize, float squeezeLimit,
+                       int &alignX, int &alignY)
+{
+    alignX = rect.x;
+    
+    switch (align)
+    {
+        default:
+        case Bitmap::Left :
+            break;
+            
+        case Bitmap::Center :
+            alignX += ceil((rect.w - (txtW + doubleOutlineSize)) / 2.0f);
+            break;
+            
+        case Bitmap::Right :
+            alignX += rect.w - txtW;
+            break;
+    }
+    
+    if (alignX < rect.x)
+        alignX = rect.x;
+    
+    alignY = rect.y + (rect.h - txtH) / 2;
+    
+    alignY = std::max(alignY, rect.y);
+    
+    /* FIXME: RGSS begins squeezing the text before it fills the rect.
+     * While this is extremely undesirable, a number of games will understandably
+     * have made the rects bigger to compensate, so we should probably match it */
+    float squeeze = (float) rect.w / txtW;
+    
+    return clamp(squeeze, squeezeLimit, 1.0f);
+}
+
 void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 {
     guardDisposed();
     
+    ProfileScope profile(ProfDrawText);
+    
     GUARD_MEGA;
     GUARD_ANIMATED;
     
@@ -1980,6 +2042,53 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
         str = fixed.c_str();
     }
     
+    GlyphRun run;
+    
+    /* Solid and shadowed text are left to SDL_ttf */
+    if (!p->font->isSolid() && !p->font->getShadow() &&
+        shState->glyphAtlas().layout(font, str, scaledOutlineSize, run))
+    {
+        int alignX, alignY;
+        float squeeze = alignText(rect, align, run.width, run.height, doubleOutlineSize,
+                                  squeezeLimit, alignX, alignY);
+        
+        IntRect destRect(alignX, alignY,
+                         std::min(rect.w, (int)(run.outWidth * squeeze)),
+                         std::min(rect.h, run.outHeight));
+        
+        destRect.w = std::min(destRect.w, width() - destRect.x);
+        destRect.h = std::min(destRect.h, height() - destRect.y);
+        
+        if (destRect.w <= 0 || destRect.h <= 0)
+            return;
+        
+        /* Same areas as the outline blit below */
+        IntRect sourceRect(scaledOutlineSize, scaledOutlineSize, destRect.w / squeeze, destRect.h);
+        IntRect fillClip(doubleOutlineSize, doubleOutlineSize,
+                         (int)(rect.w / squeeze) - doubleOutlineSize, rect.h - doubleOutlineSize);
+        
+        Vec4 fillColor = fontColor.norm;
+        
+        if (scaledOutlineSize)
+            fillColor.w = 1.0f;
+        
+        Bitmap *layer = shState->glyphAtlas().render(sourceRect, fillClip, fillColor, outColor.norm);
+        
+        if (layer)
+        {
+            /* The layer's texture came from the pool and goes back
+             * there, so only smooth it while scaling it into place */
+            TEX::ID layerTex = layer->getGLTypes().tex;
+            
+            TEX::bind(layerTex);
+            TEX::setSmooth(true);
+            stretchBlt(destRect, *layer, IntRect(0, 0, sourceRect.w, sourceRect.h), txtAlpha);
+            TEX::bind(layerTex);
+            TEX::setSmooth(false);
+            return;
+        }
+    }
+    
     SDL_Surface *txtSurf;
     
     if (p->font->isSolid())
@@ -1992,36 +2101,9 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
     if (p->font->getShadow())
         applyShadow(txtSurf, *p->format, c);
     
-    int alignX = rect.x;
-    
-    switch (align)
-    {
-        default:
-        case Left :
-            break;
-            
-        case Center :
-            alignX += ceil((rect.w - (txtSurf->w + doubleOutlineSize)) / 2.0f);
-            break;
-            
-        case Right :
-            alignX += rect.w - txtSurf->w;
-            break;
-    }
-    
-    if (alignX < rect.x)
-        alignX = rect.x;
-    
-    int alignY = rect.y + (rect.h - txtSurf->h) / 2;
-    
-    alignY = std::max(alignY, rect.y);
-    
-    /* FIXME: RGSS begins squeezing the text before it fills the rect.
-     * While this is extremely undesirable, a number of games will understandably
-     * have made the rects bigger to compensate, so we should probably match it */
-    float squeeze = (float) rect.w / txtSurf->w;
-    
-    squeeze = clamp(squeeze, squeezeLimit, 1.0f);
+    int alignX, alignY;
+    float squeeze = alignText(rect, align, txtSurf->w, txtSurf->h, doubleOutlineSize,
+                              squeezeLimit, alignX, alignY);
     
     /* outline using TTF_Outline and blending it together with SDL_BlitSurface
      * FIXME: RGSS's "outline" includes a complete set of text behind the regular text
@@ -2123,6 +2205,11 @@ IntRect Bitmap::textSize(const char *str)
     // Need to double-check this.
 
     TTF_Font *font = p->font->getSdlFont();
+    SharedFontState &fontState = shState->fontState();
+    Vec2i size;
+    
+    if (fontState.cachedTextSize(font, str, size))
+        return IntRect(0, 0, size.x, size.y);
     
     // freetype sometimes treats the last character of the as being
     // a pixel wider than it should be. Adding a space at the end and then
@@ -2147,6 +2234,8 @@ IntRect Bitmap::textSize(const char *str)
     if (p->font->getItalic() && *endPtr == '\0')
         TTF_GlyphMetrics(font, ucs2, 0, 0, 0, 0, &w);
     
+    fontState.cacheTextSize(font, str, Vec2i(w, h));
+    
     return IntRect(0, 0, w, h);
 }
 
@@ -2181,6 +2270,8 @@ SDL_Surface *Bitmap::surface() const
         Debug() << "BUG: High-res Bitmap surface not implemented";
     }
 
+    p->syncSurface();
+    
     return p->surface;
 }
 
@@ -2234,6 +2325,7 @@ void Bitmap::stop()
     }
 
     p->animation.stop();
+    ScreenDamage::mark();
 }
 
 void Bitmap::play()
@@ -2248,6 +2340,7 @@ void Bitmap::play()
     }
 
     p->animation.play();
+    ScreenDamage::mark();
 }
 
 bool Bitmap::isPlaying() const
@@ -2279,6 +2372,7 @@ void Bitmap::gotoAndStop(int frame)
 
     p->animation.stop();
     p->animation.seek(frame);
+    ScreenDamage::mark();
 }
 void Bitmap::gotoAndPlay(int frame)
 {
@@ -2293,6 +2387,7 @@ void Bitmap::gotoAndPlay(int frame)
     p->animation.stop();
     p->animation.seek(frame);
     p->animation.play();
+    ScreenDamage::mark();
 }
 
 int Bitmap::numFrames() const
@@ -2353,16 +2448,14 @@ int Bitmap::addFrame(Bitmap &source, int position)
         
         p->animation.frames.push_back(p->gl);
         
-        if (p->surface)
-            SDL_FreeSurface(p->surface);
+        p->freeSurface();
         p->gl = TEXFBO();
     }
     
     if (source.surface()) {
         TEX::bind(newframe.tex);
         TEX::uploadImage(source.width(), source.height(), source.surface()->pixels, GL_RGBA);
-        SDL_FreeSurface(p->surface);
-        p->surface = 0;
+        p->freeSurface();
     }
     else {
         GLMeta::blitBegin(newframe);
@@ -2382,6 +2475,8 @@ int Bitmap::addFrame(Bitmap &source, int position)
         ret = position;
     }
     
+    ScreenDamage::mark();
+    
     return ret;
 }
 
@@ -2397,6 +2492,7 @@ void Bitmap::removeFrame(int position) {
     int pos = (position < 0) ? (int)p->animation.frames.size() - 1 : clamp(position, 0, (int)(p->animation.frames.size() - 1));
     shState->texPool().release(p->animation.frames[pos]);
     p->animation.frames.erase(p->animation.frames.begin() + pos);
+    ScreenDamage::mark();
     
     // Change the animated bitmap back to a normal one if there's only one frame left
     if (p->animation.frames.size() == 1) {
@@ -2426,6 +2522,8 @@ void Bitmap::nextFrame()
     }
 
     stop();
+    ScreenDamage::mark();
+    
     if ((uint32_t)p->animation.lastFrame >= p->animation.frames.size() - 1)  {
         if (!p->animation.loop) return;
         p->animation.lastFrame = 0;
@@ -2446,6 +2544,8 @@ void Bitmap::previousFrame()
     }
 
     stop();
+    ScreenDamage::mark();
+    
     if (p->animation.lastFrame <= 0) {
         if (!p->animation.loop) {
             p->animation.lastFrame = 0;
@@ -2573,6 +2673,8 @@ void Bitmap::assumeRubyGC()
 
 void Bitmap::releaseResources()
 {
+    ScreenDamage::mark();
+    
     if (p->selfHires && !p->assumingRubyGC) {
         delete p->selfHires;
     }
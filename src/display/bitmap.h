@@ -32,6 +32,7 @@ class Font;
 class ShaderBase;
 struct TEXFBO;
 struct SDL_Surface;
+struct DecodedImage;
 
 struct BitmapPrivate;
 // FIXME make this class use proper RGSS classes again
@@ -43,6 +44,8 @@ public:
 	Bitmap(void *pixeldata, int width, int height);
 	Bitmap(TEXFBO &other);
 	Bitmap(SDL_Surface *imgSurf, SDL_Surface *imgSurfHires, bool forceMega = false);
+	/* Takes ownership of the image data */
+	Bitmap(DecodedImage &image, const char *filename);
 
 	/* Clone constructor */
     
@@ -51,6 +54,7 @@ public:
 	~Bitmap();
 
 	void initFromSurface(SDL_Surface *imgSurf, Bitmap *hiresBitmap, bool forceMega = false);
+	void initFromImage(DecodedImage &image, Bitmap *hiresBitmap, const char *filename);
 
 	int width()  const;
 	int height() const;
@@ -98,6 +102,8 @@ public:
     bool getRaw(void *output, int output_size);
     void replaceRaw(void *pixel_data, int size);
     void saveToFile(const char *filename);
+    /* Returns a handle for ImageWriter::finished() */
+    int saveToFileAsync(const char *filename);
 
 	void hueChange(int hue);
 
@@ -0,0 +1,841 @@
+/*
+** bitmaploader.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bitmaploader.h"
+
+#include "sharedstate.h"
+#include "filesystem.h"
+#include "config.h"
+#include "boost-hash.h"
+#include "intrulist.h"
+#include "sdl-util.h"
+#include "util.h"
+#include "debugwriter.h"
+
+#include <SDL_image.h>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#include <SDL_cpuinfo.h>
+
+#include <physfs.h>
+
+#include <deque>
+#include <vector>
+#include <assert.h>
+#include <stdlib.h>
+
+extern "C" {
+#include "libnsgif/libnsgif.h"
+}
+
+// libnsgif loading callbacks, taken pretty much straight from their tests
+
+static void *gif_bitmap_create(int width, int height)
+{
+    /* ensure a stupidly large bitmap is not created */
+    return calloc(width * height, 4);
+}
+
+
+static void gif_bitmap_set_opaque(void *bitmap, bool opaque)
+{
+    (void) opaque;  /* unused */
+    (void) bitmap;  /* unused */
+    assert(bitmap);
+}
+
+
+static bool gif_bitmap_test_opaque(void *bitmap)
+{
+    (void) bitmap;  /* unused */
+    assert(bitmap);
+    return false;
+}
+
+
+static unsigned char *gif_bitmap_get_buffer(void *bitmap)
+{
+    assert(bitmap);
+    return (unsigned char *)bitmap;
+}
+
+
+static void gif_bitmap_destroy(void *bitmap)
+{
+    assert(bitmap);
+    free(bitmap);
+}
+
+
+static void gif_bitmap_modified(void *bitmap)
+{
+    (void) bitmap;  /* unused */
+    assert(bitmap);
+    return;
+}
+
+// --------------------
+
+/* Limits on decoded images that were prefetched but not (yet)
+ * picked up by a Bitmap; beyond them, the oldest are dropped */
+#define MAX_UNCLAIMED_JOBS 128
+#define MAX_UNCLAIMED_BYTES (128 * 1024 * 1024)
+
+struct CachedImage
+{
+	std::string key;
+
+	/* Always in ABGR8888 */
+	SDL_Surface *surface;
+	size_t bytes;
+
+	/* Link into the cache priority list */
+	IntruListLink<CachedImage> link;
+
+	CachedImage()
+	    : surface(0),
+	      bytes(0),
+	      link(this)
+	{}
+};
+
+struct ImageCache
+{
+	SDL_mutex *mutex;
+
+	BoostHash<std::string, CachedImage*> hash;
+	/* Most recently used image at the front */
+	IntruList<CachedImage> images;
+
+	size_t size;
+	size_t capacity;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+
+	ImageCache(size_t capacity)
+	    : size(0),
+	      capacity(capacity),
+	      hits(0),
+	      misses(0),
+	      evictions(0)
+	{
+		mutex = SDL_CreateMutex();
+	}
+
+	~ImageCache()
+	{
+		for (BoostHash<std::string, CachedImage*>::const_iterator iter = hash.cbegin();
+		     iter != hash.cend(); ++iter)
+		{
+			SDL_FreeSurface(iter->second->surface);
+			delete iter->second;
+		}
+
+		SDL_DestroyMutex(mutex);
+	}
+
+	bool enabled() const
+	{
+		return capacity > 0;
+	}
+
+	/* Identifies the file contents as well as we cheaply can:
+	 * the same path may resolve into a different archive or
+	 * directory, or have been modified since it was cached */
+	static std::string makeKey(const char *fullPath)
+	{
+		std::string key(fullPath);
+
+		const char *realDir = PHYSFS_getRealDir(fullPath);
+		if (realDir)
+		{
+			key += '|';
+			key += realDir;
+		}
+
+		PHYSFS_Stat stat;
+		if (PHYSFS_stat(fullPath, &stat))
+		{
+			key += '|' + std::to_string(stat.modtime);
+			key += '|' + std::to_string(stat.filesize);
+		}
+
+		return key;
+	}
+
+	/* Returns a private copy of the cached image, or null */
+	SDL_Surface *lookup(const std::string &key)
+	{
+		SDL_LockMutex(mutex);
+
+		CachedImage *image = hash.value(key, 0);
+		SDL_Surface *copy = 0;
+
+		if (image)
+		{
+			images.remove(image->link);
+			images.prepend(image->link);
+
+			copy = SDL_ConvertSurface(image->surface, image->surface->format, 0);
+		}
+
+		if (copy)
+			++hits;
+		else
+			++misses;
+
+		SDL_UnlockMutex(mutex);
+
+		return copy;
+	}
+
+	/* Stores a copy of 'surf' */
+	void insert(const std::string &key, SDL_Surface *surf)
+	{
+		size_t bytes = (size_t) surf->pitch * surf->h;
+
+		if (bytes > capacity)
+			return;
+
+		SDL_Surface *copy = SDL_ConvertSurface(surf, surf->format, 0);
+
+		if (!copy)
+			return;
+
+		SDL_LockMutex(mutex);
+
+		/* Another worker might have decoded the same file */
+		if (hash.contains(key))
+		{
+			SDL_UnlockMutex(mutex);
+			SDL_FreeSurface(copy);
+
+			return;
+		}
+
+		/* If memory limit is reached, delete lowest priority images
+		 * until there is room or no images left */
+		while (size + bytes > capacity && !images.isEmpty())
+		{
+			CachedImage *last = images.tail();
+			hash.remove(last->key);
+			images.remove(last->link);
+
+			size -= last->bytes;
+			++evictions;
+
+			SDL_FreeSurface(last->surface);
+			delete last;
+		}
+
+		CachedImage *image = new CachedImage;
+		image->key = key;
+		image->surface = copy;
+		image->bytes = bytes;
+
+		hash.insert(key, image);
+		images.prepend(image->link);
+
+		size += bytes;
+
+		SDL_UnlockMutex(mutex);
+	}
+
+	void getStats(BitmapCacheStats &out)
+	{
+		SDL_LockMutex(mutex);
+
+		out.hits = hits;
+		out.misses = misses;
+		out.evictions = evictions;
+		out.entries = images.getSize();
+		out.size = size;
+		out.capacity = capacity;
+
+		SDL_UnlockMutex(mutex);
+	}
+};
+
+struct BitmapOpenHandler : FileSystem::OpenHandler
+{
+    // Non-GIF
+    SDL_Surface *surface;
+    
+    // GIF
+    std::string error;
+    gif_animation *gif;
+    unsigned char *gif_data;
+    size_t gif_data_size;
+    
+    ImageCache *cache;
+    std::string cacheKey;
+    
+    BitmapOpenHandler(ImageCache *cache)
+    : surface(0), gif(0), gif_data(0), gif_data_size(0), cache(cache)
+    {}
+    
+    bool tryPath(const char *fullPath)
+    {
+        if (!cache)
+            return false;
+        
+        cacheKey = ImageCache::makeKey(fullPath);
+        surface = cache->lookup(cacheKey);
+        
+        return surface;
+    }
+    
+    bool tryRead(SDL_RWops &ops, const char *ext)
+    {
+        if (IMG_isGIF(&ops)) {
+            // Use libnsgif to initialise the gif data
+            gif = new gif_animation;
+            
+            gif_bitmap_callback_vt gif_bitmap_callbacks = {
+                gif_bitmap_create,
+                gif_bitmap_destroy,
+                gif_bitmap_get_buffer,
+                gif_bitmap_set_opaque,
+                gif_bitmap_test_opaque,
+                gif_bitmap_modified
+            };
+            
+            gif_create(gif, &gif_bitmap_callbacks);
+            
+            gif_data_size = ops.size(&ops);
+            
+            gif_data = new unsigned char[gif_data_size];
+            ops.seek(&ops, 0, RW_SEEK_SET);
+            ops.read(&ops, gif_data, gif_data_size, 1);
+            
+            int status;
+            do {
+                status = gif_initialise(gif, gif_data_size, gif_data);
+                if (status != GIF_OK && status != GIF_WORKING) {
+                    gif_finalise(gif);
+                    delete gif;
+                    delete[] gif_data;
+                    gif = 0;
+                    error = "Failed to initialize GIF (Error " + std::to_string(status) + ")";
+                    return false;
+                }
+            } while (status != GIF_OK);
+            
+            // Decode the first frame
+            status = gif_decode_frame(gif, 0);
+            if (status != GIF_OK && status != GIF_WORKING) {
+                error = "Failed to decode first GIF frame. (Error " + std::to_string(status) + ")";
+                gif_finalise(gif);
+                delete gif;
+                delete[] gif_data;
+                gif = 0;
+                return false;
+            }
+        } else {
+            surface = IMG_LoadTyped_RW(&ops, 1, ext);
+            
+            // Convert here rather than on the render thread
+            if (surface && surface->format->format != SDL_PIXELFORMAT_ABGR8888) {
+                SDL_Surface *surfConv = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ABGR8888, 0);
+                SDL_FreeSurface(surface);
+                surface = surfConv;
+            }
+            
+            if (surface && cache)
+                cache->insert(cacheKey, surface);
+        }
+        return (surface || gif);
+    }
+};
+
+DecodedImage::DecodedImage()
+    : surface(0),
+      gif(0),
+      gifData(0),
+      gifDataSize(0),
+      failed(false),
+      errorType(Exception::MKXPError)
+{}
+
+void DecodedImage::fail(const Exception &exc)
+{
+	release();
+
+	failed = true;
+	errorType = exc.type;
+	error = exc.msg.c_str();
+}
+
+void DecodedImage::release()
+{
+	if (surface)
+		SDL_FreeSurface(surface);
+
+	if (gif)
+	{
+		gif_finalise(gif);
+		delete gif;
+	}
+
+	delete[] gifData;
+
+	surface = 0;
+	gif = 0;
+	gifData = 0;
+	gifDataSize = 0;
+}
+
+static void decodeImage(const char *filename, DecodedImage &out, ImageCache *cache)
+{
+	BitmapOpenHandler handler(cache->enabled() ? cache : 0);
+
+	try
+	{
+		if (!shState->fileSystem().tryOpenRead(handler, filename))
+		{
+			out.fail(Exception(Exception::NoFileError, "%s", filename));
+			return;
+		}
+	}
+	catch (const Exception &e)
+	{
+		out.fail(e);
+		return;
+	}
+
+	if (!handler.error.empty())
+	{
+		// Not loaded with SDL, but I want it to be caught with the same exception type
+		out.fail(Exception(Exception::SDLError, "Error loading image '%s': %s",
+		                   filename, handler.error.c_str()));
+	}
+	else if (!handler.gif && !handler.surface)
+	{
+		/* SDL errors are per thread, so this has to be read here */
+		out.fail(Exception(Exception::SDLError, "Error loading image '%s': %s",
+		                   filename, SDL_GetError()));
+	}
+	else
+	{
+		out.surface = handler.surface;
+		out.gif = handler.gif;
+		out.gifData = handler.gif_data;
+		out.gifDataSize = handler.gif_data_size;
+	}
+}
+
+static size_t imageBytes(const DecodedImage &image)
+{
+	if (image.surface)
+		return (size_t) image.surface->pitch * image.surface->h;
+
+	if (image.gif)
+		return image.gifDataSize + (size_t) image.gif->width * image.gif->height * 4;
+
+	return 0;
+}
+
+struct LoadJob
+{
+	std::string filename;
+	DecodedImage image;
+
+	/* Taken off the queue by a worker (or 'load()') */
+	bool started;
+	bool done;
+
+	/* Being picked up by 'load()' */
+	bool claimed;
+	/* Released while being decoded; dropped once done */
+	bool discard;
+
+	/* Link into the list of finished, unclaimed jobs */
+	IntruListLink<LoadJob> link;
+	size_t bytes;
+
+	LoadJob(const std::string &filename)
+	    : filename(filename),
+	      started(false),
+	      done(false),
+	      claimed(false),
+	      discard(false),
+	      link(this),
+	      bytes(0)
+	{}
+};
+
+struct BitmapLoaderPrivate
+{
+	bool enableHires;
+
+	ImageCache cache;
+
+	std::vector<SDL_Thread*> workers;
+
+	SDL_mutex *mutex;
+	/* Signalled when a job is queued, or on shutdown */
+	SDL_cond *workCond;
+	/* Broadcast whenever a job finishes */
+	SDL_cond *doneCond;
+
+	std::deque<LoadJob*> queue;
+	BoostHash<std::string, LoadJob*> jobs;
+
+	/* Finished jobs nobody claimed yet, oldest first */
+	IntruList<LoadJob> unclaimed;
+	size_t unclaimedBytes;
+
+	/* Jobs currently being decoded by workers */
+	size_t active;
+
+	bool quit;
+
+	BitmapLoaderPrivate(size_t cacheSize)
+	    : cache(cacheSize),
+	      unclaimedBytes(0),
+	      active(0),
+	      quit(false)
+	{
+		mutex = SDL_CreateMutex();
+		workCond = SDL_CreateCond();
+		doneCond = SDL_CreateCond();
+	}
+
+	~BitmapLoaderPrivate()
+	{
+		SDL_DestroyCond(doneCond);
+		SDL_DestroyCond(workCond);
+		SDL_DestroyMutex(mutex);
+	}
+
+	/* Requires the lock */
+	bool enqueue(const std::string &filename)
+	{
+		LoadJob *existing = jobs.value(filename, 0);
+
+		if (existing)
+		{
+			/* Released while decoding, but wanted again */
+			existing->discard = false;
+			return false;
+		}
+
+		LoadJob *job = new LoadJob(filename);
+		jobs.insert(filename, job);
+		queue.push_back(job);
+
+		SDL_CondSignal(workCond);
+
+		return true;
+	}
+
+	/* Requires the lock. Frees an unclaimed job, whatever its state;
+	 * ones still being decoded are only marked */
+	void drop(LoadJob *job)
+	{
+		if (job->started && !job->done)
+		{
+			job->discard = true;
+			return;
+		}
+
+		if (!job->started)
+		{
+			for (std::deque<LoadJob*>::iterator iter = queue.begin();
+			     iter != queue.end(); ++iter)
+			{
+				if (*iter == job)
+				{
+					queue.erase(iter);
+					break;
+				}
+			}
+		}
+
+		if (job->link.next)
+		{
+			unclaimed.remove(job->link);
+			unclaimedBytes -= job->bytes;
+		}
+
+		jobs.remove(job->filename);
+		job->image.release();
+		delete job;
+	}
+
+	/* Requires the lock */
+	void finish(LoadJob *job)
+	{
+		job->done = true;
+
+		if (job->claimed)
+			return;
+
+		if (job->discard)
+		{
+			drop(job);
+			return;
+		}
+
+		job->bytes = imageBytes(job->image);
+		unclaimed.append(job->link);
+		unclaimedBytes += job->bytes;
+
+		while ((unclaimed.getSize() > MAX_UNCLAIMED_JOBS ||
+		        unclaimedBytes > MAX_UNCLAIMED_BYTES) && !unclaimed.isEmpty())
+			drop(unclaimed.begin()->data);
+	}
+
+	void worker()
+	{
+		SDL_LockMutex(mutex);
+
+		while (true)
+		{
+			while (queue.empty() && !quit)
+				SDL_CondWait(workCond, mutex);
+
+			if (quit)
+				break;
+
+			LoadJob *job = queue.front();
+			queue.pop_front();
+			job->started = true;
+			++active;
+
+			SDL_UnlockMutex(mutex);
+			decodeImage(job->filename.c_str(), job->image, &cache);
+			SDL_LockMutex(mutex);
+
+			--active;
+			finish(job);
+
+			SDL_CondBroadcast(doneCond);
+		}
+
+		SDL_UnlockMutex(mutex);
+	}
+};
+
+BitmapLoader::BitmapLoader(const Config &conf)
+{
+	p = new BitmapLoaderPrivate((size_t) conf.bitmapCacheSize * 1024 * 1024);
+	p->enableHires = conf.enableHires;
+
+	int threadCount = conf.bitmapLoaderThreads;
+
+	/* Leave one core to the main thread */
+	if (threadCount <= 0)
+		threadCount = clamp(SDL_GetCPUCount() - 1, 1, 4);
+
+	for (int i = 0; i < threadCount; ++i)
+	{
+		SDL_Thread *thread = createSDLThread
+			<BitmapLoaderPrivate, &BitmapLoaderPrivate::worker>(p, "bitmapload");
+
+		if (thread)
+			p->workers.push_back(thread);
+	}
+
+	if (p->workers.empty())
+		Debug() << "Failed to start image decoding threads:" << SDL_GetError();
+}
+
+BitmapLoader::~BitmapLoader()
+{
+	SDL_LockMutex(p->mutex);
+	p->quit = true;
+	SDL_CondBroadcast(p->workCond);
+	SDL_UnlockMutex(p->mutex);
+
+	for (size_t i = 0; i < p->workers.size(); ++i)
+		SDL_WaitThread(p->workers[i], 0);
+
+	/* Free results that were never picked up */
+	for (BoostHash<std::string, LoadJob*>::const_iterator iter = p->jobs.cbegin();
+	     iter != p->jobs.cend(); ++iter)
+	{
+		p->unclaimed.remove(iter->second->link);
+		iter->second->image.release();
+		delete iter->second;
+	}
+
+	delete p;
+}
+
+void BitmapLoader::decode(const char *filename, DecodedImage &out)
+{
+	decodeImage(filename, out, &p->cache);
+}
+
+bool BitmapLoader::prefetch(const char *filename)
+{
+	/* Without workers, this would only delay the decode */
+	if (p->workers.empty())
+		return false;
+
+	std::string name(filename);
+	static const std::string hiresPrefix = "Hires/";
+
+	SDL_LockMutex(p->mutex);
+
+	bool queued = p->enqueue(name);
+
+	if (p->enableHires && name.compare(0, hiresPrefix.size(), hiresPrefix) != 0)
+		p->enqueue(hiresPrefix + name);
+
+	SDL_UnlockMutex(p->mutex);
+
+	return queued;
+}
+
+bool BitmapLoader::isReady(const char *filename)
+{
+	SDL_LockMutex(p->mutex);
+
+	LoadJob *job = p->jobs.value(filename, 0);
+	bool ready = job && job->done;
+
+	SDL_UnlockMutex(p->mutex);
+
+	return ready;
+}
+
+void BitmapLoader::load(const char *filename, DecodedImage &out)
+{
+	std::string name(filename);
+
+	SDL_LockMutex(p->mutex);
+
+	LoadJob *job = p->jobs.value(name, 0);
+
+	if (!job || job->discard)
+	{
+		SDL_UnlockMutex(p->mutex);
+		decode(filename, out);
+
+		return;
+	}
+
+	job->claimed = true;
+
+	if (job->link.next)
+	{
+		p->unclaimed.remove(job->link);
+		p->unclaimedBytes -= job->bytes;
+	}
+
+	if (!job->started)
+	{
+		/* Don't wait behind other queued jobs */
+		for (std::deque<LoadJob*>::iterator iter = p->queue.begin();
+		     iter != p->queue.end(); ++iter)
+		{
+			if (*iter == job)
+			{
+				p->queue.erase(iter);
+				break;
+			}
+		}
+
+		job->started = true;
+
+		SDL_UnlockMutex(p->mutex);
+		decode(filename, job->image);
+		SDL_LockMutex(p->mutex);
+
+		p->finish(job);
+	}
+
+	while (!job->done)
+		SDL_CondWait(p->doneCond, p->mutex);
+
+	p->jobs.remove(name);
+
+	SDL_UnlockMutex(p->mutex);
+
+	out = job->image;
+	delete job;
+}
+
+void BitmapLoader::release(const char *filename)
+{
+	std::string name(filename);
+	static const std::string hiresPrefix = "Hires/";
+
+	SDL_LockMutex(p->mutex);
+
+	LoadJob *job = p->jobs.value(name, 0);
+	if (job && !job->claimed)
+		p->drop(job);
+
+	if (p->enableHires && name.compare(0, hiresPrefix.size(), hiresPrefix) != 0)
+	{
+		job = p->jobs.value(hiresPrefix + name, 0);
+		if (job && !job->claimed)
+			p->drop(job);
+	}
+
+	SDL_UnlockMutex(p->mutex);
+}
+
+void BitmapLoader::releaseAll()
+{
+	SDL_LockMutex(p->mutex);
+
+	std::vector<LoadJob*> unclaimed;
+
+	for (BoostHash<std::string, LoadJob*>::const_iterator iter = p->jobs.cbegin();
+	     iter != p->jobs.cend(); ++iter)
+		if (!iter->second->claimed)
+			unclaimed.push_back(iter->second);
+
+	for (size_t i = 0; i < unclaimed.size(); ++i)
+		p->drop(unclaimed[i]);
+
+	SDL_UnlockMutex(p->mutex);
+}
+
+void BitmapLoader::waitAll()
+{
+	SDL_LockMutex(p->mutex);
+
+	while (!p->queue.empty() || p->active > 0)
+		SDL_CondWait(p->doneCond, p->mutex);
+
+	SDL_UnlockMutex(p->mutex);
+}
+
+size_t BitmapLoader::pendingCount()
+{
+	SDL_LockMutex(p->mutex);
+	size_t count = p->queue.size() + p->active;
+	SDL_UnlockMutex(p->mutex);
+
+	return count;
+}
+
+void BitmapLoader::getCacheStats(BitmapCacheStats &out)
+{
+	p->cache.getStats(out);
+}
@@ -0,0 +1,121 @@
+/*
+** bitmaploader.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BITMAPLOADER_H
+#define BITMAPLOADER_H
+
+#include "exception.h"
+#include "cachestats.h"
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+struct SDL_Surface;
+struct gif_animation;
+struct Config;
+
+/* An image file decoded into CPU memory,
+ * ready to be uploaded into a Bitmap */
+struct DecodedImage
+{
+	/* Non-GIF */
+	SDL_Surface *surface;
+
+	/* GIF (first frame decoded) */
+	gif_animation *gif;
+	unsigned char *gifData;
+	size_t gifDataSize;
+
+	/* If set, neither of the above is valid */
+	bool failed;
+	Exception::Type errorType;
+	std::string error;
+
+	DecodedImage();
+
+	void fail(const Exception &exc);
+
+	/* Frees whatever is still held */
+	void release();
+};
+
+struct BitmapCacheStats : CacheStats
+{
+	/* Bytes of pixel data currently held */
+	size_t size;
+	size_t capacity;
+};
+
+struct BitmapLoaderPrivate;
+
+/* Decodes image files on a pool of worker threads, so that
+ * Bitmap construction only has to do the texture upload.
+ * Files are queued by name via 'prefetch()'; the Bitmap
+ * constructor then picks up the result via 'load()'.
+ * Decoded still images are additionally kept in an LRU cache
+ * keyed by their resolved path and modification time, so
+ * loading the same file again skips decoding entirely. */
+class BitmapLoader
+{
+public:
+	BitmapLoader(const Config &conf);
+	~BitmapLoader();
+
+	/* Queues 'filename' (and its Hires/ variant, if
+	 * enabled) for decoding. Returns false if it
+	 * was already queued */
+	bool prefetch(const char *filename);
+
+	/* Returns true if 'filename' was queued
+	 * and has finished decoding */
+	bool isReady(const char *filename);
+
+	/* Hands over the decoded 'filename'. If it was queued,
+	 * waits for the worker to finish (or decodes it right away
+	 * if no worker has picked it up yet), otherwise decodes
+	 * it on the calling thread */
+	void load(const char *filename, DecodedImage &out);
+
+	/* Drops a prefetched 'filename' (and its Hires/ variant) that
+	 * won't be loaded after all. Decoded images nobody picks up
+	 * are also dropped, oldest first, past a fixed budget */
+	void release(const char *filename);
+
+	/* Drops every prefetched image not being loaded right now */
+	void releaseAll();
+
+	/* Blocks until no decodes are queued or in progress */
+	void waitAll();
+
+	/* Number of queued or in progress decodes */
+	size_t pendingCount();
+
+	/* Thread safe; failures are reported through 'out' */
+	void decode(const char *filename, DecodedImage &out);
+
+	void getCacheStats(BitmapCacheStats &out);
+
+private:
+	BitmapLoaderPrivate *p;
+};
+
+#endif // BITMAPLOADER_H
@@ -24,6 +24,7 @@
 
 #include "etc.h"
 #include "etc-internal.h"
+#include "screendamage.h"
 
 class Flashable
 {
@@ -41,6 +42,8 @@ public:
 		if (duration < 1)
 			return;
 
+		ScreenDamage::mark();
+
 		flashing = true;
 		this->duration = duration;
 		counter = 0;
@@ -60,6 +63,8 @@ public:
 		if (!flashing)
 			return;
 
+		ScreenDamage::mark();
+
 		if (++counter > duration)
 		{
 			/* Flash finished. Cleanup */
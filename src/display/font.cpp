@@ -83,6 +83,10 @@ static SDL_RWops *openBundledFont()
 
 typedef std::pair<std::string, int> FontKey;
 
+/* Dropped all at once when exceeded; strings measured by
+ * window scripts are few and repeat every frame */
+#define TEXT_SIZE_CACHE_MAX 8192
+
 struct FontSet
 {
 	/* 'Regular' style */
@@ -109,8 +113,21 @@ struct SharedFontStatePrivate
     /* Internal default font family that is used anytime an
      * empty/invalid family is requested */
     std::string defaultFamily;
+
+	/* Maps: font handle, style and string, To: text size */
+	BoostHash<std::string, Vec2i> textSizes;
+	CacheStats textSizeStats;
 };
 
+static std::string textSizeKey(TTF_Font *font, const char *str)
+{
+	std::string key(reinterpret_cast<const char*>(&font), sizeof(font));
+	key += (char) TTF_GetFontStyle(font);
+	key += str;
+
+	return key;
+}
+
 SharedFontState::SharedFontState(const Config &conf)
 {
 	p = new SharedFontStatePrivate;
@@ -262,6 +279,41 @@ bool SharedFontState::fontPresent(std::string family) const
 	return !(set.regular.empty() && set.other.empty());
 }
 
+bool SharedFontState::cachedTextSize(_TTF_Font *font, const char *str, Vec2i &size)
+{
+	/* Measured sizes are never negative */
+	const Vec2i missing(-1, -1);
+	Vec2i cached = p->textSizes.value(textSizeKey(font, str), missing);
+
+	if (cached.x == missing.x)
+	{
+		++p->textSizeStats.misses;
+		return false;
+	}
+
+	++p->textSizeStats.hits;
+	size = cached;
+
+	return true;
+}
+
+void SharedFontState::cacheTextSize(_TTF_Font *font, const char *str, const Vec2i &size)
+{
+	if (p->textSizes.size() >= TEXT_SIZE_CACHE_MAX)
+	{
+		p->textSizeStats.evictions += p->textSizes.size();
+		p->textSizes.clear();
+	}
+
+	p->textSizes.insert(textSizeKey(font, str), size);
+	p->textSizeStats.entries = p->textSizes.size();
+}
+
+const CacheStats &SharedFontState::textSizeStats() const
+{
+	return p->textSizeStats;
+}
+
 _TTF_Font *SharedFontState::openBundled(int size)
 {
 	SDL_RWops *ops = openBundledFont();
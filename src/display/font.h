@@ -24,6 +24,7 @@
 
 #include "etc.h"
 #include "util.h"
+#include "cachestats.h"
 
 #include <vector>
 #include <string>
@@ -55,6 +56,13 @@ public:
 	static _TTF_Font *openBundled(int size);
     void setDefaultFontFamily(const std::string &family);
 
+	/* Memoized Bitmap#text_size results, keyed by font (with
+	 * its current style) and string. Returns false on a miss */
+	bool cachedTextSize(_TTF_Font *font, const char *str, Vec2i &size);
+	void cacheTextSize(_TTF_Font *font, const char *str, const Vec2i &size);
+
+	const CacheStats &textSizeStats() const;
+
 private:
 	SharedFontStatePrivate *p;
 };
@@ -0,0 +1,272 @@
+/*
+** frameprofiler.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "frameprofiler.h"
+
+#include "exception.h"
+
+#include <SDL_timer.h>
+#include <SDL_thread.h>
+#include <SDL_rwops.h>
+#include <SDL_error.h>
+
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+
+/* About 5 seconds at 60 FPS */
+#define FRAME_RING_SIZE 300
+
+#define EVENT_RING_SIZE (1 << 16)
+#define MAX_DEPTH 16
+
+/* Marks the span of a whole frame in the trace */
+#define FRAME_EVENT ProfSectionCount
+
+static const char *sectionNames[] =
+{
+	"script",
+	"composite",
+	"tilemap_prepare",
+	"draw_text",
+	"frame_delay",
+	"swap"
+};
+
+struct TraceEvent
+{
+	uint8_t section;
+	uint64_t start;
+	uint64_t end;
+};
+
+template<typename T>
+struct Ring
+{
+	std::vector<T> data;
+	size_t head;
+	size_t fill;
+
+	Ring(size_t size)
+	    : data(size),
+	      head(0),
+	      fill(0)
+	{}
+
+	void push(const T &value)
+	{
+		data[head] = value;
+		head = (head + 1) % data.size();
+
+		if (fill < data.size())
+			++fill;
+	}
+
+	/* 0 is the oldest */
+	const T &at(size_t index) const
+	{
+		return data[(head + data.size() - fill + index) % data.size()];
+	}
+
+	void clear()
+	{
+		head = fill = 0;
+	}
+};
+
+struct ProfilerState
+{
+	SDL_threadID thread;
+	double msPerCount;
+
+	uint64_t frameStart;
+
+	/* Last time the time since got charged to a section */
+	uint64_t lastMark;
+
+	/* stack[0] is always ProfScript */
+	ProfileSection stack[MAX_DEPTH];
+	uint64_t enterTime[MAX_DEPTH];
+	int depth;
+
+	uint64_t acc[ProfSectionCount];
+
+	Ring<FrameStats> frames;
+	Ring<TraceEvent> events;
+
+	ProfilerState()
+	    : frames(FRAME_RING_SIZE),
+	      events(EVENT_RING_SIZE)
+	{
+		msPerCount = 1000.0 / SDL_GetPerformanceFrequency();
+		reset();
+	}
+
+	void reset()
+	{
+		thread = SDL_ThreadID();
+		frameStart = lastMark = SDL_GetPerformanceCounter();
+
+		stack[0] = ProfScript;
+		enterTime[0] = frameStart;
+		depth = 1;
+
+		memset(acc, 0, sizeof(acc));
+
+		frames.clear();
+		events.clear();
+	}
+
+	/* Charges the time since the last mark to the current section */
+	uint64_t mark()
+	{
+		uint64_t now = SDL_GetPerformanceCounter();
+		acc[stack[depth-1]] += now - lastMark;
+		lastMark = now;
+
+		return now;
+	}
+};
+
+static ProfilerState *state = 0;
+
+bool FrameProfiler::enabled = false;
+
+void FrameProfiler::setEnabled(bool value)
+{
+	if (value && !state)
+		state = new ProfilerState;
+
+	if (value && !enabled)
+		state->reset();
+
+	enabled = value;
+}
+
+void FrameProfiler::enter(ProfileSection section)
+{
+	if (SDL_ThreadID() != state->thread || state->depth == MAX_DEPTH)
+		return;
+
+	uint64_t now = state->mark();
+
+	state->stack[state->depth] = section;
+	state->enterTime[state->depth] = now;
+	++state->depth;
+}
+
+void FrameProfiler::leave(ProfileSection section)
+{
+	if (SDL_ThreadID() != state->thread)
+		return;
+
+	/* Unbalanced, eg. after a reset inside the section */
+	if (state->depth < 2 || state->stack[state->depth-1] != section)
+		return;
+
+	uint64_t now = state->mark();
+	--state->depth;
+
+	TraceEvent e = { (uint8_t) section, state->enterTime[state->depth], now };
+	state->events.push(e);
+}
+
+void FrameProfiler::endFrame()
+{
+	if (!enabled || SDL_ThreadID() != state->thread)
+		return;
+
+	uint64_t now = state->mark();
+
+	FrameStats stats;
+	stats.total = (now - state->frameStart) * state->msPerCount;
+
+	for (size_t i = 0; i < ProfSectionCount; ++i)
+		stats.sections[i] = state->acc[i] * state->msPerCount;
+
+	state->frames.push(stats);
+
+	TraceEvent e = { FRAME_EVENT, state->frameStart, now };
+	state->events.push(e);
+
+	memset(state->acc, 0, sizeof(state->acc));
+	state->frameStart = now;
+}
+
+size_t FrameProfiler::frameCount()
+{
+	return state ? state->frames.fill : 0;
+}
+
+const FrameStats &FrameProfiler::frame(size_t index)
+{
+	return state->frames.at(index);
+}
+
+const char *FrameProfiler::sectionName(ProfileSection section)
+{
+	return sectionNames[section];
+}
+
+void FrameProfiler::dumpTrace(const char *filename)
+{
+	SDL_RWops *ops = SDL_RWFromFile(filename, "wb");
+
+	if (!ops)
+		throw Exception(Exception::MKXPError, "Failed to open %s for writing: %s",
+		                filename, SDL_GetError());
+
+	std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	size_t count = state ? state->events.fill : 0;
+
+	/* Timestamps are in microseconds, relative to the earliest event
+	 * (which isn't necessarily the first one, those are in the order
+	 * they ended) */
+	uint64_t base = count ? state->events.at(0).start : 0;
+
+	for (size_t i = 1; i < count; ++i)
+		if (state->events.at(i).start < base)
+			base = state->events.at(i).start;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const TraceEvent &e = state->events.at(i);
+		const char *name = (e.section == FRAME_EVENT) ? "frame" : sectionNames[e.section];
+
+		char buf[192];
+		snprintf(buf, sizeof(buf),
+		         "%s{\"name\":\"%s\",\"cat\":\"mkxp\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+		         "\"ts\":%.3f,\"dur\":%.3f}\n", i ? "," : "", name,
+		         (e.start - base) * state->msPerCount * 1000.0,
+		         (e.end - e.start) * state->msPerCount * 1000.0);
+
+		out += buf;
+	}
+
+	out += "]}\n";
+
+	bool ok = SDL_RWwrite(ops, out.c_str(), 1, out.size()) == out.size();
+	ok = (SDL_RWclose(ops) == 0) && ok;
+
+	if (!ok)
+		throw Exception(Exception::MKXPError, "Failed to write frame trace to %s", filename);
+}
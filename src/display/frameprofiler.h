@@ -0,0 +1,101 @@
+/*
+** frameprofiler.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Where the time of a frame goes. Sections are exclusive:
+ * time spent in a nested section isn't counted towards the
+ * enclosing one. Anything outside of all sections counts as
+ * 'Script' (Ruby, plus the engine work it calls into) */
+enum ProfileSection
+{
+	ProfScript,
+	ProfComposite,
+	ProfTilemapPrepare,
+	ProfDrawText,
+	ProfFrameDelay,
+	ProfSwap,
+
+	ProfSectionCount
+};
+
+struct FrameStats
+{
+	/* In milliseconds */
+	double total;
+	double sections[ProfSectionCount];
+};
+
+/* Records per-frame time breakdowns of the RGSS thread into
+ * a ring buffer, and (optionally) the individual sections as
+ * a trace that can be dumped in Chrome's trace event format.
+ * Costs a single branch per section while disabled */
+struct FrameProfiler
+{
+	static bool enabled;
+
+	/* Starts recording on the calling thread, dropping
+	 * anything recorded before. Sections entered from
+	 * other threads are ignored */
+	static void setEnabled(bool value);
+
+	static void enter(ProfileSection section);
+	static void leave(ProfileSection section);
+
+	/* Closes the current frame, called right after
+	 * it was presented (or skipped) */
+	static void endFrame();
+
+	/* Recorded frames, oldest first */
+	static size_t frameCount();
+	static const FrameStats &frame(size_t index);
+
+	static const char *sectionName(ProfileSection section);
+
+	/* Writes all recorded trace events to 'filename' */
+	static void dumpTrace(const char *filename);
+};
+
+struct ProfileScope
+{
+	ProfileSection section;
+	bool active;
+
+	ProfileScope(ProfileSection section)
+	    : section(section),
+	      active(FrameProfiler::enabled)
+	{
+		if (active)
+			FrameProfiler::enter(section);
+	}
+
+	~ProfileScope()
+	{
+		if (active)
+			FrameProfiler::leave(section);
+	}
+};
+
+#endif // FRAMEPROFILER_H
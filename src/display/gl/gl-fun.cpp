@@ -97,6 +97,7 @@ void initGLFunctions()
     
     /* Assume single digit */
     int glMajor = *ver - '0';
+    int glMinor = (ver[1] == '.') ? ver[2] - '0' : 0;
     
     if (glMajor < 2)
 #ifndef GLES2_HEADER
@@ -177,6 +178,14 @@ void initGLFunctions()
         GL_VAO_FUN;
     }
     
+    /* Asynchronous readback entrypoints */
+    if (gles ? glMajor >= 3 : (glMajor > 3 || (glMajor == 3 && (glMinor >= 2 || HAVE_EXT(ARB_sync)))))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+        GL_READBACK_FUN;
+    }
+    
     /* Debug callback entrypoints */
     if (HAVE_EXT(KHR_debug))
     {
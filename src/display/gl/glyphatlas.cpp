@@ -0,0 +1,682 @@
+/*
+** glyphatlas.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "glyphatlas.h"
+
+#include "bitmap.h"
+#include "boost-hash.h"
+#include "debugwriter.h"
+#include "gl-meta.h"
+#include "gl-util.h"
+#include "glstate.h"
+#include "quad.h"
+#include "quadarray.h"
+#include "shader.h"
+#include "sharedstate.h"
+#include "util.h"
+
+#include <SDL_ttf.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <string.h>
+
+/* Pages start out small and grow up to this size */
+#define PAGE_START_SIZE 256
+#define PAGE_MAX_SIZE 2048
+
+/* Least recently used pages are dropped beyond this count */
+#define MAX_PAGES 16
+
+#define GLYPH_PADDING 1
+
+struct Glyph
+{
+	/* Area in the atlas page. Like SDL_ttf's single glyph surfaces,
+	 * it spans the full line height, and starts 'offset' pixels
+	 * from the pen position */
+	IntRect rect;
+	int offset;
+	int advance;
+
+	/* No visible pixels (eg. spaces); not stored in the page */
+	bool blank;
+};
+
+/* All glyphs of one font, style and outline size combination */
+struct AtlasPage
+{
+	TEXFBO tex;
+
+	BoostHash<uint16_t, Glyph> glyphs;
+	BoostHash<uint32_t, int> kerning;
+
+	/* Shelf packing state */
+	int shelfX, shelfY, shelfH;
+
+	/* Set once a layout didn't match SDL_ttf's */
+	bool unusable;
+
+	unsigned int lastUse;
+};
+
+/* Font, and style | outline size << 8. Fonts are never
+ * closed before the program ends, so the pointer is stable */
+typedef std::pair<_TTF_Font*, int> PageKey;
+
+struct PlacedGlyph
+{
+	IntRect rect;
+	int x;
+};
+
+/* A laid out line of text */
+struct GlyphLine
+{
+	AtlasPage *page;
+	std::vector<PlacedGlyph> glyphs;
+};
+
+enum LoadResult
+{
+	LoadOk,
+	LoadPageFull,
+	LoadError
+};
+
+static const SDL_Color white = { 255, 255, 255, 255 };
+
+/* Returns false for anything outside of the BMP
+ * (SDL_ttf's glyph functions take UCS-2), for byte
+ * order marks (which SDL_ttf skips) and invalid input */
+static bool decodeUCS2(const char *str, std::vector<uint16_t> &out)
+{
+	const unsigned char *s = reinterpret_cast<const unsigned char*>(str);
+
+	while (*s)
+	{
+		uint32_t ch;
+		int len;
+
+		if (s[0] < 0x80)
+		{
+			ch = s[0];
+			len = 1;
+		}
+		else if ((s[0] & 0xE0) == 0xC0)
+		{
+			ch = s[0] & 0x1F;
+			len = 2;
+		}
+		else if ((s[0] & 0xF0) == 0xE0)
+		{
+			ch = s[0] & 0x0F;
+			len = 3;
+		}
+		else
+		{
+			return false;
+		}
+
+		for (int i = 1; i < len; ++i)
+		{
+			if ((s[i] & 0xC0) != 0x80)
+				return false;
+
+			ch = (ch << 6) | (s[i] & 0x3F);
+		}
+
+		if ((ch >= 0xD800 && ch <= 0xDFFF) || ch == 0xFEFF || ch == 0xFFFE)
+			return false;
+
+		out.push_back(ch);
+		s += len;
+	}
+
+	return !out.empty();
+}
+
+static void encodeUTF8(uint16_t ch, char *out)
+{
+	if (ch < 0x80)
+	{
+		*out++ = ch;
+	}
+	else if (ch < 0x800)
+	{
+		*out++ = 0xC0 | (ch >> 6);
+		*out++ = 0x80 | (ch & 0x3F);
+	}
+	else
+	{
+		*out++ = 0xE0 | (ch >> 12);
+		*out++ = 0x80 | ((ch >> 6) & 0x3F);
+		*out++ = 0x80 | (ch & 0x3F);
+	}
+
+	*out = '\0';
+}
+
+static bool isBlank(SDL_Surface *surf)
+{
+	for (int y = 0; y < surf->h; ++y)
+	{
+		const uint32_t *row = (const uint32_t*) ((uint8_t*) surf->pixels + y*surf->pitch);
+
+		for (int x = 0; x < surf->w; ++x)
+			if (row[x] & surf->format->Amask)
+				return false;
+	}
+
+	return true;
+}
+
+static void initPageTex(TEXFBO &tex, int width, int height)
+{
+	TEXFBO::init(tex);
+	TEXFBO::allocEmpty(tex, width, height);
+	TEXFBO::linkFBO(tex);
+}
+
+static bool growPage(AtlasPage &page)
+{
+	int maxSize = std::min(PAGE_MAX_SIZE, glState.caps.maxTexSize);
+	int width = page.tex.width;
+	int height = page.tex.height;
+
+	if (height <= width && height < maxSize)
+		height *= 2;
+	else if (width < maxSize)
+		width *= 2;
+	else if (height < maxSize)
+		height *= 2;
+	else
+		return false;
+
+	TEXFBO tex;
+	initPageTex(tex, width, height);
+
+	GLMeta::blitBegin(tex);
+	GLMeta::blitSource(page.tex);
+	GLMeta::blitRectangle(IntRect(0, 0, page.tex.width, page.tex.height), Vec2i());
+	GLMeta::blitEnd();
+
+	TEXFBO::fini(page.tex);
+	page.tex = tex;
+
+	return true;
+}
+
+static bool packGlyph(AtlasPage &page, int width, int height, IntRect &out)
+{
+	if (page.shelfX + width > page.tex.width)
+	{
+		/* Start a new shelf */
+		page.shelfX = 0;
+		page.shelfY += page.shelfH + GLYPH_PADDING;
+		page.shelfH = 0;
+	}
+
+	while (page.shelfX + width > page.tex.width ||
+	       page.shelfY + height > page.tex.height)
+		if (!growPage(page))
+			return false;
+
+	out = IntRect(page.shelfX, page.shelfY, width, height);
+
+	page.shelfX += width + GLYPH_PADDING;
+	page.shelfH = std::max(page.shelfH, height);
+
+	return true;
+}
+
+static void resetPage(AtlasPage &page)
+{
+	page.glyphs.clear();
+	page.shelfX = page.shelfY = page.shelfH = 0;
+}
+
+/* Expects the font outline to be set already */
+static LoadResult loadGlyph(AtlasPage &page, TTF_Font *font, uint16_t ch)
+{
+	Glyph glyph;
+	int minx;
+
+	if (TTF_GlyphMetrics(font, ch, &minx, 0, 0, 0, &glyph.advance) < 0)
+		return LoadError;
+
+	char utf8[4];
+	encodeUTF8(ch, utf8);
+
+	SDL_Surface *surf = TTF_RenderUTF8_Blended(font, utf8, white);
+
+	if (!surf)
+		return LoadError;
+
+	if (surf->format->format != SDL_PIXELFORMAT_ABGR8888)
+	{
+		SDL_Surface *conv = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ABGR8888, 0);
+		SDL_FreeSurface(surf);
+
+		if (!conv)
+			return LoadError;
+
+		surf = conv;
+	}
+
+	glyph.offset = std::min(minx, 0);
+	glyph.rect = IntRect(0, 0, surf->w, surf->h);
+	glyph.blank = isBlank(surf);
+
+	if (!glyph.blank)
+	{
+		if (!packGlyph(page, surf->w, surf->h, glyph.rect))
+		{
+			SDL_FreeSurface(surf);
+			return LoadPageFull;
+		}
+
+		const void *pixels = surf->pixels;
+		std::vector<uint32_t> packed;
+
+		if (surf->pitch != surf->w * 4)
+		{
+			packed.resize(surf->w * surf->h);
+
+			for (int y = 0; y < surf->h; ++y)
+				memcpy(&packed[y*surf->w], (uint8_t*) surf->pixels + y*surf->pitch, surf->w * 4);
+
+			pixels = &packed[0];
+		}
+
+		TEX::bind(page.tex.tex);
+		TEX::uploadSubImage(glyph.rect.x, glyph.rect.y,
+		                    glyph.rect.w, glyph.rect.h, pixels, GL_RGBA);
+	}
+
+	SDL_FreeSurface(surf);
+	page.glyphs.insert(ch, glyph);
+
+	return LoadOk;
+}
+
+static LoadResult loadMissing(AtlasPage &page, TTF_Font *font, int outline,
+                              const std::vector<uint16_t> &chars, bool &added)
+{
+	LoadResult result = LoadOk;
+	bool outlineSet = false;
+
+	for (size_t i = 0; i < chars.size(); ++i)
+	{
+		if (page.glyphs.contains(chars[i]))
+			continue;
+
+		/* Changing the outline flushes SDL_ttf's glyph
+		 * cache, so only do it once there's a miss */
+		if (outline && !outlineSet)
+		{
+			TTF_SetFontOutline(font, outline);
+			outlineSet = true;
+		}
+
+		result = loadGlyph(page, font, chars[i]);
+
+		if (result != LoadOk)
+			break;
+
+		added = true;
+	}
+
+	if (outlineSet)
+		TTF_SetFontOutline(font, 0);
+
+	return result;
+}
+
+static int getKerning(AtlasPage &page, TTF_Font *font,
+                      uint16_t prev, uint16_t ch, bool &added)
+{
+	uint32_t key = (prev << 16) | ch;
+
+	if (!page.kerning.contains(key))
+	{
+		page.kerning.insert(key, TTF_GetFontKerningSizeGlyphs(font, prev, ch));
+		added = true;
+	}
+
+	return page.kerning.value(key);
+}
+
+struct GlyphAtlasPrivate
+{
+	BoostHash<PageKey, AtlasPage*> pages;
+	size_t pageCount;
+	unsigned int useCounter;
+
+	/* Result of the last layout */
+	GlyphLine fill;
+	GlyphLine outline;
+	int outlineSize;
+
+	ColorQuadArray quads;
+
+	/* Scratch bitmap text is composed in */
+	Bitmap *layer;
+
+	GlyphAtlasPrivate()
+	    : pageCount(0),
+	      useCounter(0),
+	      outlineSize(0),
+	      layer(0)
+	{}
+
+	~GlyphAtlasPrivate()
+	{
+		BoostHash<PageKey, AtlasPage*>::const_iterator iter;
+		for (iter = pages.cbegin(); iter != pages.cend(); ++iter)
+		{
+			TEXFBO::fini(iter->second->tex);
+			delete iter->second;
+		}
+
+		delete layer;
+	}
+
+	void evictPage()
+	{
+		BoostHash<PageKey, AtlasPage*>::const_iterator iter, oldest = pages.cend();
+
+		for (iter = pages.cbegin(); iter != pages.cend(); ++iter)
+			if (oldest == pages.cend() || iter->second->lastUse < oldest->second->lastUse)
+				oldest = iter;
+
+		AtlasPage *page = oldest->second;
+		pages.remove(oldest->first);
+		--pageCount;
+
+		TEXFBO::fini(page->tex);
+		delete page;
+	}
+
+	AtlasPage *getPage(TTF_Font *font, int outline)
+	{
+		PageKey key(font, TTF_GetFontStyle(font) | (outline << 8));
+		AtlasPage *page = pages.value(key);
+
+		if (!page)
+		{
+			if (pageCount == MAX_PAGES)
+				evictPage();
+
+			page = new AtlasPage;
+			initPageTex(page->tex, PAGE_START_SIZE, PAGE_START_SIZE);
+			page->shelfX = page->shelfY = page->shelfH = 0;
+			page->unusable = false;
+
+			pages.insert(key, page);
+			++pageCount;
+		}
+
+		page->lastUse = ++useCounter;
+
+		return page;
+	}
+
+	bool layoutLine(TTF_Font *font, const char *str, int outlineSize,
+	                const std::vector<uint16_t> &chars, GlyphLine &line,
+	                int &width, int &height)
+	{
+		AtlasPage *page = getPage(font, outlineSize);
+
+		if (page->unusable)
+			return false;
+
+		bool added = false;
+		LoadResult result = loadMissing(*page, font, outlineSize, chars, added);
+
+		if (result == LoadPageFull)
+		{
+			/* Start over; the text still has to fit at once */
+			resetPage(*page);
+			result = loadMissing(*page, font, outlineSize, chars, added);
+		}
+
+		if (result != LoadOk)
+			return false;
+
+		line.page = page;
+		line.glyphs.clear();
+
+		int pen = 0, left = 0, right = 0;
+		height = -1;
+
+		for (size_t i = 0; i < chars.size(); ++i)
+		{
+			const Glyph &glyph = page->glyphs[chars[i]];
+
+			if (i > 0)
+				pen += getKerning(*page, font, chars[i-1], chars[i], added);
+
+			int x = pen + glyph.offset;
+
+			left = std::min(left, x);
+			right = std::max(right, x + glyph.rect.w);
+
+			if (height < 0)
+				height = glyph.rect.h;
+			else if (glyph.rect.h != height)
+				return false;
+
+			if (!glyph.blank)
+			{
+				PlacedGlyph placed = { glyph.rect, x };
+				line.glyphs.push_back(placed);
+			}
+
+			pen += glyph.advance;
+		}
+
+		for (size_t i = 0; i < line.glyphs.size(); ++i)
+			line.glyphs[i].x -= left;
+
+		width = right - left;
+
+		if (!added)
+			return true;
+
+		/* New glyphs or pairs; make sure SDL_ttf agrees */
+		int ttfWidth, ttfHeight;
+
+		if (outlineSize)
+			TTF_SetFontOutline(font, outlineSize);
+
+		int ok = TTF_SizeUTF8(font, str, &ttfWidth, &ttfHeight);
+
+		if (outlineSize)
+			TTF_SetFontOutline(font, 0);
+
+		if (ok < 0)
+			return false;
+
+		if (ttfWidth != width || ttfHeight != height)
+		{
+			Debug() << "GlyphAtlas: Layout doesn't match SDL_ttf for"
+			        << TTF_FontFaceFamilyName(font) << "(" << width << "vs" << ttfWidth
+			        << "), using regular text rendering";
+
+			page->unusable = true;
+			return false;
+		}
+
+		return true;
+	}
+
+	void ensureLayer(int width, int height)
+	{
+		if (layer && layer->width() >= width && layer->height() >= height)
+			return;
+
+		int maxSize = glState.caps.maxTexSize;
+
+		if (layer)
+		{
+			width = std::max(width, layer->width());
+			height = std::max(height, layer->height());
+		}
+
+		delete layer;
+
+		/* Not a hires-enabled bitmap; the text gets
+		 * composed at the target's own resolution */
+		layer = new Bitmap(std::min(findNextPow2(width), maxSize),
+		                   std::min(findNextPow2(height), maxSize), true);
+	}
+
+	void appendQuads(const GlyphLine &line, size_t &quadIdx, int offX, int offY, const Vec4 &color)
+	{
+		for (size_t i = 0; i < line.glyphs.size(); ++i)
+		{
+			const PlacedGlyph &glyph = line.glyphs[i];
+			Vertex *vert = &quads.vertices[quadIdx++ * 4];
+
+			FloatRect pos(glyph.x + offX, offY, glyph.rect.w, glyph.rect.h);
+			Quad::setTexPosRect(vert, glyph.rect, pos);
+			Quad::setColor(vert, color);
+		}
+	}
+
+	void drawLine(GlyphShader &shader, const GlyphLine &line, size_t offset)
+	{
+		if (line.glyphs.empty())
+			return;
+
+		TEX::bind(line.page->tex.tex);
+		shader.setTexSize(Vec2i(line.page->tex.width, line.page->tex.height));
+
+		quads.draw(offset, line.glyphs.size());
+	}
+};
+
+GlyphAtlas::GlyphAtlas()
+{
+	p = new GlyphAtlasPrivate;
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+	delete p;
+}
+
+bool GlyphAtlas::layout(_TTF_Font *font, const char *str,
+                        int outline, GlyphRun &run)
+{
+	std::vector<uint16_t> chars;
+
+	if (!decodeUCS2(str, chars))
+		return false;
+
+	p->outline.glyphs.clear();
+	p->outlineSize = outline;
+
+	if (!p->layoutLine(font, str, 0, chars, p->fill, run.width, run.height))
+		return false;
+
+	run.outWidth = run.width;
+	run.outHeight = run.height;
+
+	if (outline == 0)
+		return true;
+
+	return p->layoutLine(font, str, outline, chars, p->outline,
+	                     run.outWidth, run.outHeight);
+}
+
+Bitmap *GlyphAtlas::render(const IntRect &area, const IntRect &fillClip,
+                           const Vec4 &color, const Vec4 &outColor)
+{
+	int maxSize = glState.caps.maxTexSize;
+
+	if (area.w > maxSize || area.h > maxSize)
+		return 0;
+
+	p->ensureLayer(area.w, area.h);
+
+	bool hasOutline = p->outlineSize > 0;
+	size_t outCount = p->outline.glyphs.size();
+	size_t quadIdx = 0;
+
+	p->quads.resize(outCount + p->fill.glyphs.size());
+
+	/* The fill sits one outline size into the outline
+	 * surface, see the SDL_ttf path in Bitmap::drawText */
+	int fillOff = p->outlineSize;
+
+	p->appendQuads(p->outline, quadIdx, -area.x, -area.y, outColor);
+	p->appendQuads(p->fill, quadIdx, fillOff - area.x, fillOff - area.y, color);
+
+	p->quads.commit();
+
+	/* Transparent pixels keep the color of the glyphs above them,
+	 * as they would in an SDL_ttf surface, so scaling the layer
+	 * doesn't darken the edges */
+	const Vec4 &base = hasOutline ? outColor : color;
+	TEXFBO &layer = p->layer->getGLTypes();
+
+	FBO::bind(layer.fbo);
+	glState.viewport.pushSet(IntRect(0, 0, layer.width, layer.height));
+	glState.clearColor.pushSet(Vec4(base.x, base.y, base.z, 0));
+
+	FBO::clear();
+
+	glState.clearColor.pop();
+
+	GlyphShader &shader = shState->shaders().glyph;
+	shader.bind();
+	shader.applyViewportProj();
+	shader.setTranslation(Vec2i());
+
+	glState.blend.pushSet(true);
+	glState.blendMode.pushSet(BlendNormal);
+
+	if (hasOutline)
+	{
+		p->drawLine(shader, p->outline, 0);
+
+		glState.scissorTest.pushSet(true);
+		glState.scissorBox.pushSet(IntRect(fillClip.x - area.x, fillClip.y - area.y,
+		                                   std::max(fillClip.w, 0), std::max(fillClip.h, 0)));
+	}
+
+	p->drawLine(shader, p->fill, outCount);
+
+	if (hasOutline)
+	{
+		glState.scissorBox.pop();
+		glState.scissorTest.pop();
+	}
+
+	glState.blendMode.pop();
+	glState.blend.pop();
+	glState.viewport.pop();
+
+	return p->layer;
+}
@@ -0,0 +1,74 @@
+/*
+** glyphatlas.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+#include "etc-internal.h"
+
+struct GlyphAtlasPrivate;
+struct _TTF_Font;
+class Bitmap;
+
+/* Size of a laid out line of text, matching the
+ * surfaces TTF_RenderUTF8_Blended would produce */
+struct GlyphRun
+{
+	int width, height;
+
+	/* Same with the font outline applied;
+	 * equal to the above without outline */
+	int outWidth, outHeight;
+};
+
+/* Keeps the glyphs of each (font, style, outline size) combination
+ * Bitmap#draw_text was called with in an atlas texture, together
+ * with their metrics and kerning, so text can be drawn as a batch
+ * of textured quads instead of being rendered by SDL_ttf every time.
+ *
+ * Glyphs are placed like SDL_ttf would place them; whenever a layout
+ * involves new glyphs or glyph pairs, it's checked against SDL_ttf's
+ * own measurement, and combinations that don't match (eg. because of
+ * shaping) are permanently left to the regular rendering path. */
+class GlyphAtlas
+{
+public:
+	GlyphAtlas();
+	~GlyphAtlas();
+
+	/* Lays out the UTF-8 string 'str' in 'font' (with its current
+	 * style), and with an outline of 'outline' pixels if non-zero.
+	 * Returns false if the text can't be drawn from the atlas */
+	bool layout(_TTF_Font *font, const char *str,
+	            int outline, GlyphRun &run);
+
+	/* Renders 'area' of the last laid out text into a scratch bitmap
+	 * (at its origin) and returns it, or null if it doesn't fit.
+	 * Coordinates are relative to the outline surface if there is
+	 * an outline; the fill is clipped to 'fillClip' in that case */
+	Bitmap *render(const IntRect &area, const IntRect &fillClip,
+	               const Vec4 &color, const Vec4 &outColor);
+
+private:
+	GlyphAtlasPrivate *p;
+};
+
+#endif // GLYPHATLAS_H
@@ -21,6 +21,10 @@
 
 #include "scene.h"
 #include "sharedstate.h"
+#include "spritebatch.h"
+#include "screendamage.h"
+
+bool ScreenDamage::damaged = true;
 
 Scene::Scene()
 {}
@@ -40,6 +44,8 @@ void Scene::insert(SceneElement &element)
 {
 	IntruListLink<SceneElement> *iter;
 
+	ScreenDamage::mark();
+
 	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
 		SceneElement *e = iter->data;
@@ -58,6 +64,8 @@ void Scene::insertAfter(SceneElement &element, SceneElement &after)
 {
 	IntruListLink<SceneElement> *iter;
 
+	ScreenDamage::mark();
+
 	for (iter = &after.link; iter != elements.end(); iter = iter->next)
 	{
 		SceneElement *e = iter->data;
@@ -82,6 +90,8 @@ void Scene::notifyGeometryChange()
 {
 	IntruListLink<SceneElement> *iter;
 
+	ScreenDamage::mark();
+
 	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
 		iter->data->onGeometryChange(geometry);
@@ -91,14 +101,25 @@ void Scene::notifyGeometryChange()
 void Scene::composite()
 {
 	IntruListLink<SceneElement> *iter;
+	SpriteBatch &batch = shState->spriteBatch();
 
 	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
 		SceneElement *e = iter->data;
 
-		if (e->visible)
-			e->draw();
+		if (!e->visible)
+			continue;
+
+		if (e->drawBatched(batch))
+			continue;
+
+		batch.flush();
+		e->draw();
 	}
+
+	/* Viewports post-process their contents
+	 * right after this, so nothing may linger */
+	batch.flush();
 }
 
 
@@ -158,7 +179,11 @@ void SceneElement::setVisible(bool value)
 {
 	aboutToAccess();
 
+	if (visible == value)
+		return;
+
 	visible = value;
+	ScreenDamage::mark();
 }
 
 bool SceneElement::operator<(const SceneElement &o) const
@@ -197,6 +222,9 @@ void SceneElement::setSpriteY(int value)
 
 void SceneElement::unlink()
 {
-	if (scene)
-		scene->elements.remove(link);
+	if (!scene)
+		return;
+
+	scene->elements.remove(link);
+	ScreenDamage::mark();
 }
@@ -33,6 +33,7 @@ class WindowVX;
 class Window;
 struct ScanRow;
 struct TilemapPrivate;
+struct SpriteBatch;
 
 class Scene
 {
@@ -112,6 +113,12 @@ protected:
 	 */
 	virtual void draw() = 0;
 
+	/* Elements that can be expressed as a single textured quad
+	 * may append themselves to 'batch' instead of drawing
+	 * immediately. Returns false if the element has to go
+	 * through 'draw()', in which case the batch is flushed first */
+	virtual bool drawBatched(SpriteBatch &) { return false; }
+
 	// FIXME: This should be a signal
 	virtual void onGeometryChange(const Scene::Geometry &) {}
 
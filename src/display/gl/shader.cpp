@@ -33,6 +33,7 @@
 #ifndef MKXPZ_BUILD_XCODE
 #include "common.h.xxd"
 #include "sprite.frag.xxd"
+#include "spriteBatch.frag.xxd"
 #include "hue.frag.xxd"
 #include "trans.frag.xxd"
 #include "transSimple.frag.xxd"
@@ -44,6 +45,7 @@
 #include "simpleColor.frag.xxd"
 #include "simpleAlpha.frag.xxd"
 #include "simpleAlphaUni.frag.xxd"
+#include "glyph.frag.xxd"
 #include "tilemap.frag.xxd"
 #include "flashMap.frag.xxd"
 #include "bicubic.frag.xxd"
@@ -52,6 +54,7 @@
 #include "simple.vert.xxd"
 #include "simpleColor.vert.xxd"
 #include "sprite.vert.xxd"
+#include "spriteBatch.vert.xxd"
 #include "tilemap.vert.xxd"
 #include "blur.frag.xxd"
 #include "simpleMatrix.vert.xxd"
@@ -222,6 +225,8 @@ void Shader::init(const unsigned char *vert, int vertSize,
 	gl.BindAttribLocation(program, Position, "position");
 	gl.BindAttribLocation(program, TexCoord, "texCoord");
 	gl.BindAttribLocation(program, Color, "color");
+	gl.BindAttribLocation(program, Tone, "tone");
+	gl.BindAttribLocation(program, Opacity, "opacity");
 
 	gl.LinkProgram(program);
 
@@ -368,6 +373,14 @@ SimpleAlphaShader::SimpleAlphaShader()
 }
 
 
+GlyphShader::GlyphShader()
+{
+	INIT_SHADER(simpleColor, glyph, GlyphShader);
+
+	ShaderBase::init();
+}
+
+
 SimpleSpriteShader::SimpleSpriteShader()
 {
 	INIT_SHADER(sprite, simple, SimpleSpriteShader);
@@ -565,6 +578,14 @@ void SpriteShader::setInvert(bool value)
 }
 
 
+SpriteBatchShader::SpriteBatchShader()
+{
+	INIT_SHADER(spriteBatch, spriteBatch, SpriteBatchShader);
+
+	ShaderBase::init();
+}
+
+
 PlaneShader::PlaneShader()
 {
 	INIT_SHADER(simple, plane, PlaneShader);
@@ -632,6 +653,9 @@ TilemapShader::TilemapShader()
 
 	GET_U(aniIndex);
 	GET_U(atFrames);
+
+	GET_U(ringOrigin);
+	GET_U(ringSize);
 }
 
 void TilemapShader::setTone(const Vec4 &tone)
@@ -659,6 +683,16 @@ void TilemapShader::setATFrames(int values[7])
 	gl.Uniform1iv(u_atFrames, 7, values);
 }
 
+void TilemapShader::setRingOrigin(const Vec2i &value)
+{
+	gl.Uniform2f(u_ringOrigin, value.x, value.y);
+}
+
+void TilemapShader::setRingSize(const Vec2i &value)
+{
+	gl.Uniform2f(u_ringSize, value.x, value.y);
+}
+
 
 
 FlashMapShader::FlashMapShader()
@@ -36,7 +36,9 @@ public:
 	{
 		Position = 0,
 		TexCoord = 1,
-		Color = 2
+		Color = 2,
+		Tone = 3,
+		Opacity = 4
 	};
     
     static std::string &commonHeader();
@@ -130,6 +132,13 @@ public:
 	SimpleAlphaShader();
 };
 
+/* Tints white glyphs with the vertex color, see GlyphAtlas */
+class GlyphShader : public ShaderBase
+{
+public:
+	GlyphShader();
+};
+
 class SimpleSpriteShader : public ShaderBase
 {
 public:
@@ -206,6 +215,14 @@ private:
     u_patternBlendType, u_patternSizeInv, u_patternTile, u_patternOpacity, u_patternScroll, u_patternZoom, u_invert;
 };
 
+/* Per-sprite tone/color/opacity are supplied
+ * as vertex attributes, see SpriteBatch */
+class SpriteBatchShader : public ShaderBase
+{
+public:
+	SpriteBatchShader();
+};
+
 class PlaneShader : public ShaderBase
 {
 public:
@@ -247,8 +264,11 @@ public:
 
 	void setATFrames(int values[7]);
 
+	void setRingOrigin(const Vec2i &value);
+	void setRingSize(const Vec2i &value);
+
 private:
-	GLint u_aniIndex, u_tone, u_color, u_opacity, u_atFrames;
+	GLint u_aniIndex, u_tone, u_color, u_opacity, u_atFrames, u_ringOrigin, u_ringSize;
 };
 
 class FlashMapShader : public ShaderBase
@@ -359,9 +379,11 @@ struct ShaderSet
 	SimpleShader simple;
 	SimpleColorShader simpleColor;
 	SimpleAlphaShader simpleAlpha;
+	GlyphShader glyph;
 	SimpleSpriteShader simpleSprite;
 	AlphaSpriteShader alphaSprite;
 	SpriteShader sprite;
+	SpriteBatchShader spriteBatch;
 	PlaneShader plane;
 	GrayShader gray;
 	TilemapShader tilemap;
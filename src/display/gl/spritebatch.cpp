@@ -0,0 +1,119 @@
+/*
+** spritebatch.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "spritebatch.h"
+
+#include "bitmap.h"
+#include "glstate.h"
+#include "global-ibo.h"
+#include "shader.h"
+#include "sharedstate.h"
+#include "util.h"
+
+/* Upper bound on quads per draw call; keeps the
+ * required index count within the 16 bit global IBO */
+#define BATCH_MAX_QUADS 4096
+
+SpriteBatch::SpriteBatch()
+    : bitmap(0),
+      blendType(BlendNormal),
+      quadCount(0)
+{
+	vertices.reserve(BATCH_MAX_QUADS * 4);
+
+	vbo = VBO::gen();
+
+	GLMeta::vaoFillInVertexData<BVertex>(vao);
+	vao.vbo = vbo;
+	vao.ibo = shState->globalIBO().ibo;
+
+	GLMeta::vaoInit(vao);
+}
+
+SpriteBatch::~SpriteBatch()
+{
+	GLMeta::vaoFini(vao);
+	VBO::del(vbo);
+}
+
+void SpriteBatch::append(Bitmap &bitmap, BlendType blendType,
+                         const Vertex *vert, const float *mat,
+                         float opacity, const Vec4 &color, const Vec4 &tone)
+{
+	if (quadCount > 0 &&
+	    (&bitmap != this->bitmap ||
+	     blendType != this->blendType ||
+	     quadCount == BATCH_MAX_QUADS))
+		flush();
+
+	this->bitmap = &bitmap;
+	this->blendType = blendType;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		const Vec2 &pos = vert[i].pos;
+		BVertex v;
+
+		v.pos.x = mat[0] * pos.x + mat[4] * pos.y + mat[12];
+		v.pos.y = mat[1] * pos.x + mat[5] * pos.y + mat[13];
+		v.texPos = vert[i].texPos;
+		v.color = color;
+		v.tone = tone;
+		v.opacity = opacity;
+
+		vertices.push_back(v);
+	}
+
+	++quadCount;
+}
+
+void SpriteBatch::flush()
+{
+	if (quadCount == 0)
+		return;
+
+	SpriteBatchShader &shader = shState->shaders().spriteBatch;
+	shader.bind();
+	shader.applyViewportProj();
+
+	glState.blendMode.pushSet(blendType);
+
+	bitmap->bindTex(shader);
+
+	/* Orphan the previous storage so the driver doesn't
+	 * have to sync with draws still in flight */
+	VBO::bind(vbo);
+	VBO::uploadData(vertices.size() * sizeof(BVertex),
+	                dataPtr(vertices), GL_STREAM_DRAW);
+	VBO::unbind();
+
+	shState->ensureQuadIBO(quadCount);
+
+	GLMeta::vaoBind(vao);
+	gl.DrawElements(GL_TRIANGLES, quadCount * 6, _GL_INDEX_TYPE, 0);
+	GLMeta::vaoUnbind(vao);
+
+	glState.blendMode.pop();
+
+	vertices.clear();
+	quadCount = 0;
+	bitmap = 0;
+}
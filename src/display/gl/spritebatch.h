@@ -0,0 +1,67 @@
+/*
+** spritebatch.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPRITEBATCH_H
+#define SPRITEBATCH_H
+
+#include "vertex.h"
+#include "gl-util.h"
+#include "gl-meta.h"
+#include "etc.h"
+
+#include <vector>
+
+class Bitmap;
+
+/* Collects consecutive sprite quads that share the same source
+ * bitmap and blend mode, and submits them with a single draw call.
+ * Vertex positions are transformed on the CPU, and the per-sprite
+ * color/tone/opacity travel as vertex attributes, so any run of
+ * effect-free (or color/tone-only) sprites can be merged.
+ *
+ * Scene::composite flushes the batch before drawing any element
+ * that can't be batched, which keeps the draw order intact. */
+struct SpriteBatch
+{
+	SpriteBatch();
+	~SpriteBatch();
+
+	/* 'vert' points to the four vertices of the sprite quad,
+	 * 'mat' is the sprite's (column-major) transform matrix */
+	void append(Bitmap &bitmap, BlendType blendType,
+	            const Vertex *vert, const float *mat,
+	            float opacity, const Vec4 &color, const Vec4 &tone);
+
+	/* Submits all pending quads; no-op if there are none */
+	void flush();
+
+private:
+	std::vector<BVertex> vertices;
+
+	VBO::ID vbo;
+	GLMeta::VAO vao;
+
+	Bitmap *bitmap;
+	BlendType blendType;
+	size_t quadCount;
+};
+
+#endif // SPRITEBATCH_H
@@ -23,107 +23,155 @@
 #include "exception.h"
 #include "sharedstate.h"
 #include "glstate.h"
-#include "boost-hash.h"
 #include "debugwriter.h"
+#include "boost-hash.h"
+#include "intrulist.h"
+#include "util.h"
 
-#include <list>
-#include <utility>
 #include <assert.h>
 #include <string.h>
 
-typedef std::pair<uint16_t, uint16_t> Size;
-
-static uint32_t byteCount(Size &s)
-{
-	return s.first * s.second * 4;
-}
-
 struct CacheNode
 {
 	TEXFBO obj;
-	std::list<TEXFBO>::iterator prioIter;
 
-	bool operator==(const CacheNode &o) const
-	{
-		return obj == o.obj;
-	}
+	/* Link in the pool-wide list, most recently released first */
+	IntruListLink<CacheNode> lruLink;
+
+	/* Link in the list of nodes with the same size */
+	IntruListLink<CacheNode> sizeLink;
+
+	/* Link in the list of nodes in the same size class */
+	IntruListLink<CacheNode> classLink;
+
+	CacheNode(const TEXFBO &obj)
+	    : obj(obj),
+	      lruLink(this),
+	      sizeLink(this),
+	      classLink(this)
+	{}
 };
 
-typedef std::list<CacheNode> CNodeList;
+typedef IntruList<CacheNode> NodeList;
 
-struct TexPoolPrivate
+static size_t byteCount(int width, int height)
 {
-	/* Contains all cached TexFBOs, grouped by size */
-	BoostHash<Size, CNodeList> poolHash;
+	return (size_t) width * height * 4;
+}
+
+static uint32_t sizeKey(int width, int height)
+{
+	return ((uint32_t) width << 16) | (uint32_t) height;
+}
 
+/* Textures whose dimensions round up to the same powers
+ * of two are in the same class, and can be recycled for
+ * one another if there's no exact match */
+static uint32_t classKey(int width, int height)
+{
+	return sizeKey(findNextPow2(width), findNextPow2(height));
+}
+
+struct TexPoolPrivate
+{
 	/* Contains all cached TexFBOs, sorted by release time */
-	std::list<TEXFBO> priorityQueue;
+	NodeList lru;
+
+	/* Contains all cached TexFBOs, grouped by size and size class.
+	 * Empty lists are dropped */
+	BoostHash<uint32_t, NodeList> sizeBuckets;
+	BoostHash<uint32_t, NodeList> classBuckets;
 
 	/* Maximal allowed cache memory */
-	const uint32_t maxMemSize;
+	const size_t maxMemSize;
 
 	/* Current amound of memory consumed by the cache */
-	uint32_t memSize;
-
-	/* Current amount of TexFBOs cached */
-	uint16_t objCount;
+	size_t memSize;
 
 	/* Has this pool been disabled? */
 	bool disabled;
 
-	TexPoolPrivate(uint32_t maxMemSize)
+	CacheStats stats;
+
+	TexPoolPrivate(size_t maxMemSize)
 	    : maxMemSize(maxMemSize),
 	      memSize(0),
-	      objCount(0),
 	      disabled(false)
 	{}
+
+	void link(CacheNode *node)
+	{
+		const TEXFBO &obj = node->obj;
+
+		lru.prepend(node->lruLink);
+		sizeBuckets[sizeKey(obj.width, obj.height)].prepend(node->sizeLink);
+		classBuckets[classKey(obj.width, obj.height)].prepend(node->classLink);
+
+		memSize += byteCount(obj.width, obj.height);
+		++stats.entries;
+	}
+
+	/* Unlinks and frees 'node', returning its TexFBO */
+	TEXFBO unlink(CacheNode *node)
+	{
+		TEXFBO obj = node->obj;
+
+		lru.remove(node->lruLink);
+
+		uint32_t key = sizeKey(obj.width, obj.height);
+		NodeList &sizeList = sizeBuckets[key];
+		sizeList.remove(node->sizeLink);
+
+		if (sizeList.isEmpty())
+			sizeBuckets.remove(key);
+
+		key = classKey(obj.width, obj.height);
+		NodeList &classList = classBuckets[key];
+		classList.remove(node->classLink);
+
+		if (classList.isEmpty())
+			classBuckets.remove(key);
+
+		memSize -= byteCount(obj.width, obj.height);
+		--stats.entries;
+
+		delete node;
+
+		return obj;
+	}
 };
 
-TexPool::TexPool(uint32_t maxMemSize)
+TexPool::TexPool(size_t maxMemSize)
 {
 	p = new TexPoolPrivate(maxMemSize);
 }
 
 TexPool::~TexPool()
 {
-	std::list<TEXFBO>::iterator iter;
-
-	for (iter = p->priorityQueue.begin();
-	     iter != p->priorityQueue.end();
-	     ++iter)
+	while (!p->lru.isEmpty())
 	{
-		TEXFBO obj = *iter;
+		TEXFBO obj = p->unlink(p->lru.tail());
 		TEXFBO::fini(obj);
-		--p->objCount;
 	}
 
-	assert(p->objCount == 0);
+	assert(p->stats.entries == 0);
 
 	delete p;
 }
 
 TEXFBO TexPool::request(int width, int height)
 {
-	CacheNode cnode;
-	Size size(width, height);
-
 	/* See if we can statisfy request from cache */
-	CNodeList &bucket = p->poolHash[size];
+	uint32_t key = sizeKey(width, height);
 
-	if (!bucket.empty())
+	if (p->sizeBuckets.contains(key))
 	{
 		/* Found one! */
-		cnode = bucket.back();
-		bucket.pop_back();
-
-		p->priorityQueue.erase(cnode.prioIter);
-
-		p->memSize -= byteCount(size);
-		--p->objCount;
+		++p->stats.hits;
 
 //		Debug() << "TexPool: <?+> (" << width << height << ")";
 
-		return cnode.obj;
+		return p->unlink(p->sizeBuckets[key].begin()->data);
 	}
 
 	int maxSize = glState.caps.maxTexSize;
@@ -132,14 +180,35 @@ TEXFBO TexPool::request(int width, int height)
 		                "Texture dimensions [%d, %d] exceed hardware capabilities",
 		                width, height);
 
+	key = classKey(width, height);
+
+	if (p->classBuckets.contains(key))
+	{
+		/* Close enough; reuse its texture and framebuffer
+		 * objects, only the storage has to be respecified.
+		 * Handing out the larger texture as is isn't an option,
+		 * as TexFBO sizes double as texture coordinate bases */
+		++p->stats.hits;
+
+		TEXFBO obj = p->unlink(p->classBuckets[key].begin()->data);
+		TEXFBO::allocEmpty(obj, width, height);
+
+//		Debug() << "TexPool: <?~> (" << width << height << ")";
+
+		return obj;
+	}
+
 	/* Nope, create it instead */
-	TEXFBO::init(cnode.obj);
-	TEXFBO::allocEmpty(cnode.obj, width, height);
-	TEXFBO::linkFBO(cnode.obj);
+	++p->stats.misses;
+
+	TEXFBO obj;
+	TEXFBO::init(obj);
+	TEXFBO::allocEmpty(obj, width, height);
+	TEXFBO::linkFBO(obj);
 
 //	Debug() << "TexPool: <?-> (" << width << height << ")";
 
-	return cnode.obj;
+	return obj;
 }
 
 void TexPool::release(TEXFBO &obj)
@@ -158,52 +227,26 @@ void TexPool::release(TEXFBO &obj)
 		return;
 	}
 
-	Size size(obj.width, obj.height);
-
-	uint32_t newMemSize = p->memSize + byteCount(size);
+	size_t newMemSize = p->memSize + byteCount(obj.width, obj.height);
 
 	/* If caching this object would spill over the allowed memory budget,
 	 * delete least used objects until we're good again */
-	while (newMemSize > p->maxMemSize)
+	while (newMemSize > p->maxMemSize && !p->lru.isEmpty())
 	{
-		if (p->objCount == 0)
-			break;
-
-//		Debug() << "TexPool: <!~> Size:" << p->memSize;
-
-		/* Retrieve object with lowest priority for deletion */
-		CacheNode last;
-		last.obj = p->priorityQueue.back();
-		Size removedSize(last.obj.width, last.obj.height);
+		CacheNode *tail = p->lru.tail();
+		size_t removedSize = byteCount(tail->obj.width, tail->obj.height);
 
-		CNodeList &bucket = p->poolHash[removedSize];
+		TEXFBO last = p->unlink(tail);
+		TEXFBO::fini(last);
 
-		std::list<CacheNode>::iterator toRemove =
-		        std::find(bucket.begin(), bucket.end(), last);
-		assert(toRemove != bucket.end());
-		bucket.erase(toRemove);
+		newMemSize -= removedSize;
+		++p->stats.evictions;
 
-		p->priorityQueue.pop_back();
-
-		TEXFBO::fini(last.obj);
-
-		newMemSize -= byteCount(removedSize);
-		--p->objCount;
-
-//		Debug() << "TexPool: <!-> (" << last.obj.width << last.obj.height << ")";
+//		Debug() << "TexPool: <!-> (" << last.width << last.height << ")";
 	}
 
-	p->memSize = newMemSize;
-
 	/* Retain object */
-	p->priorityQueue.push_front(obj);
-	CacheNode cnode;
-	cnode.obj = obj;
-	cnode.prioIter = p->priorityQueue.begin();
-	CNodeList &bucket = p->poolHash[size];
-	bucket.push_back(cnode);
-
-	++p->objCount;
+	p->link(new CacheNode(obj));
 
 //	Debug() << "TexPool: <!+> (" << obj.width << obj.height << ") Current size:" << p->memSize;
 }
@@ -213,4 +256,7 @@ void TexPool::disable()
 	p->disabled = true;
 }
 
-
+const CacheStats &TexPool::stats() const
+{
+	return p->stats;
+}
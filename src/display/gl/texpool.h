@@ -23,13 +23,16 @@
 #define TEXPOOL_H
 
 #include "gl-util.h"
+#include "cachestats.h"
+
+#include <stddef.h>
 
 struct TexPoolPrivate;
 
 class TexPool
 {
 public:
-	TexPool(uint32_t maxMemSize = 20000000 /* 20 MB */);
+	TexPool(size_t maxMemSize = 20000000 /* 20 MB */);
 	~TexPool();
 
 	TEXFBO request(int width, int height);
@@ -37,6 +40,8 @@ public:
 
 	void disable();
 
+	const CacheStats &stats() const;
+
 private:
 	TexPoolPrivate *p;
 };
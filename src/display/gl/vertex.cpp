@@ -53,6 +53,15 @@ static const VertexAttribute VertexAttribs[] =
 	{ Shader::TexCoord, 2, GL_FLOAT, o(Vertex, texPos) }
 };
 
+static const VertexAttribute BVertexAttribs[] =
+{
+	{ Shader::Color,    4, GL_FLOAT, o(BVertex, color)   },
+	{ Shader::Tone,     4, GL_FLOAT, o(BVertex, tone)    },
+	{ Shader::Opacity,  1, GL_FLOAT, o(BVertex, opacity) },
+	{ Shader::Position, 2, GL_FLOAT, o(BVertex, pos)     },
+	{ Shader::TexCoord, 2, GL_FLOAT, o(BVertex, texPos)  }
+};
+
 #define DEF_TRAITS(VertType) \
 	template<> \
 	const VertexAttribute *VertexTraits<VertType>::attr = VertType##Attribs; \
@@ -62,3 +71,4 @@ static const VertexAttribute VertexAttribs[] =
 DEF_TRAITS(SVertex);
 DEF_TRAITS(CVertex);
 DEF_TRAITS(Vertex);
+DEF_TRAITS(BVertex);
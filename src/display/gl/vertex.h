@@ -51,6 +51,18 @@ struct Vertex
 	Vertex();
 };
 
+/* Batched sprite vertex; carries the sprite's
+ * effect parameters so that several sprites can
+ * be drawn with one call */
+struct BVertex
+{
+	Vec2 pos;
+	Vec2 texPos;
+	Vec4 color;
+	Vec4 tone;
+	float opacity;
+};
+
 struct VertexAttribute
 {
 	Shader::Attribute index;
@@ -25,13 +25,18 @@
 #include "audio.h"
 #include "binding.h"
 #include "bitmap.h"
+#include "bitmaploader.h"
 #include "config.h"
 #include "debugwriter.h"
 #include "disposable.h"
 #include "etc.h"
 #include "etc-internal.h"
 #include "eventthread.h"
+#include "exception.h"
 #include "filesystem.h"
+#include "frameprofiler.h"
+#include "imagewriter.h"
+#include "screendamage.h"
 #include "gl-fun.h"
 #include "gl-util.h"
 #include "glstate.h"
@@ -486,6 +491,8 @@ struct PingPong {
         }
         
         glState.clearColor.pop();
+        
+        ScreenDamage::mark();
     }
     
 private:
@@ -502,6 +509,8 @@ public:
     }
     
     void composite() {
+        ProfileScope profile(ProfComposite);
+        
         const int w = geometry.rect.w;
         const int h = geometry.rect.h;
         
@@ -630,6 +639,7 @@ public:
         brightnessQuad.setColor(Vec4(0, 0, 0, 1.0f - norm));
         
         brightEffect = norm < 1.0f;
+        ScreenDamage::mark();
     }
     
     void updateReso(int width, int height) {
@@ -824,6 +834,13 @@ struct GraphicsPrivate {
     double last_avg_update;
     SDL_mutex *avgFPSLock;
     
+    bool profilerOverlay;
+    
+    /* Set while the window shows the last composited frame
+     * as is; cleared by any other buffer swap or anything
+     * that changes how the frame is scaled to the window */
+    bool framePresented;
+    
     SDL_mutex *glResourceLock;
     bool multithreadedMode;
     
@@ -840,7 +857,8 @@ struct GraphicsPrivate {
     fpsLimiter(frameRate), useFrameSkip(rtData->config.frameSkip), frozen(false),
     last_update(0), last_avg_update(0), backingScaleFactor(1), integerScaleFactor(0, 0),
     integerScaleActive(rtData->config.integerScaling.active),
-    integerLastMileScaling(rtData->config.integerScaling.lastMileScaling) {
+    integerLastMileScaling(rtData->config.integerScaling.lastMileScaling),
+    profilerOverlay(rtData->config.frameProfilerOverlay), framePresented(false) {
         avgFPSData = std::vector<double>();
         avgFPSLock = SDL_CreateMutex();
         glResourceLock = SDL_CreateMutex();
@@ -978,6 +996,8 @@ struct GraphicsPrivate {
             
             SDL_Rect screen = {scOffset.x, scOffset.y, scSize.x, scSize.y};
             threadData->ethread->notifyGameScreenChange(screen);
+            
+            framePresented = false;
         }
     }
     
@@ -994,12 +1014,142 @@ struct GraphicsPrivate {
     }
     
     void swapGLBuffer() {
-        fpsLimiter.delay();
-        SDL_GL_SwapWindow(threadData->window);
+        {
+            ProfileScope profile(ProfFrameDelay);
+            fpsLimiter.delay();
+        }
+        /* Transitions and frozen frames still end up
+         * here in headless mode; there's no one to show
+         * them to either */
+        if (!threadData->config.headless.enabled) {
+            /* Drawn over the window only, so it never ends
+             * up in screenshots, snapshots or transitions */
+            if (profilerOverlay)
+                drawProfilerOverlay();
+            
+            ProfileScope profile(ProfSwap);
+            SDL_GL_SwapWindow(threadData->window);
+        }
         
         ++frameCount;
+        framePresented = false;
         
         threadData->ethread->notifyFrame();
+        FrameProfiler::endFrame();
+    }
+    
+    /* Headless mode has nothing to present to; the
+     * frame is left in the PP front buffer, and
+     * dumped to disk every so often */
+    void finishHeadlessFrame() {
+        const Config &conf = threadData->config;
+        
+        if (!conf.headless.frameDumpDir.empty() &&
+            frameCount % conf.headless.frameDumpInterval == 0)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "/frame_%06d.png", frameCount);
+            std::string path = conf.headless.frameDumpDir + name;
+            
+            try {
+                Bitmap snap(screen.getPP().frontBuffer());
+                snap.saveToFile(path.c_str());
+            } catch (const Exception &e) {
+                Debug() << "Failed to dump frame:" << e.msg;
+            }
+        }
+        
+        skipFrame();
+        recordFrameTime();
+    }
+    
+    /* Paces a frame without presenting anything */
+    void skipFrame() {
+        {
+            ProfileScope profile(ProfFrameDelay);
+            fpsLimiter.delay();
+        }
+        
+        ++frameCount;
+        
+        threadData->ethread->notifyFrame();
+        FrameProfiler::endFrame();
+    }
+    
+    /* Whether the window can keep showing the previous
+     * frame instead of presenting it again */
+    bool canSkipPresent() const {
+        const Config &conf = threadData->config;
+        
+        if (conf.skipUnchangedFrames < 2 || !framePresented || profilerOverlay ||
+            conf.headless.enabled)
+            return false;
+        
+        /* Without vsync or the frame rate limiter, the
+         * buffer swap is all that paces the game */
+        return !conf.vsync && !fpsLimiter.disabled;
+    }
+    
+    /* Stacked bar graph of the most recent frame times in the
+     * bottom left corner of the game area of the window */
+    void drawProfilerOverlay() {
+        static const Vec4 sectionColors[ProfSectionCount] = {
+            Vec4(0.20f, 0.60f, 1.00f, 1), // script
+            Vec4(0.30f, 0.85f, 0.30f, 1), // composite
+            Vec4(0.95f, 0.85f, 0.20f, 1), // tilemap_prepare
+            Vec4(0.90f, 0.30f, 0.90f, 1), // draw_text
+            Vec4(0.45f, 0.45f, 0.45f, 1), // frame_delay
+            Vec4(1.00f, 0.40f, 0.20f, 1)  // swap
+        };
+        
+        const int barWidth = 2;
+        const float pxPerMs = 2.0f;
+        const int maxBars = std::min(150, (scSize.x - 8) / barWidth);
+        /* The window framebuffer's origin is its bottom left */
+        const IntRect area(scOffset.x + 4, scOffset.y + 4, maxBars * barWidth, 80);
+        
+        if (maxBars <= 0 || scSize.y < area.h + 8)
+            return;
+        
+        const size_t count = FrameProfiler::frameCount();
+        const size_t shown = std::min<size_t>(count, maxBars);
+        const int top = area.y + area.h;
+        
+        FBO::unbind();
+        glState.viewport.pushSet(IntRect(0, 0, winSize.x, winSize.y));
+        glState.scissorTest.pushSet(true);
+        glState.scissorBox.pushSet(area);
+        glState.clearColor.pushSet(Vec4(0, 0, 0, 1));
+        
+        FBO::clear();
+        
+        for (size_t i = 0; i < shown; ++i) {
+            const FrameStats &stats = FrameProfiler::frame(count - shown + i);
+            int y = area.y;
+            
+            for (int s = 0; s < ProfSectionCount && y < top; ++s) {
+                int h = std::min((int) lround(stats.sections[s] * pxPerMs), top - y);
+                
+                if (h <= 0)
+                    continue;
+                
+                glState.scissorBox.set(IntRect(area.x + i * barWidth, y, barWidth, h));
+                glState.clearColor.set(sectionColors[s]);
+                FBO::clear();
+                
+                y += h;
+            }
+        }
+        
+        /* 60 FPS frame budget */
+        glState.scissorBox.set(IntRect(area.x, area.y + (int) lround(1000.0 / 60 * pxPerMs), area.w, 1));
+        glState.clearColor.set(Vec4(1, 1, 1, 1));
+        FBO::clear();
+        
+        glState.clearColor.pop();
+        glState.scissorBox.pop();
+        glState.scissorTest.pop();
+        glState.viewport.pop();
     }
     
     void compositeToBuffer(TEXFBO &buffer) {
@@ -1033,7 +1183,24 @@ struct GraphicsPrivate {
     }
     
     void redrawScreen() {
-        screen.composite();
+        /* If nothing changed, the last composited frame
+         * is still sitting in the PP front buffer */
+        const bool damaged = ScreenDamage::consume() ||
+            threadData->config.skipUnchangedFrames == 0;
+        
+        if (!damaged && canSkipPresent()) {
+            skipFrame();
+            recordFrameTime();
+            return;
+        }
+        
+        if (damaged)
+            screen.composite();
+        
+        if (threadData->config.headless.enabled) {
+            finishHeadlessFrame();
+            return;
+        }
         
         // maybe unspaghetti this later
         if (integerScaleStepApplicable() && !integerLastMileScaling)
@@ -1046,6 +1213,7 @@ struct GraphicsPrivate {
             GLMeta::blitEnd();
             
             swapGLBuffer();
+            framePresented = true;
             return;
         }
         
@@ -1084,7 +1252,11 @@ struct GraphicsPrivate {
         GLMeta::blitEnd();
         
         swapGLBuffer();
-        
+        framePresented = true;
+        recordFrameTime();
+    }
+    
+    void recordFrameTime() {
         SDL_LockMutex(avgFPSLock);
         if (avgFPSData.size() > 40)
             avgFPSData.erase(avgFPSData.begin());
@@ -1144,6 +1316,12 @@ Graphics::Graphics(RGSSThreadData *data) {
     } else if (data->config.fixedFramerate < 0) {
         p->fpsLimiter.disabled = true;
     }
+    
+    /* Run as fast as possible unless asked otherwise */
+    if (data->config.headless.enabled && !data->config.headless.frameLimit)
+        p->fpsLimiter.disabled = true;
+    
+    FrameProfiler::setEnabled(data->config.frameProfiler || p->profilerOverlay);
 }
 
 Graphics::~Graphics() { delete p; }
@@ -1174,6 +1352,8 @@ void Graphics::update(bool checkForShutdown) {
     
     p->checkSyncLock();
     
+    /* Pick up finished Bitmap#to_file_async readbacks */
+    shState->imageWriter().update();
     
 #ifdef MKXPZ_STEAM
     if (STEAMSHIM_alive())
@@ -1186,9 +1366,7 @@ void Graphics::update(bool checkForShutdown) {
     if (p->fpsLimiter.frameSkipRequired()) {
         if (p->useFrameSkip) {
             /* Skip frame */
-            p->fpsLimiter.delay();
-            ++p->frameCount;
-            p->threadData->ethread->notifyFrame();
+            p->skipFrame();
             
             return;
         } else {
@@ -1218,6 +1396,11 @@ void Graphics::transition(int duration, const char *filename, int vague) {
         return;
     
     vague = clamp(vague, 1, 256);
+    
+    /* Finish decoding whatever the new scene prefetched,
+     * so the transition itself doesn't hitch on it */
+    shState->bitmapLoader().waitAll();
+    
     Bitmap *transMap = *filename ? new Bitmap(filename) : 0;
     
     setBrightness(255);
@@ -1544,6 +1727,19 @@ void Graphics::screenshot(const char *filename) {
     delete ss;
 }
 
+int Graphics::screenshotAsync(const char *filename) {
+    p->threadData->rqWindowAdjust.wait();
+    Bitmap *ss = snapToBitmap();
+    
+    /* The readback is already queued when the
+     * snapshot's texture goes back to the pool */
+    int handle = ss->saveToFileAsync(filename);
+    ss->dispose();
+    delete ss;
+    
+    return handle;
+}
+
 DEF_ATTR_RD_SIMPLE(Graphics, Brightness, int, p->brightness)
 
 void Graphics::setBrightness(int value) {
@@ -1567,6 +1763,9 @@ void Graphics::reset() {
     
     p->dispList.clear();
     
+    /* Whatever the old game prefetched is of no use anymore */
+    shState->bitmapLoader().releaseAll();
+    
     /* Reset attributes (frame count not included) */
     p->fpsLimiter.resetFrameAdjust();
     p->frozen = false;
@@ -1614,6 +1813,7 @@ void Graphics::setFixedAspectRatio(bool value)
     p->findHighestIntegerScale();
     p->recalculateScreenSize(p->threadData->config.fixedAspectRatio);
     p->updateScreenResoRatio(p->threadData);
+    p->framePresented = false;
 }
 
 int Graphics::getSmoothScaling() const
@@ -1625,6 +1825,7 @@ int Graphics::getSmoothScaling() const
 void Graphics::setSmoothScaling(int value)
 {
     shState->config().smoothScaling = value;
+    p->framePresented = false;
 }
 
 bool Graphics::getIntegerScaling() const
@@ -1640,6 +1841,7 @@ void Graphics::setIntegerScaling(bool value)
     
     p->recalculateScreenSize(p->threadData->config.fixedAspectRatio);
     p->updateScreenResoRatio(p->threadData);
+    p->framePresented = false;
 }
 
 bool Graphics::getLastMileScaling() const
@@ -1652,6 +1854,7 @@ void Graphics::setLastMileScaling(bool value)
     p->integerLastMileScaling = value;
     p->recalculateScreenSize(p->threadData->config.fixedAspectRatio);
     p->updateScreenResoRatio(p->threadData);
+    p->framePresented = false;
 }
 
 bool Graphics::getThreadsafe() const
@@ -1664,6 +1867,44 @@ void Graphics::setThreadsafe(bool value)
     p->multithreadedMode = value;
 }
 
+bool Graphics::getFrameProfiler() const
+{
+    return FrameProfiler::enabled;
+}
+
+void Graphics::setFrameProfiler(bool value)
+{
+    FrameProfiler::setEnabled(value);
+    
+    if (!value && p->profilerOverlay) {
+        p->profilerOverlay = false;
+        
+        /* Present again, so the window stops showing it */
+        ScreenDamage::mark();
+    }
+}
+
+bool Graphics::getFrameProfilerOverlay() const
+{
+    return p->profilerOverlay;
+}
+
+void Graphics::setFrameProfilerOverlay(bool value)
+{
+    /* The overlay has nothing to show otherwise */
+    if (value)
+        FrameProfiler::setEnabled(true);
+    else if (p->profilerOverlay)
+        ScreenDamage::mark();
+    
+    p->profilerOverlay = value;
+}
+
+void Graphics::dumpFrameTrace(const char *filename)
+{
+    FrameProfiler::dumpTrace(filename);
+}
+
 double Graphics::getScale() const {
     p->checkResize();
     return (double)(p->winSize.y / p->backingScaleFactor) / p->scRes.y;
@@ -1713,6 +1954,8 @@ void Graphics::repaintWait(const AtomicFlag &exitCond, bool checkReset) {
     }
     
     GLMeta::blitEnd();
+    
+    p->framePresented = false;
 }
 
 void Graphics::lock(bool force) {
@@ -71,6 +71,8 @@ public:
 	bool updateMovieInput(Movie *movie);
 	void playMovie(const char *filename, int volume, bool skippable);
 	void screenshot(const char *filename);
+	/* Returns a handle for ImageWriter::finished() */
+	int screenshotAsync(const char *filename);
 
 	void reset();
     void center();
@@ -85,7 +87,10 @@ public:
     DECL_ATTR( IntegerScaling, bool )
     DECL_ATTR( LastMileScaling, bool )
     DECL_ATTR( Threadsafe, bool )
+    DECL_ATTR( FrameProfiler, bool )
+    DECL_ATTR( FrameProfilerOverlay, bool )
     double averageFrameRate();
+    void dumpFrameTrace(const char *filename);
 
 	/* <internal> */
 	Scene *getScreen() const;
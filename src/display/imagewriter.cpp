@@ -0,0 +1,240 @@
+/*
+** imagewriter.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagewriter.h"
+
+#include "gl-fun.h"
+#include "writequeue.h"
+#include "exception.h"
+
+#include <SDL_image.h>
+
+#include <deque>
+#include <string.h>
+#include <ctype.h>
+
+struct ImageJob : QueuedJob
+{
+	std::string path;
+
+	/* Pixel buffer and fence of the readback in flight */
+	GLuint pbo;
+	_GLsync fence;
+
+	/* Set once the pixels are in CPU memory */
+	SDL_Surface *surface;
+
+	ImageJob(const std::string &path)
+	    : path(path),
+	      pbo(0),
+	      fence(0),
+	      surface(0)
+	{}
+
+	~ImageJob()
+	{
+		SDL_FreeSurface(surface);
+	}
+
+	void run()
+	{
+		if (!failed && ImageWriter::writeFile(surface, path.c_str()) != 0)
+		{
+			failed = true;
+			error = "Failed to save " + path + ": " + SDL_GetError();
+		}
+
+		SDL_FreeSurface(surface);
+		surface = 0;
+	}
+};
+
+struct ImageWriterPrivate
+{
+	WriteQueue queue;
+
+	/* Readbacks in flight, oldest first (GL thread only) */
+	std::deque<ImageJob*> readbacks;
+
+	ImageWriterPrivate()
+	    : queue("imagewrite")
+	{}
+
+	static SDL_Surface *createSurface(int width, int height)
+	{
+		SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32,
+		                                                   SDL_PIXELFORMAT_ABGR8888);
+
+		if (!surf)
+			throw Exception(Exception::SDLError, "Failed to prepare image for saving: %s",
+			                SDL_GetError());
+
+		return surf;
+	}
+
+	/* Maps the pixel buffer of a finished
+	 * (or if need be, unfinished) readback */
+	void finishReadback(ImageJob *job)
+	{
+		const size_t size = job->surface->w * job->surface->h * 4;
+
+		gl.BindBuffer(GL_PIXEL_PACK_BUFFER, job->pbo);
+		void *pixels = gl.MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+		if (pixels)
+		{
+			memcpy(job->surface->pixels, pixels, size);
+			gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		else
+		{
+			job->failed = true;
+			job->error = "Failed to read back image for saving";
+		}
+
+		gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		gl.DeleteBuffers(1, &job->pbo);
+		gl.DeleteSync(job->fence);
+
+		queue.enqueue(job);
+	}
+};
+
+ImageWriter::ImageWriter()
+{
+	p = new ImageWriterPrivate;
+}
+
+ImageWriter::~ImageWriter()
+{
+	waitAll();
+
+	delete p;
+}
+
+int ImageWriter::save(FBO::ID fbo, int width, int height, const std::string &path)
+{
+	SDL_Surface *surf = ImageWriterPrivate::createSurface(width, height);
+	ImageJob *job = new ImageJob(path);
+	job->surface = surf;
+
+	int handle = p->queue.add(job);
+
+	FBO::bind(fbo);
+
+	if (!gl.FenceSync)
+	{
+		gl.ReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, surf->pixels);
+		p->queue.enqueue(job);
+
+		return handle;
+	}
+
+	/* Into the pixel buffer; this returns without waiting */
+	gl.GenBuffers(1, &job->pbo);
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, job->pbo);
+	gl.BufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, 0, GL_STREAM_READ);
+	gl.ReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	job->fence = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	p->readbacks.push_back(job);
+
+	return handle;
+}
+
+int ImageWriter::save(SDL_Surface *surf, const std::string &path)
+{
+	SDL_Surface *copy = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ABGR8888, 0);
+
+	if (!copy)
+		throw Exception(Exception::SDLError, "Failed to prepare image for saving: %s",
+		                SDL_GetError());
+
+	ImageJob *job = new ImageJob(path);
+	job->surface = copy;
+
+	int handle = p->queue.add(job);
+	p->queue.enqueue(job);
+
+	return handle;
+}
+
+void ImageWriter::update()
+{
+	while (!p->readbacks.empty())
+	{
+		ImageJob *job = p->readbacks.front();
+
+		/* Later readbacks can't be done before this one */
+		if (gl.ClientWaitSync(job->fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			break;
+
+		p->readbacks.pop_front();
+		p->finishReadback(job);
+	}
+}
+
+bool ImageWriter::finished(int handle)
+{
+	update();
+
+	bool failed;
+	std::string error;
+
+	if (!p->queue.finished(handle, failed, error))
+		return false;
+
+	if (failed)
+		throw Exception(Exception::SDLError, "%s", error.c_str());
+
+	return true;
+}
+
+void ImageWriter::waitAll()
+{
+	while (!p->readbacks.empty())
+	{
+		p->finishReadback(p->readbacks.front());
+		p->readbacks.pop_front();
+	}
+
+	p->queue.waitAll();
+}
+
+int ImageWriter::writeFile(SDL_Surface *surf, const char *path)
+{
+	/* Try and determine the intended image format from the filename extension */
+	std::string ext;
+	const char *period = strrchr(path, '.');
+
+	if (period)
+		for (const char *c = period+1; *c; ++c)
+			ext += tolower(*c);
+
+	if (ext == "png")
+		return IMG_SavePNG(surf, path);
+
+	if (ext == "jpg" || ext == "jpeg")
+		return IMG_SaveJPG(surf, path, 90);
+
+	return SDL_SaveBMP(surf, path);
+}
@@ -0,0 +1,74 @@
+/*
+** imagewriter.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include "gl-util.h"
+
+#include <string>
+
+struct SDL_Surface;
+struct ImageWriterPrivate;
+
+/* Saves images to disk without stalling the calling (GL) thread.
+ * Pixels are read back into a pixel buffer object, and only
+ * mapped once the GPU is done with it (GL 3.2 / GLES 3.0 and up;
+ * older contexts read back synchronously). Encoding and writing
+ * the file then happens on a worker thread.
+ * Every save is identified by a handle to poll for its result */
+class ImageWriter
+{
+public:
+	ImageWriter();
+	~ImageWriter();
+
+	/* Saves the contents of 'fbo' (width * height pixels) to
+	 * 'path', which has to be a resolved file system path */
+	int save(FBO::ID fbo, int width, int height, const std::string &path);
+
+	/* Saves a copy of 'surf' to 'path' */
+	int save(SDL_Surface *surf, const std::string &path);
+
+	/* Hands finished readbacks over to the worker.
+	 * Called once per frame, from the GL thread */
+	void update();
+
+	/* Returns false while 'handle' is still being saved. Once it's
+	 * done, returns true (or throws if saving failed) and forgets
+	 * about the handle; unknown handles count as done. Only the
+	 * results of the latest saves are kept until polled, older
+	 * ones are forgotten (and failures logged) */
+	bool finished(int handle);
+
+	/* Blocks until every save is written */
+	void waitAll();
+
+	/* Encodes 'surf' into 'path', picking the format from its
+	 * extension (png, jpg/jpeg, anything else is bmp). Thread safe;
+	 * returns non-zero on failure, with SDL_GetError() set */
+	static int writeFile(SDL_Surface *surf, const char *path);
+
+private:
+	ImageWriterPrivate *p;
+};
+
+#endif // IMAGEWRITER_H
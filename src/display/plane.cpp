@@ -33,6 +33,7 @@
 #include "etc-internal.h"
 #include "shader.h"
 #include "glstate.h"
+#include "screendamage.h"
 
 #include "sigslot/signal.hpp"
 
@@ -161,9 +162,9 @@ DEF_ATTR_RD_SIMPLE(Plane, ZoomX,     float,   p->zoomX)
 DEF_ATTR_RD_SIMPLE(Plane, ZoomY,     float,   p->zoomY)
 DEF_ATTR_RD_SIMPLE(Plane, BlendType, int,     p->blendType)
 
-DEF_ATTR_SIMPLE(Plane, Opacity,   int,     p->opacity)
-DEF_ATTR_SIMPLE(Plane, Color,     Color&, *p->color)
-DEF_ATTR_SIMPLE(Plane, Tone,      Tone&,  *p->tone)
+DEF_ATTR_SIMPLE_DAMAGE(Plane, Opacity,   int,     p->opacity)
+DEF_ATTR_SIMPLE_DAMAGE(Plane, Color,     Color&, *p->color)
+DEF_ATTR_SIMPLE_DAMAGE(Plane, Tone,      Tone&,  *p->tone)
 
 Plane::~Plane()
 {
@@ -174,6 +175,8 @@ void Plane::setBitmap(Bitmap *value)
 {
 	guardDisposed();
 
+	ScreenDamage::mark();
+
 	p->bitmap = value;
 
 	if (!value)
@@ -189,6 +192,8 @@ void Plane::setOX(int value)
 	if (p->ox == value)
 	        return;
 
+	ScreenDamage::mark();
+
 	p->ox = value;
 	p->quadSourceDirty = true;
 }
@@ -200,6 +205,8 @@ void Plane::setOY(int value)
 	if (p->oy == value)
 	        return;
 
+	ScreenDamage::mark();
+
 	p->oy = value;
 	p->quadSourceDirty = true;
 }
@@ -211,6 +218,8 @@ void Plane::setZoomX(float value)
 	if (p->zoomX == value)
 	        return;
 
+	ScreenDamage::mark();
+
 	p->zoomX = value;
 	p->quadSourceDirty = true;
 }
@@ -222,6 +231,8 @@ void Plane::setZoomY(float value)
 	if (p->zoomY == value)
 	        return;
 
+	ScreenDamage::mark();
+
 	p->zoomY = value;
 	p->quadSourceDirty = true;
 }
@@ -230,6 +241,8 @@ void Plane::setBlendType(int value)
 {
 	guardDisposed();
 
+	ScreenDamage::mark();
+
 	switch (value)
 	{
 	default :
@@ -0,0 +1,58 @@
+/*
+** screendamage.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCREENDAMAGE_H
+#define SCREENDAMAGE_H
+
+/* Tracks whether anything that might change the composited
+ * screen happened since it was last composited (element
+ * attributes, bitmap contents, animations etc.). When it
+ * didn't, Graphics reuses the previous frame instead of
+ * drawing the whole scene again.
+ * Erring on the side of marking too much is harmless;
+ * missing a change leaves a stale frame on screen */
+struct ScreenDamage
+{
+	static bool damaged;
+
+	static void mark() { damaged = true; }
+
+	/* Returns whether the screen was damaged, and resets it */
+	static bool consume()
+	{
+		bool value = damaged;
+		damaged = false;
+
+		return value;
+	}
+};
+
+/* Like DEF_ATTR_SIMPLE, for attributes that affect the screen */
+#define DEF_ATTR_SIMPLE_DAMAGE(klass, name, type, location) \
+	DEF_ATTR_RD_SIMPLE(klass, name, type, location) \
+	void klass :: set##name(type value) \
+	{ \
+		guardDisposed(); \
+		location = value; \
+		ScreenDamage::mark(); \
+	}
+
+#endif // SCREENDAMAGE_H
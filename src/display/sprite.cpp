@@ -34,6 +34,8 @@
 #include "shader.h"
 #include "glstate.h"
 #include "quadarray.h"
+#include "spritebatch.h"
+#include "screendamage.h"
 
 #include <math.h>
 #ifndef M_PI
@@ -350,18 +352,18 @@ DEF_ATTR_RD_SIMPLE(Sprite, WaveLength, int,     p->wave.length)
 DEF_ATTR_RD_SIMPLE(Sprite, WaveSpeed,  int,     p->wave.speed)
 DEF_ATTR_RD_SIMPLE(Sprite, WavePhase,  float,   p->wave.phase)
 
-DEF_ATTR_SIMPLE(Sprite, BushOpacity, int,     p->bushOpacity)
-DEF_ATTR_SIMPLE(Sprite, Opacity,     int,     p->opacity)
-DEF_ATTR_SIMPLE(Sprite, SrcRect,     Rect&,  *p->srcRect)
-DEF_ATTR_SIMPLE(Sprite, Color,       Color&, *p->color)
-DEF_ATTR_SIMPLE(Sprite, Tone,        Tone&,  *p->tone)
-DEF_ATTR_SIMPLE(Sprite, PatternTile, bool, p->patternTile)
-DEF_ATTR_SIMPLE(Sprite, PatternOpacity, int, p->patternOpacity)
-DEF_ATTR_SIMPLE(Sprite, PatternScrollX, int, p->patternScroll.x)
-DEF_ATTR_SIMPLE(Sprite, PatternScrollY, int, p->patternScroll.y)
-DEF_ATTR_SIMPLE(Sprite, PatternZoomX, float, p->patternZoom.x)
-DEF_ATTR_SIMPLE(Sprite, PatternZoomY, float, p->patternZoom.y)
-DEF_ATTR_SIMPLE(Sprite, Invert,      bool,    p->invert)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, BushOpacity, int,     p->bushOpacity)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, Opacity,     int,     p->opacity)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, SrcRect,     Rect&,  *p->srcRect)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, Color,       Color&, *p->color)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, Tone,        Tone&,  *p->tone)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, PatternTile, bool, p->patternTile)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, PatternOpacity, int, p->patternOpacity)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, PatternScrollX, int, p->patternScroll.x)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, PatternScrollY, int, p->patternScroll.y)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, PatternZoomX, float, p->patternZoom.x)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, PatternZoomY, float, p->patternZoom.y)
+DEF_ATTR_SIMPLE_DAMAGE(Sprite, Invert,      bool,    p->invert)
 
 void Sprite::setBitmap(Bitmap *bitmap)
 {
@@ -370,6 +372,8 @@ void Sprite::setBitmap(Bitmap *bitmap)
     if (p->bitmap == bitmap)
         return;
     
+    ScreenDamage::mark();
+    
     p->bitmap = bitmap;
     
     if (nullOrDisposed(bitmap))
@@ -391,6 +395,8 @@ void Sprite::setX(int value)
     if (p->trans.getPosition().x == value)
         return;
     
+    ScreenDamage::mark();
+    
     p->trans.setPosition(Vec2(value, getY()));
 }
 
@@ -401,6 +407,8 @@ void Sprite::setY(int value)
     if (p->trans.getPosition().y == value)
         return;
     
+    ScreenDamage::mark();
+    
     p->trans.setPosition(Vec2(getX(), value));
     
     if (rgssVer >= 2)
@@ -417,6 +425,8 @@ void Sprite::setOX(int value)
     if (p->trans.getOrigin().x == value)
         return;
     
+    ScreenDamage::mark();
+    
     p->trans.setOrigin(Vec2(value, getOY()));
 }
 
@@ -427,6 +437,8 @@ void Sprite::setOY(int value)
     if (p->trans.getOrigin().y == value)
         return;
     
+    ScreenDamage::mark();
+    
     p->trans.setOrigin(Vec2(getOX(), value));
 }
 
@@ -437,6 +449,8 @@ void Sprite::setZoomX(float value)
     if (p->trans.getScale().x == value)
         return;
     
+    ScreenDamage::mark();
+    
     p->trans.setScale(Vec2(value, getZoomY()));
 }
 
@@ -447,6 +461,8 @@ void Sprite::setZoomY(float value)
     if (p->trans.getScale().y == value)
         return;
     
+    ScreenDamage::mark();
+    
     p->trans.setScale(Vec2(getZoomX(), value));
     p->recomputeBushDepth();
     
@@ -461,6 +477,8 @@ void Sprite::setAngle(float value)
     if (p->trans.getRotation() == value)
         return;
     
+    ScreenDamage::mark();
+    
     p->trans.setRotation(value);
 }
 
@@ -471,6 +489,8 @@ void Sprite::setMirror(bool mirrored)
     if (p->mirrored == mirrored)
         return;
     
+    ScreenDamage::mark();
+    
     p->mirrored = mirrored;
     p->onSrcRectChange();
 }
@@ -482,6 +502,8 @@ void Sprite::setBushDepth(int value)
     if (p->bushDepth == value)
         return;
     
+    ScreenDamage::mark();
+    
     p->bushDepth = value;
     p->recomputeBushDepth();
 }
@@ -490,6 +512,8 @@ void Sprite::setBlendType(int type)
 {
     guardDisposed();
     
+    ScreenDamage::mark();
+    
     switch (type)
     {
         default :
@@ -512,6 +536,8 @@ void Sprite::setPattern(Bitmap *value)
     if (p->pattern == value)
         return;
     
+    ScreenDamage::mark();
+    
     p->pattern = value;
     
     if (!nullOrDisposed(value))
@@ -522,6 +548,8 @@ void Sprite::setPatternBlendType(int type)
 {
     guardDisposed();
     
+    ScreenDamage::mark();
+    
     switch (type)
     {
         default :
@@ -545,6 +573,7 @@ if (p->wave.name == value) \
 return; \
 p->wave.name = value; \
 p->wave.dirty = true; \
+ScreenDamage::mark(); \
 }
 
 DEF_WAVE_SETTER(Amp,    amp,    int)
@@ -572,6 +601,9 @@ void Sprite::update()
     
     p->wave.phase += p->wave.speed / 180;
     p->wave.dirty = true;
+    
+    if (p->wave.active)
+        ScreenDamage::mark();
 }
 
 /* SceneElement */
@@ -665,6 +697,30 @@ void Sprite::draw()
     glState.blendMode.pop();
 }
 
+bool Sprite::drawBatched(SpriteBatch &batch)
+{
+    /* Nothing to draw counts as handled */
+    if (!p->isVisible || emptyFlashFlag)
+        return true;
+    
+    /* Effects that need per-fragment state
+     * beyond color/tone/opacity go through draw() */
+    if (p->wave.active     ||
+        p->bushDepth != 0  ||
+        p->invert          ||
+        (p->pattern && !p->pattern->isDisposed()))
+        return false;
+    
+    const Vec4 *blend = (flashing && flashColor.w > p->color->norm.w) ?
+    &flashColor : &p->color->norm;
+    
+    batch.append(*p->bitmap, p->blendType, p->quad.vert,
+                 p->trans.getMatrix(), p->opacity.norm,
+                 *blend, p->tone->norm);
+    
+    return true;
+}
+
 void Sprite::onGeometryChange(const Scene::Geometry &geo)
 {
     /* Offset at which the sprite will be drawn
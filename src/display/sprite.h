@@ -82,6 +82,7 @@ private:
 	SpritePrivate *p;
 
 	void draw();
+	bool drawBatched(SpriteBatch &batch);
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
@@ -32,6 +32,7 @@
 #include "vertex.h"
 #include "quad.h"
 #include "etc-internal.h"
+#include "screendamage.h"
 
 #include <stdint.h>
 #include <assert.h>
@@ -61,6 +62,28 @@ tableGetWrapped(const Table &t, int x, int y, int z = 0)
 	             z);
 }
 
+/* Whether the span [pos, pos+len) of a wrapping map of
+ * 'size' cells (0 <= pos, pos+len <= size) shows up in the
+ * span [viewPos, viewPos+viewLen), which may lie anywhere */
+static inline bool
+spanVisibleWrapped(int pos, int len, int viewPos, int viewLen, int size)
+{
+	if (len <= 0 || viewLen <= 0)
+		return false;
+
+	if (viewLen >= size)
+		return true;
+
+	const int start = wrap(viewPos, size);
+	const int end = start + viewLen;
+
+	if (pos < end && pos + len > start)
+		return true;
+
+	/* The view wraps around past the map edge */
+	return end > size && pos < end - size;
+}
+
 /* Calculate the tile x/y on which this pixel x/y lies */
 static inline Vec2i
 getTilePos(const Vec2i &pixelPos)
@@ -159,6 +182,12 @@ struct FlashMap
 		dirty = true;
 	}
 
+	/* Whether there might be any flashing tiles */
+	bool hasContent() const
+	{
+		return dirty || quadCount() > 0;
+	}
+
 	void prepare()
 	{
 		if (!dirty)
@@ -195,6 +224,7 @@ private:
 	void setDirty()
 	{
 		dirty = true;
+		ScreenDamage::mark();
 	}
 
 	size_t quadCount() const
@@ -39,11 +39,14 @@
 #include "vertex.h"
 #include "tileatlas.h"
 #include "tilemap-common.h"
+#include "frameprofiler.h"
+#include "screendamage.h"
 
 #include "sigslot/signal.hpp"
 
 #include <string.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <algorithm>
 #include <vector>
 
@@ -72,6 +75,22 @@ static const int viewpH = 16;
 
 static const size_t zlayersMax = viewpH + 5;
 
+/* Ring buffer dimensions (in map cells); one larger than
+ * the map viewport as the edge cells are partially visible */
+static const int ringW = viewpW + 1;
+static const int ringH = viewpH + 1;
+
+/* Max quads per (cell, layer) slot (autotiles use 4 pieces) */
+static const int quadsPerSlot = 4;
+
+/* Distance between two ring cells in vertex position units,
+ * see tilemap.vert for the encoding */
+static const int ringCellSpan = 64;
+
+/* Map layers beyond this are not displayed, as the
+ * ring vertices would no longer fit 16 bit indices */
+static const int ringMaxZ = (INDEX_T_MAX + 1) / (ringW * ringH * quadsPerSlot * 4);
+
 /* Vocabulary:
  *
  * Atlas: A texture containing both the tileset and all
@@ -152,8 +171,22 @@ static const size_t zlayersMax = viewpH + 5;
  *   This rectangle describes the subregion of the map that is
  *   actually translated to vertices and stored on the GPU ready
  *   for rendering. Whenever, ox/oy are modified, its position is
- *   adjusted if necessary and the data is regenerated. Its size
- *   is fixed. This is NOT related to the RGSS Viewport class!
+ *   adjusted if necessary. Its size is fixed. This is NOT related
+ *   to the RGSS Viewport class!
+ *
+ * Ring buffer:
+ *   The tile VBO holds one fixed size slot per (map cell, layer),
+ *   and map cell (x, y) always lives at ring cell (x % ringW,
+ *   y % ringH). When the map viewport moves, only the cells of
+ *   the newly exposed rows/columns are regenerated and uploaded;
+ *   everything else stays put. The vertex shader translates ring
+ *   cells back into viewport cells using the ring origin (the
+ *   ring cell of the map viewport's top left corner).
+ *   Which slot quads make up the ground layer and each zlayer
+ *   is expressed through a small private index buffer, which is
+ *   rebuilt from per slot metadata whenever the ring changes.
+ *   Cells written to through the map data Table are regenerated
+ *   in place the same way.
  *
  */
 
@@ -274,11 +307,28 @@ struct TilemapPrivate
 	/* Map viewport position */
 	Vec2i viewpPos;
 
-	/* Ground layer vertices */
-	SVVector groundVert;
+	/* Ring buffer backing the tile VBO */
+	struct
+	{
+		/* Map viewport position the contents correspond to */
+		Vec2i pos;
+
+		/* Number of map layers stored per cell */
+		int zSize;
+
+		/* Vertices of all slots, quadsPerSlot quads each */
+		SVVector vert;
+
+		/* Per slot: used quads (0 = empty) and tile priority */
+		std::vector<uint8_t> quads;
+		std::vector<uint8_t> prio;
+	} ring;
 
-	/* ZLayer vertices */
-	SVVector zlayerVert[zlayersMax];
+	/* Ground layer indices */
+	std::vector<index_t> groundInd;
+
+	/* ZLayer indices */
+	std::vector<index_t> zlayerInd[zlayersMax];
 
 	/* Base quad indices of each zlayer
 	 * in the shared buffer */
@@ -289,6 +339,7 @@ struct TilemapPrivate
 	{
 		GLMeta::VAO vao;
 		VBO::ID vbo;
+		IBO::ID ibo;
 		bool animated;
 
 		/* Animation state */
@@ -312,8 +363,11 @@ struct TilemapPrivate
 	bool atlasSizeDirty;
 	/* Affected by: autotiles(.changed), tileset(.changed), allocateAtlas */
 	bool atlasDirty;
-	/* Affected by: mapData(.changed), priorities(.changed) */
+	/* Affected by: mapData, priorities(.changed) */
 	bool buffersDirty;
+	/* Affected by: mapData(.modifiedArea); the map cells
+	 * to regenerate in place (empty if none) */
+	IntRect dirtyCells;
 	/* Affected by: ox, oy */
 	bool mapViewportDirty;
 	/* Affected by: oy */
@@ -368,12 +422,16 @@ struct TilemapPrivate
 		tiles.animated = false;
 		tiles.aniIdx = 0;
 
+		ring.zSize = 0;
+		memset(zlayerBases, 0, sizeof(zlayerBases));
+
 		/* Init tile buffers */
 		tiles.vbo = VBO::gen();
+		tiles.ibo = IBO::gen();
 
 		GLMeta::vaoFillInVertexData<SVertex>(tiles.vao);
 		tiles.vao.vbo = tiles.vbo;
-		tiles.vao.ibo = shState->globalIBO().ibo;
+		tiles.vao.ibo = tiles.ibo;
 
 		GLMeta::vaoInit(tiles.vao);
 
@@ -400,6 +458,7 @@ struct TilemapPrivate
 		/* Destroy tile buffers */
 		GLMeta::vaoFini(tiles.vao);
 		VBO::del(tiles.vbo);
+		IBO::del(tiles.ibo);
 
 		/* Disconnect signal handlers */
 		tilesetCon.disconnect();
@@ -446,6 +505,9 @@ struct TilemapPrivate
 		usableATs.clear();
 		animatedATs.clear();
 
+		bool smallATs[autotileCount];
+		memcpy(smallATs, atlas.smallATs, sizeof(smallATs));
+
 		for (int i = 0; i < autotileCount; ++i)
 		{
 			if (nullOrDisposed(autotiles[i]) || autotiles[i]->megaSurface())
@@ -472,6 +534,11 @@ struct TilemapPrivate
 		}
 
 		tiles.animated = !animatedATs.empty();
+
+		/* Small autotiles are laid out differently
+		 * in the ring, so those need regenerating */
+		if (memcmp(smallATs, atlas.smallATs, sizeof(smallATs)))
+			buffersDirty = true;
 	}
 
 	void updateSceneGeometry(const Scene::Geometry &geo)
@@ -483,16 +550,25 @@ struct TilemapPrivate
 	void invalidateAtlasSize()
 	{
 		atlasSizeDirty = true;
+		ScreenDamage::mark();
 	}
 
 	void invalidateAtlasContents()
 	{
 		atlasDirty = true;
+		ScreenDamage::mark();
 	}
 
 	void invalidateBuffers()
 	{
 		buffersDirty = true;
+		ScreenDamage::mark();
+	}
+
+	void invalidateCells(const IntRect &area)
+	{
+		SDL_UnionRect(&dirtyCells, &area, &dirtyCells);
+		ScreenDamage::mark();
 	}
 
 	/* Checks for the minimum amount of data needed to display */
@@ -517,6 +593,9 @@ struct TilemapPrivate
 		shState->requestAtlasTex(atlas.size.x, atlas.size.y, atlas.gl);
 
 		atlasDirty = true;
+
+		/* Tileset coordinates depend on the atlas size */
+		buffersDirty = true;
 	}
 
 	/* Assembles atlas from tileset and autotile bitmaps */
@@ -680,7 +759,9 @@ struct TilemapPrivate
 		return value;
 	}
 
-	void handleAutotile(int x, int y, int tileInd, SVVector *array)
+	/* Writes the quads for an autotile with their positions
+	 * relative to the cell; returns the number of quads used */
+	int handleAutotile(int tileInd, SVertex *vert)
 	{
 		/* Which autotile [0-7] */
 		int atInd = tileInd / 48 - 1;
@@ -694,7 +775,7 @@ struct TilemapPrivate
 			/* Iterate over the 4 tile pieces */
 			for (int i = 0; i < 4; ++i)
 			{
-				FloatRect posRect(x*32, y*32, 16, 16);
+				FloatRect posRect(0, 0, 16, 16);
 				atSelectSubPos(posRect, i);
 
 				FloatRect texRect = pieceRect[i];
@@ -702,31 +783,32 @@ struct TilemapPrivate
 				/* Adjust to atlas coordinates */
 				texRect.y += atInd * autotileH;
 
-				SVertex v[4];
-				Quad::setTexPosRect(v, texRect, posRect);
-
-				/* Iterate over 4 vertices */
-				for (size_t j = 0; j < 4; ++j)
-					array->push_back(v[j]);
+				Quad::setTexPosRect(&vert[i*4], texRect, posRect);
 			}
+
+			return 4;
 		}
 		else
 		{
-			FloatRect posRect(x*32, y*32, 32, 32);
+			FloatRect posRect(0, 0, 32, 32);
 			FloatRect texRect(0.5f, atInd * autotileH + 0.5f, 31, 31);
-			SVertex v[4];
-			Quad::setTexPosRect(v, texRect, posRect);
+			Quad::setTexPosRect(vert, texRect, posRect);
 
-			/* Iterate over 4 vertices */
-			for (size_t j = 0; j < 4; ++j)
-				array->push_back(v[j]);
+			return 1;
 		}
 	}
 
-	void handleTile(int x, int y, int z)
+	size_t ringSlot(int ringX, int ringY) const
+	{
+		return (ringY * ringW + ringX) * ring.zSize;
+	}
+
+	void handleTile(int x, int y, int z, int ringX, int ringY)
 	{
-		int tileInd =
-			tableGetWrapped(*mapData, x + viewpPos.x, y + viewpPos.y, z);
+		const size_t slot = ringSlot(ringX, ringY) + z;
+		ring.quads[slot] = 0;
+
+		int tileInd = mapData->get(x, y, z);
 
 		/* Check for empty space */
 		if (tileInd < 48)
@@ -738,81 +820,57 @@ struct TilemapPrivate
 		if (prio == -1)
 			return;
 
-		SVVector *targetArray;
+		SVertex *vert = &ring.vert[slot * quadsPerSlot * 4];
+		int quads;
 
-		/* Prio 0 tiles are all part of the same ground layer */
-		if (prio == 0)
+		/* Check for autotile */
+		if (tileInd < 48*8)
 		{
-			targetArray = &groundVert;
+			quads = handleAutotile(tileInd, vert);
 		}
 		else
 		{
-			int layerInd = y + prio;
-			if ((size_t)layerInd >= zlayersMax)
-				return;
-			targetArray = &zlayerVert[layerInd];
+			int tsInd = tileInd - 48*8;
+			int tileX = tsInd % 8;
+			int tileY = tsInd / 8;
+
+			Vec2i texPos = TileAtlas::tileToAtlasCoor(tileX, tileY, atlas.efTilesetH, atlas.size.y);
+			FloatRect texRect((float) texPos.x+0.5f, (float) texPos.y+0.5f, 31, 31);
+			FloatRect posRect(0, 0, 32, 32);
+
+			Quad::setTexPosRect(vert, texRect, posRect);
+			quads = 1;
 		}
 
-		/* Check for autotile */
-		if (tileInd < 48*8)
+		/* Move into the ring cell */
+		for (int i = 0; i < quads*4; ++i)
 		{
-			handleAutotile(x, y, tileInd, targetArray);
-			return;
+			vert[i].pos.x += ringX * ringCellSpan;
+			vert[i].pos.y += ringY * ringCellSpan;
 		}
 
-		int tsInd = tileInd - 48*8;
-		int tileX = tsInd % 8;
-		int tileY = tsInd / 8;
-
-		Vec2i texPos = TileAtlas::tileToAtlasCoor(tileX, tileY, atlas.efTilesetH, atlas.size.y);
-		FloatRect texRect((float) texPos.x+0.5f, (float) texPos.y+0.5f, 31, 31);
-		FloatRect posRect(x*32, y*32, 32, 32);
-
-		SVertex v[4];
-		Quad::setTexPosRect(v, texRect, posRect);
-
-		for (size_t i = 0; i < 4; ++i)
-			targetArray->push_back(v[i]);
+		ring.quads[slot] = quads;
+		ring.prio[slot] = prio;
 	}
 
-	void clearQuadArrays()
+	/* Regenerates all layers of map cell x/y */
+	void handleCell(int x, int y)
 	{
-		groundVert.clear();
+		if (ring.zSize == 0)
+			return;
 
-		for (size_t i = 0; i < zlayersMax; ++i)
-			zlayerVert[i].clear();
-	}
+		const int ringX = wrap(x, ringW);
+		const int ringY = wrap(y, ringH);
 
-	void buildQuadArray()
-	{
-		clearQuadArrays();
-
-		int ox = viewpPos.x;
-		int oy = viewpPos.y;
-		int mapW = mapData->xSize();
-		int mapH = mapData->ySize();
-
-		int minX = 0;
-		int minY = 0;
-		if (ox < 0)
-			minX = -ox;
-		if (oy < 0)
-			minY = -oy;
-
-		// There could be off-by-one issues in these couple sections.
-		int maxX = viewpW;
-		int maxY = viewpH;
-		if (ox + maxX >= mapW)
-			maxX = mapW - ox - 1;
-		if (oy + maxY >= mapH)
-			maxY = mapH - oy - 1;
-
-		if ((minX > maxX) || (minY > maxY))
+		/* Cells outside the map stay empty */
+		if (x < 0 || y < 0 || x >= mapData->xSize() || y >= mapData->ySize())
+		{
+			memset(&ring.quads[ringSlot(ringX, ringY)], 0, ring.zSize);
 			return;
-		for (int x = minX; x <= maxX; ++x)
-			for (int y = minY; y <= maxY; ++y)
-				for (int z = 0; z < mapData->zSize(); ++z)
-					handleTile(x, y, z);
+		}
+
+		for (int z = 0; z < ring.zSize; ++z)
+			handleTile(x, y, z, ringX, ringY);
 	}
 
 	static size_t quadDataSize(size_t quadCount)
@@ -820,66 +878,240 @@ struct TilemapPrivate
 		return quadCount * sizeof(SVertex) * 4;
 	}
 
-	size_t zlayerSize(size_t index)
+	/* Uploads 'count' consecutive cells of one ring row */
+	void uploadRingCells(int ringX, int ringY, int count)
 	{
-		return zlayerBases[index+1] - zlayerBases[index];
+		const size_t slot = ringSlot(ringX, ringY);
+
+		VBO::uploadSubData(quadDataSize(slot * quadsPerSlot),
+		                   quadDataSize(count * ring.zSize * quadsPerSlot),
+		                   &ring.vert[slot * quadsPerSlot * 4]);
 	}
 
-	void uploadBuffers()
+	/* Regenerates the entire ring for the current map viewport */
+	void buildRing()
 	{
-		/* Calculate total quad count */
-		size_t groundQuadCount = groundVert.size() / 4;
-		size_t quadCount = groundQuadCount;
+		if (mapData->zSize() > ringMaxZ && ring.zSize != ringMaxZ)
+			Debug() << "Tilemap: only the first" << ringMaxZ << "map layers are displayed";
 
-		for (size_t i = 0; i < zlayersMax; ++i)
+		ring.zSize = std::min(mapData->zSize(), ringMaxZ);
+		ring.pos = viewpPos;
+		dirtyCells = IntRect();
+
+		const size_t slotCount = ringW * ringH * ring.zSize;
+		ring.vert.resize(slotCount * quadsPerSlot * 4);
+		ring.quads.assign(slotCount, 0);
+		ring.prio.assign(slotCount, 0);
+
+		for (int y = 0; y < ringH; ++y)
+			for (int x = 0; x < ringW; ++x)
+				handleCell(viewpPos.x + x, viewpPos.y + y);
+
+		VBO::bind(tiles.vbo);
+		VBO::uploadData(ring.vert.size() * sizeof(SVertex), dataPtr(ring.vert), GL_DYNAMIC_DRAW);
+		VBO::unbind();
+	}
+
+	/* Brings the ring up to date after the map viewport moved,
+	 * regenerating only the newly exposed rows and columns */
+	void scrollRing()
+	{
+		const Vec2i delta = viewpPos - ring.pos;
+
+		if (abs(delta.x) >= ringW || abs(delta.y) >= ringH || ring.zSize == 0)
 		{
-			zlayerBases[i] = quadCount;
-			quadCount += zlayerVert[i].size() / 4;
+			buildRing();
+			return;
 		}
 
-		zlayerBases[zlayersMax] = quadCount;
+		ring.pos = viewpPos;
+
+		const int colStart = delta.x > 0 ? ringW - delta.x : 0;
+		const int colEnd = colStart + abs(delta.x);
+		const int rowStart = delta.y > 0 ? ringH - delta.y : 0;
+		const int rowEnd = rowStart + abs(delta.y);
 
 		VBO::bind(tiles.vbo);
-		VBO::allocEmpty(quadDataSize(quadCount));
 
-		VBO::uploadSubData(0, quadDataSize(groundQuadCount), dataPtr(groundVert));
+		/* Exposed rows replace entire ring rows */
+		for (int y = rowStart; y < rowEnd; ++y)
+		{
+			for (int x = 0; x < ringW; ++x)
+				handleCell(viewpPos.x + x, viewpPos.y + y);
 
-		for (size_t i = 0; i < zlayersMax; ++i)
+			uploadRingCells(0, wrap(viewpPos.y + y, ringH), ringW);
+		}
+
+		/* Exposed columns, minus the cells covered above */
+		for (int x = colStart; x < colEnd; ++x)
 		{
-			if (zlayerVert[i].empty())
-				continue;
+			for (int y = 0; y < ringH; ++y)
+			{
+				if (y >= rowStart && y < rowEnd)
+					continue;
 
-			VBO::uploadSubData(quadDataSize(zlayerBases[i]),
-			                   quadDataSize(zlayerSize(i)), dataPtr(zlayerVert[i]));
+				handleCell(viewpPos.x + x, viewpPos.y + y);
+				uploadRingCells(wrap(viewpPos.x + x, ringW),
+				                wrap(viewpPos.y + y, ringH), 1);
+			}
 		}
 
 		VBO::unbind();
+	}
 
-		/* Ensure global IBO size */
-		shState->ensureQuadIBO(quadCount);
+	/* Regenerates the dirty map cells that are currently in
+	 * the ring, and uploads just their slots. Returns whether
+	 * any slot's quad count or priority changed, which means
+	 * the indices need rebuilding */
+	bool patchRing()
+	{
+		const IntRect ringArea(ring.pos, Vec2i(ringW, ringH));
+		IntRect area;
+
+		const bool inRing = SDL_IntersectRect(&dirtyCells, &ringArea, &area);
+		dirtyCells = IntRect();
+
+		if (!inRing || ring.zSize == 0)
+			return false;
+
+		bool layoutChanged = false;
+		uint8_t quads[ringMaxZ];
+		uint8_t prio[ringMaxZ];
+
+		VBO::bind(tiles.vbo);
+
+		for (int y = area.y; y < area.y + area.h; ++y)
+		{
+			const int ringY = wrap(y, ringH);
+
+			for (int x = area.x; x < area.x + area.w; ++x)
+			{
+				const size_t slot = ringSlot(wrap(x, ringW), ringY);
+
+				memcpy(quads, &ring.quads[slot], ring.zSize);
+				memcpy(prio, &ring.prio[slot], ring.zSize);
+
+				handleCell(x, y);
+
+				if (memcmp(quads, &ring.quads[slot], ring.zSize) ||
+				    memcmp(prio, &ring.prio[slot], ring.zSize))
+					layoutChanged = true;
+			}
+
+			/* The row's cells are consecutive in the
+			 * ring, unless they wrap around its edge */
+			const int ringX = wrap(area.x, ringW);
+			const int count = std::min(area.w, ringW - ringX);
+
+			uploadRingCells(ringX, ringY, count);
+
+			if (count < area.w)
+				uploadRingCells(0, ringY, area.w - count);
+		}
+
+		VBO::unbind();
+
+		return layoutChanged;
 	}
 
-	void bindShader(ShaderBase *&shaderVar)
+	static void pushQuadIndices(std::vector<index_t> &array, size_t quad)
 	{
-		if (tiles.animated || color->hasEffect() || tone->hasEffect() || opacity != 255)
+		static const index_t indTemp[] = { 0, 1, 2, 2, 3, 0 };
+		const index_t base = quad * 4;
+
+		for (size_t i = 0; i < 6; ++i)
+			array.push_back(base + indTemp[i]);
+	}
+
+	/* Sorts the ring's quads into the ground layer
+	 * and zlayers (by viewport row) and uploads the
+	 * resulting index buffer */
+	void buildIndices()
+	{
+		groundInd.clear();
+
+		for (size_t i = 0; i < zlayersMax; ++i)
+			zlayerInd[i].clear();
+
+		for (int y = 0; y < ringH; ++y)
 		{
-			TilemapShader &tilemapShader = shState->shaders().tilemap;
-			tilemapShader.bind();
-			tilemapShader.applyViewportProj();
-			tilemapShader.setTone(tone->norm);
-			tilemapShader.setColor(color->norm);
-			tilemapShader.setOpacity(opacity.norm);
-			tilemapShader.setAniIndex(tiles.aniIdx / atFrameDur);
-			tilemapShader.setATFrames(atlas.nATFrames);
-			shaderVar = &tilemapShader;
+			const int ringY = wrap(viewpPos.y + y, ringH);
+
+			for (int x = 0; x < ringW; ++x)
+			{
+				const size_t slot = ringSlot(wrap(viewpPos.x + x, ringW), ringY);
+
+				for (int z = 0; z < ring.zSize; ++z)
+				{
+					const int quads = ring.quads[slot+z];
+
+					if (quads == 0)
+						continue;
+
+					const int prio = ring.prio[slot+z];
+					std::vector<index_t> *targetArray;
+
+					/* Prio 0 tiles are all part of the same ground layer */
+					if (prio == 0)
+					{
+						targetArray = &groundInd;
+					}
+					else
+					{
+						int layerInd = y + prio;
+						if ((size_t)layerInd >= zlayersMax)
+							continue;
+						targetArray = &zlayerInd[layerInd];
+					}
+
+					for (int q = 0; q < quads; ++q)
+						pushQuadIndices(*targetArray, (slot+z) * quadsPerSlot + q);
+				}
+			}
 		}
-		else
+
+		/* Calculate quad bases and concatenate */
+		size_t quadCount = groundInd.size() / 6;
+
+		for (size_t i = 0; i < zlayersMax; ++i)
 		{
-			shaderVar = &shState->shaders().simple;
-			shaderVar->bind();
+			zlayerBases[i] = quadCount;
+			quadCount += zlayerInd[i].size() / 6;
 		}
 
-		shaderVar->applyViewportProj();
+		zlayerBases[zlayersMax] = quadCount;
+
+		std::vector<index_t> indices;
+		indices.reserve(quadCount * 6);
+		indices.insert(indices.end(), groundInd.begin(), groundInd.end());
+
+		for (size_t i = 0; i < zlayersMax; ++i)
+			indices.insert(indices.end(), zlayerInd[i].begin(), zlayerInd[i].end());
+
+		IBO::bind(tiles.ibo);
+		IBO::uploadData(indices.size() * sizeof(index_t), dataPtr(indices), GL_DYNAMIC_DRAW);
+		IBO::unbind();
+	}
+
+	size_t zlayerSize(size_t index)
+	{
+		return zlayerBases[index+1] - zlayerBases[index];
+	}
+
+	void bindShader(ShaderBase *&shaderVar)
+	{
+		/* Always needed, as it also unwraps the ring buffer */
+		TilemapShader &tilemapShader = shState->shaders().tilemap;
+		tilemapShader.bind();
+		tilemapShader.applyViewportProj();
+		tilemapShader.setTone(tone->norm);
+		tilemapShader.setColor(color->norm);
+		tilemapShader.setOpacity(opacity.norm);
+		tilemapShader.setAniIndex(tiles.aniIdx / atFrameDur);
+		tilemapShader.setATFrames(atlas.nATFrames);
+		tilemapShader.setRingOrigin(Vec2i(wrap(ring.pos.x, ringW), wrap(ring.pos.y, ringH)));
+		tilemapShader.setRingSize(Vec2i(ringW, ringH));
+		shaderVar = &tilemapShader;
 	}
 
 	void bindAtlas(ShaderBase &shader)
@@ -914,7 +1146,7 @@ struct TilemapPrivate
 		std::vector<int> zlayerInd;
 
 		for (size_t i = 0; i < zlayersMax; ++i)
-			if (zlayerVert[i].size() > 0)
+			if (zlayerSize(i) > 0)
 				zlayerInd.push_back(i);
 
 		updateActiveElements(zlayerInd);
@@ -997,8 +1229,8 @@ struct TilemapPrivate
 
 		if (mvpPos != viewpPos)
 		{
+			/* The ring catches up in prepare() */
 			viewpPos = mvpPos;
-			buffersDirty = true;
 			updateFlashMapViewport();
 		}
 
@@ -1007,6 +1239,8 @@ struct TilemapPrivate
 
 	void prepare()
 	{
+		ProfileScope profile(ProfTilemapPrepare);
+
 		if (!verifyResources())
 		{
 			if (tilemapReady)
@@ -1036,11 +1270,30 @@ struct TilemapPrivate
 
 		if (buffersDirty)
 		{
-			buildQuadArray();
-			uploadBuffers();
+			buildRing();
+			buildIndices();
 			updateSceneElements();
 			buffersDirty = false;
 		}
+		else
+		{
+			bool indicesDirty = false;
+
+			if (viewpPos != ring.pos)
+			{
+				scrollRing();
+				indicesDirty = true;
+			}
+
+			if (!SDL_RectEmpty(&dirtyCells) && patchRing())
+				indicesDirty = true;
+
+			if (indicesDirty)
+			{
+				buildIndices();
+				updateSceneElements();
+			}
+		}
 
 		flashMap.prepare();
 
@@ -1071,7 +1324,7 @@ void GroundLayer::updateVboCount()
 
 void GroundLayer::draw()
 {
-	if (p->groundVert.size() == 0)
+	if (p->groundInd.empty())
 		return;
 
 	if (!p->opacity)
@@ -1232,11 +1485,15 @@ void Tilemap::update()
 	if (++p->flashAlphaIdx >= flashAlphaN)
 		p->flashAlphaIdx = 0;
 
+	if (p->flashMap.hasContent())
+		ScreenDamage::mark();
+
 	/* Animate autotiles */
 	if (!p->tiles.animated)
 		return;
 
-	++p->tiles.aniIdx;
+	if (++p->tiles.aniIdx % atFrameDur == 0)
+		ScreenDamage::mark();
 }
 
 Tilemap::Autotiles &Tilemap::getAutotiles()
@@ -1256,9 +1513,9 @@ DEF_ATTR_RD_SIMPLE(Tilemap, OX, int, p->origin.x)
 DEF_ATTR_RD_SIMPLE(Tilemap, OY, int, p->origin.y)
 
 DEF_ATTR_RD_SIMPLE(Tilemap, BlendType, int, p->blendType)
-DEF_ATTR_SIMPLE(Tilemap, Opacity,   int,     p->opacity)
-DEF_ATTR_SIMPLE(Tilemap, Color,     Color&, *p->color)
-DEF_ATTR_SIMPLE(Tilemap, Tone,      Tone&,  *p->tone)
+DEF_ATTR_SIMPLE_DAMAGE(Tilemap, Opacity,   int,     p->opacity)
+DEF_ATTR_SIMPLE_DAMAGE(Tilemap, Color,     Color&, *p->color)
+DEF_ATTR_SIMPLE_DAMAGE(Tilemap, Tone,      Tone&,  *p->tone)
 
 void Tilemap::setTileset(Bitmap *value)
 {
@@ -1267,6 +1524,8 @@ void Tilemap::setTileset(Bitmap *value)
 	if (p->tileset == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->tileset = value;
 
 	if (!value)
@@ -1287,6 +1546,8 @@ void Tilemap::setMapData(Table *value)
 	if (p->mapData == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->mapData = value;
 
 	if (!value)
@@ -1294,14 +1555,16 @@ void Tilemap::setMapData(Table *value)
 
 	p->invalidateBuffers();
 	p->mapDataCon.disconnect();
-	p->mapDataCon = value->modified.connect
-	        (&TilemapPrivate::invalidateBuffers, p);
+	p->mapDataCon = value->modifiedArea.connect
+	        (&TilemapPrivate::invalidateCells, p);
 }
 
 void Tilemap::setFlashData(Table *value)
 {
 	guardDisposed();
 
+	ScreenDamage::mark();
+
 	p->flashMap.setData(value);
 }
 
@@ -1312,6 +1575,8 @@ void Tilemap::setPriorities(Table *value)
 	if (p->priorities == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->priorities = value;
 
 	if (!value)
@@ -1330,6 +1595,8 @@ void Tilemap::setVisible(bool value)
 	if (p->visible == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->visible = value;
 
 	if (!p->tilemapReady)
@@ -1347,6 +1614,8 @@ void Tilemap::setOX(int value)
 	if (p->origin.x == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->origin.x = value;
 	p->mapViewportDirty = true;
 }
@@ -1358,6 +1627,8 @@ void Tilemap::setOY(int value)
 	if (p->origin.y == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->origin.y = value;
 	p->zOrderDirty = true;
 	p->mapViewportDirty = true;
@@ -1367,6 +1638,8 @@ void Tilemap::setBlendType(int value)
 {
 	guardDisposed();
 
+	ScreenDamage::mark();
+
 	switch (value)
 	{
 	default :
@@ -34,6 +34,8 @@
 #include "quadarray.h"
 #include "shader.h"
 #include "tilemap-common.h"
+#include "frameprofiler.h"
+#include "screendamage.h"
 
 #include <vector>
 #include "sigslot/signal.hpp"
@@ -180,11 +182,36 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	void invalidateAtlas()
 	{
 		atlasDirty = true;
+		ScreenDamage::mark();
 	}
 
 	void invalidateBuffers()
 	{
 		buffersDirty = true;
+		ScreenDamage::mark();
+	}
+
+	/* Tiles are packed in drawing order, so changes can't be
+	 * patched in place; but cells outside the map viewport
+	 * (eg. animated from script elsewhere on the map) don't
+	 * need the vertices regenerated at all */
+	void invalidateCells(const IntRect &area)
+	{
+		if (mapViewportDirty)
+		{
+			updateMapViewport();
+			mapViewportDirty = false;
+		}
+
+		if (buffersDirty)
+		{
+			ScreenDamage::mark();
+			return;
+		}
+
+		if (spanVisibleWrapped(area.x, area.w, mapViewp.x, mapViewp.w, mapData->xSize()) &&
+		    spanVisibleWrapped(area.y, area.h, mapViewp.y, mapViewp.h, mapData->ySize()))
+			invalidateBuffers();
 	}
 
 	void rebuildAtlas()
@@ -267,6 +294,8 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 
 	void prepare()
 	{
+		ProfileScope profile(ProfTilemapPrepare);
+
 		if (!mapData)
 			return;
 
@@ -412,7 +441,7 @@ void TilemapVX::BitmapArray::set(int i, Bitmap *bitmap)
 		return;
 
 	p->bitmaps[i] = bitmap;
-	p->atlasDirty = true;
+	p->invalidateAtlas();
 
 	p->bmChangedCons[i].disconnect();
 	p->bmChangedCons[i] = bitmap->modified.connect
@@ -453,6 +482,9 @@ void TilemapVX::update()
 	if (++p->frameIdx >= 30*3*4)
 		p->frameIdx = 0;
 
+	if (p->frameIdx % 30 == 0)
+		ScreenDamage::mark();
+
 	const uint8_t aniIndicesA[3*4] =
 		{ 0, 1, 2, 1, 0, 1, 2, 1, 0, 1, 2, 1 };
 	const uint8_t aniIndicesC[3*4] =
@@ -466,6 +498,9 @@ void TilemapVX::update()
 	/* Animate flash */
 	if (++p->flashAlphaIdx >= flashAlphaN)
 		p->flashAlphaIdx = 0;
+
+	if (p->flashMap.hasContent())
+		ScreenDamage::mark();
 }
 
 TilemapVX::BitmapArray &TilemapVX::getBitmapArray()
@@ -499,6 +534,8 @@ void TilemapVX::setViewport(Viewport *value)
 {
 	guardDisposed();
 
+	ScreenDamage::mark();
+
 	p->setViewport(value);
 	p->above.setViewport(value);
 }
@@ -510,18 +547,22 @@ void TilemapVX::setMapData(Table *value)
 	if (p->mapData == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->mapData = value;
 	p->buffersDirty = true;
 
 	p->mapDataCon.disconnect();
-	p->mapDataCon = value->modified.connect
-		(&TilemapVXPrivate::invalidateBuffers, p);
+	p->mapDataCon = value->modifiedArea.connect
+		(&TilemapVXPrivate::invalidateCells, p);
 }
 
 void TilemapVX::setFlashData(Table *value)
 {
 	guardDisposed();
 
+	ScreenDamage::mark();
+
 	p->flashMap.setData(value);
 }
 
@@ -532,6 +573,8 @@ void TilemapVX::setFlags(Table *value)
 	if (p->flags == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->flags = value;
 	p->buffersDirty = true;
 
@@ -544,6 +587,8 @@ void TilemapVX::setVisible(bool value)
 {
 	guardDisposed();
 
+	ScreenDamage::mark();
+
 	p->setVisible(value);
 	p->above.setVisible(value);
 }
@@ -555,6 +600,8 @@ void TilemapVX::setOX(int value)
 	if (p->origin.x == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->origin.x = value;
 	p->mapViewportDirty = true;
 }
@@ -566,6 +613,8 @@ void TilemapVX::setOY(int value)
 	if (p->origin.y == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->origin.y = value;
 	p->mapViewportDirty = true;
 }
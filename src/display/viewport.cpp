@@ -27,6 +27,7 @@
 #include "quad.h"
 #include "glstate.h"
 #include "graphics.h"
+#include "screendamage.h"
 
 #include <SDL_rect.h>
 
@@ -147,9 +148,9 @@ void Viewport::update()
 DEF_ATTR_RD_SIMPLE(Viewport, OX,   int,   geometry.orig.x)
 DEF_ATTR_RD_SIMPLE(Viewport, OY,   int,   geometry.orig.y)
 
-DEF_ATTR_SIMPLE(Viewport, Rect,  Rect&,  *p->rect)
-DEF_ATTR_SIMPLE(Viewport, Color, Color&, *p->color)
-DEF_ATTR_SIMPLE(Viewport, Tone,  Tone&,  *p->tone)
+DEF_ATTR_SIMPLE_DAMAGE(Viewport, Rect,  Rect&,  *p->rect)
+DEF_ATTR_SIMPLE_DAMAGE(Viewport, Color, Color&, *p->color)
+DEF_ATTR_SIMPLE_DAMAGE(Viewport, Tone,  Tone&,  *p->tone)
 
 void Viewport::setOX(int value)
 {
@@ -158,6 +159,8 @@ void Viewport::setOX(int value)
 	if (geometry.orig.x == value)
 		return;
 
+	ScreenDamage::mark();
+
 	geometry.orig.x = value;
 	notifyGeometryChange();
 }
@@ -169,6 +172,8 @@ void Viewport::setOY(int value)
 	if (geometry.orig.y == value)
 		return;
 
+	ScreenDamage::mark();
+
 	geometry.orig.y = value;
 	notifyGeometryChange();
 }
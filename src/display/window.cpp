@@ -33,6 +33,7 @@
 #include "quadarray.h"
 #include "texpool.h"
 #include "glstate.h"
+#include "screendamage.h"
 
 #include "sigslot/signal.hpp"
 
@@ -695,11 +696,15 @@ void Window::update()
 
 	p->updateControls();
 	p->stepAnimations();
+
+	/* Cursor blinking and pause sign */
+	if ((p->active && !p->cursorRect->isEmpty()) || p->pause)
+		ScreenDamage::mark();
 }
 
-DEF_ATTR_SIMPLE(Window, X,          int,     p->position.x)
-DEF_ATTR_SIMPLE(Window, Y,          int,     p->position.y)
-DEF_ATTR_SIMPLE(Window, CursorRect, Rect&,  *p->cursorRect)
+DEF_ATTR_SIMPLE_DAMAGE(Window, X,          int,     p->position.x)
+DEF_ATTR_SIMPLE_DAMAGE(Window, Y,          int,     p->position.y)
+DEF_ATTR_SIMPLE_DAMAGE(Window, CursorRect, Rect&,  *p->cursorRect)
 
 DEF_ATTR_RD_SIMPLE(Window, Windowskin,      Bitmap*, p->windowskin)
 DEF_ATTR_RD_SIMPLE(Window, Contents,        Bitmap*, p->contents)
@@ -718,6 +723,8 @@ void Window::setWindowskin(Bitmap *value)
 {
 	guardDisposed();
 
+	ScreenDamage::mark();
+
 	p->windowskin = value;
 
 	if (nullOrDisposed(value))
@@ -733,6 +740,8 @@ void Window::setContents(Bitmap *value)
 	if (p->contents == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->contents = value;
 	p->controlsVertDirty = true;
 
@@ -750,6 +759,8 @@ void Window::setStretch(bool value)
 	if (value == p->bgStretch)
 		return;
 
+	ScreenDamage::mark();
+
 	p->bgStretch = value;
 	p->baseVertDirty = true;
 }
@@ -761,6 +772,8 @@ void Window::setActive(bool value)
 	if (p->active == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->active = value;
 	p->cursorAniAlphaIdx = 0;
 }
@@ -772,6 +785,8 @@ void Window::setPause(bool value)
 	if (p->pause == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->pause = value;
 	p->pauseAniAlphaIdx = 0;
 	p->pauseAniQuadIdx = 0;
@@ -785,6 +800,8 @@ void Window::setWidth(int value)
 	if (p->size.x == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->size.x = value;
 	p->baseVertDirty = true;
 }
@@ -796,6 +813,8 @@ void Window::setHeight(int value)
 	if (p->size.y == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->size.y = value;
 	p->baseVertDirty = true;
 }
@@ -807,6 +826,8 @@ void Window::setOX(int value)
 	if (p->contentsOffset.x == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->contentsOffset.x = value;
 	p->controlsVertDirty = true;
 }
@@ -818,6 +839,8 @@ void Window::setOY(int value)
 	if (p->contentsOffset.y == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->contentsOffset.y = value;
 	p->controlsVertDirty = true;
 }
@@ -829,6 +852,8 @@ void Window::setOpacity(int value)
 	if (p->opacity == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->opacity = value;
 	p->opacityDirty = true;
 }
@@ -840,6 +865,8 @@ void Window::setBackOpacity(int value)
 	if (p->backOpacity == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->backOpacity = value;
 	p->opacityDirty = true;
 }
@@ -851,6 +878,8 @@ void Window::setContentsOpacity(int value)
 	if (p->contentsOpacity == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->contentsOpacity = value;
 	p->contentsQuad.setColor(Vec4(1, 1, 1, p->contentsOpacity.norm));
 }
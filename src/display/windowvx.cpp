@@ -31,6 +31,7 @@
 #include "tilequad.h"
 #include "glstate.h"
 #include "shader.h"
+#include "screendamage.h"
 
 #include <limits>
 #include <algorithm>
@@ -841,6 +842,9 @@ void WindowVX::update()
 
 	p->updatePauseQuad();
 	p->updateCursorAlpha();
+
+	if ((p->active && !p->cursorRect->isEmpty()) || p->pause)
+		ScreenDamage::mark();
 }
 
 void WindowVX::move(int x, int y, int width, int height)
@@ -862,6 +866,8 @@ void WindowVX::move(int x, int y, int width, int height)
 
 	p->geo = IntRect(Vec2i(x, y), size);
 	p->updateBaseQuad();
+
+	ScreenDamage::mark();
 }
 
 bool WindowVX::isOpen() const
@@ -878,10 +884,10 @@ bool WindowVX::isClosed() const
 	return p->openness == 0;
 }
 
-DEF_ATTR_SIMPLE(WindowVX, X,          int,     p->geo.x)
-DEF_ATTR_SIMPLE(WindowVX, Y,          int,     p->geo.y)
-DEF_ATTR_SIMPLE(WindowVX, CursorRect, Rect&,  *p->cursorRect)
-DEF_ATTR_SIMPLE(WindowVX, Tone,       Tone&,  *p->tone)
+DEF_ATTR_SIMPLE_DAMAGE(WindowVX, X,          int,     p->geo.x)
+DEF_ATTR_SIMPLE_DAMAGE(WindowVX, Y,          int,     p->geo.y)
+DEF_ATTR_SIMPLE_DAMAGE(WindowVX, CursorRect, Rect&,  *p->cursorRect)
+DEF_ATTR_SIMPLE_DAMAGE(WindowVX, Tone,       Tone&,  *p->tone)
 
 DEF_ATTR_RD_SIMPLE(WindowVX, Windowskin,      Bitmap*, p->windowskin)
 DEF_ATTR_RD_SIMPLE(WindowVX, Contents,        Bitmap*, p->contents)
@@ -906,6 +912,8 @@ void WindowVX::setWindowskin(Bitmap *value)
 	if (p->windowskin == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->windowskin = value;
 	p->base.texDirty = true;
 }
@@ -917,6 +925,8 @@ void WindowVX::setContents(Bitmap *value)
 	if (p->contents == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->contents = value;
 
 	if (nullOrDisposed(value))
@@ -934,6 +944,8 @@ void WindowVX::setActive(bool value)
 	if (p->active == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->active = value;
 	p->cursorAlphaIdx = cursorAlphaResetIdx;
 	p->updateCursorAlpha();
@@ -946,6 +958,8 @@ void WindowVX::setArrowsVisible(bool value)
 	if (p->arrowsVisible == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->arrowsVisible = value;
 	p->ctrlVertDirty = true;
 }
@@ -957,6 +971,8 @@ void WindowVX::setPause(bool value)
 	if (p->pause == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->pause = value;
 	p->pauseAlphaIdx = 0;
 	p->pauseQuadIdx = 0;
@@ -970,6 +986,8 @@ void WindowVX::setWidth(int value)
 	if (p->width == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->width = value;
 	p->geo.w = std::max(0, value);
 	p->base.vertDirty = true;
@@ -986,6 +1004,8 @@ void WindowVX::setHeight(int value)
 	if (p->height == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->height = value;
 	p->geo.h = std::max(0, value);
 	p->base.vertDirty = true;
@@ -1002,6 +1022,8 @@ void WindowVX::setOX(int value)
 	if (p->contentsOff.x == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->contentsOff.x = value;
 	p->ctrlVertDirty = true;
 }
@@ -1013,6 +1035,8 @@ void WindowVX::setOY(int value)
 	if (p->contentsOff.y == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->contentsOff.y = value;
 	p->ctrlVertDirty = true;
 }
@@ -1024,6 +1048,8 @@ void WindowVX::setPadding(int value)
 	if (p->padding == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->padding = value;
 	p->paddingBottom = value;
 	p->clipRectDirty = true;
@@ -1036,6 +1062,8 @@ void WindowVX::setPaddingBottom(int value)
 	if (p->paddingBottom == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->paddingBottom = value;
 	p->clipRectDirty = true;
 }
@@ -1047,6 +1075,8 @@ void WindowVX::setOpacity(int value)
 	if (p->opacity == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->opacity = value;
 	p->base.quad.setColor(Vec4(1, 1, 1, p->opacity.norm));
 }
@@ -1058,6 +1088,8 @@ void WindowVX::setBackOpacity(int value)
 	if (p->backOpacity == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->backOpacity = value;
 	p->base.texDirty = true;
 }
@@ -1069,6 +1101,8 @@ void WindowVX::setContentsOpacity(int value)
 	if (p->contentsOpacity == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->contentsOpacity = value;
 	p->contentsQuad.setColor(Vec4(1, 1, 1, p->contentsOpacity.norm));
 }
@@ -1080,6 +1114,8 @@ void WindowVX::setOpenness(int value)
 	if (p->openness == value)
 		return;
 
+	ScreenDamage::mark();
+
 	p->openness = value;
 	p->updateBaseQuad();
 }
@@ -23,6 +23,7 @@
 
 #include "serial-util.h"
 #include "exception.h"
+#include "screendamage.h"
 
 #include <SDL_types.h>
 #include <SDL_pixels.h>
@@ -60,6 +61,8 @@ const Color &Color::operator=(const Color &o)
 	alpha = o.alpha;
 	norm  = o.norm;
 
+	ScreenDamage::mark();
+
 	return o;
 }
 
@@ -71,30 +74,35 @@ void Color::set(double red, double green, double blue, double alpha)
 	this->alpha = alpha;
 
 	updateInternal();
+	ScreenDamage::mark();
 }
 
 void Color::setRed(double value)
 {
 	red = value;
 	norm.x = clamp<double>(value, 0, 255) / 255;
+	ScreenDamage::mark();
 }
 
 void Color::setGreen(double value)
 {
 	green = value;
 	norm.y = clamp<double>(value, 0, 255) / 255;
+	ScreenDamage::mark();
 }
 
 void Color::setBlue(double value)
 {
 	blue = value;
 	norm.z = clamp<double>(value, 0, 255) / 255;
+	ScreenDamage::mark();
 }
 
 void Color::setAlpha(double value)
 {
 	alpha = value;
 	norm.w = clamp<double>(value, 0, 255) / 255;
+	ScreenDamage::mark();
 }
 
 /* Serializable */
@@ -183,6 +191,7 @@ void Tone::set(double red, double green, double blue, double gray)
 
 	updateInternal();
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 const Tone& Tone::operator=(const Tone &o)
@@ -194,6 +203,7 @@ const Tone& Tone::operator=(const Tone &o)
 	norm  = o.norm;
 
 	valueChanged();
+	ScreenDamage::mark();
 
 	return o;
 }
@@ -204,6 +214,7 @@ void Tone::setRed(double value)
 	norm.x = (float) clamp<double>(value, -255, 255) / 255;
 
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 void Tone::setGreen(double value)
@@ -212,6 +223,7 @@ void Tone::setGreen(double value)
 	norm.y = (float) clamp<double>(value, -255, 255) / 255;
 
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 void Tone::setBlue(double value)
@@ -220,6 +232,7 @@ void Tone::setBlue(double value)
 	norm.z = (float) clamp<double>(value, -255, 255) / 255;
 
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 void Tone::setGray(double value)
@@ -228,6 +241,7 @@ void Tone::setGray(double value)
 	norm.w = (float) clamp<double>(value, 0, 255) / 255;
 
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 /* Serializable */
@@ -313,6 +327,7 @@ void Rect::set(int x, int y, int w, int h)
 	width = w;
 	height = h;
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 const Rect &Rect::operator=(const Rect &o)
@@ -323,6 +338,7 @@ const Rect &Rect::operator=(const Rect &o)
 	height = o.height;
 
 	valueChanged();
+	ScreenDamage::mark();
 
 	return o;
 }
@@ -334,6 +350,7 @@ void Rect::empty()
 
 	x = y = width = height = 0;
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 bool Rect::isEmpty() const
@@ -348,6 +365,7 @@ void Rect::setX(int value)
 
 	x = value;
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 void Rect::setY(int value)
@@ -357,6 +375,7 @@ void Rect::setY(int value)
 
 	y = value;
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 void Rect::setWidth(int value)
@@ -366,6 +385,7 @@ void Rect::setWidth(int value)
 
 	width = value;
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 void Rect::setHeight(int value)
@@ -375,6 +395,7 @@ void Rect::setHeight(int value)
 
 	height = value;
 	valueChanged();
+	ScreenDamage::mark();
 }
 
 int Rect::serialSize() const
@@ -55,7 +55,7 @@ void Table::set(int16_t value, int x, int y, int z)
 
 	data[xs*ys*z + xs*y + x] = value;
 
-	modified();
+	notifyModified(IntRect(x, y, 1, 1));
 }
 
 void Table::resize(int x, int y, int z)
@@ -89,6 +89,131 @@ void Table::resize(int x)
 	resize(x, ys, zs);
 }
 
+/* Clips 'area' (in x/y) to a table of w * h cells; returns false if
+ * nothing is left. Any offset applied to its position is added to
+ * 'offX'/'offY' if given */
+static bool clipArea(IntRect &area, int w, int h, int *offX = 0, int *offY = 0)
+{
+	int x1 = std::max(area.x, 0);
+	int y1 = std::max(area.y, 0);
+	int x2 = std::min(area.x + area.w, w);
+	int y2 = std::min(area.y + area.h, h);
+
+	if (x1 >= x2 || y1 >= y2)
+		return false;
+
+	if (offX)
+		*offX += x1 - area.x;
+	if (offY)
+		*offY += y1 - area.y;
+
+	area = IntRect(x1, y1, x2 - x1, y2 - y1);
+
+	return true;
+}
+
+void Table::fill(int16_t value, const IntRect &area, int z, int zCount)
+{
+	IntRect clipped = area;
+
+	const int z1 = std::max(z, 0);
+	const int z2 = std::min(z + zCount, zs);
+
+	if (!clipArea(clipped, xs, ys) || z1 >= z2)
+		return;
+
+	for (int k = z1; k < z2; ++k)
+	{
+		/* Whole rows are contiguous, so go layer at a time */
+		if (clipped.w == xs)
+		{
+			std::fill_n(&at(0, clipped.y, k), xs*clipped.h, value);
+			continue;
+		}
+
+		for (int j = clipped.y; j < clipped.y + clipped.h; ++j)
+			std::fill_n(&at(clipped.x, j, k), clipped.w, value);
+	}
+
+	notifyModified(clipped);
+}
+
+void Table::copyFrom(const Table &other, const IntRect &srcArea,
+                     int dstX, int dstY)
+{
+	IntRect src = srcArea;
+
+	/* Clip to the source, moving the destination along,
+	 * and then to the destination, moving the source */
+	if (!clipArea(src, other.xs, other.ys, &dstX, &dstY))
+		return;
+
+	IntRect dst(dstX, dstY, src.w, src.h);
+	int srcX = src.x;
+	int srcY = src.y;
+
+	if (!clipArea(dst, xs, ys, &srcX, &srcY))
+		return;
+
+	const int zCount = std::min(zs, other.zs);
+	const size_t rowBytes = dst.w * sizeof(int16_t);
+
+	/* Copying within the same table, rows may overlap; walk
+	 * them bottom up when moving down so none is clobbered
+	 * before it's read (memmove covers the horizontal case) */
+	const bool reverse = (&other == this && dst.y > srcY);
+
+	for (int k = 0; k < zCount; ++k)
+		for (int i = 0; i < dst.h; ++i)
+		{
+			const int j = reverse ? dst.h - 1 - i : i;
+
+			memmove(&at(dst.x, dst.y + j, k),
+			        &other.at(srcX, srcY + j, k), rowBytes);
+		}
+
+	notifyModified(dst);
+}
+
+int Table::rawSize() const
+{
+	return xs * ys * zs * sizeof(int16_t);
+}
+
+void Table::getRaw(void *output, int outputSize) const
+{
+	if (outputSize != rawSize())
+		throw Exception(Exception::ArgumentError,
+		                "Table data size mismatch (given %d bytes, need %d)",
+		                outputSize, rawSize());
+
+	if (outputSize == 0)
+		return;
+
+	memcpy(output, dataPtr(data), outputSize);
+}
+
+void Table::replaceRaw(const void *input, int inputSize)
+{
+	if (inputSize != rawSize())
+		throw Exception(Exception::ArgumentError,
+		                "Table data size mismatch (given %d bytes, need %d)",
+		                inputSize, rawSize());
+
+	if (inputSize == 0)
+		return;
+
+	memcpy(dataPtr(data), input, inputSize);
+
+	notifyModified(IntRect(0, 0, xs, ys));
+}
+
+void Table::notifyModified(const IntRect &area)
+{
+	modified();
+	modifiedArea(area);
+}
+
 /* Serializable */
 int Table::serialSize() const
 {
@@ -23,6 +23,7 @@
 #define TABLE_H
 
 #include "serializable.h"
+#include "etc-internal.h"
 
 #include <stdint.h>
 #include "sigslot/signal.hpp"
@@ -47,6 +48,22 @@ public:
 	void resize(int x, int y);
 	void resize(int x);
 
+	/* Bulk operations. Areas are clipped to the table, and
+	 * each call emits a single change notice */
+
+	/* Sets the cells of 'area' in layers [z, z+zCount) */
+	void fill(int16_t value, const IntRect &area, int z, int zCount);
+
+	/* Copies 'srcArea' of all layers 'other' and this table
+	 * have in common to dstX/dstY. 'other' may be this table */
+	void copyFrom(const Table &other, const IntRect &srcArea,
+	              int dstX, int dstY);
+
+	/* All cells as native endian int16, x fastest, then y, then z */
+	int rawSize() const;
+	void getRaw(void *output, int outputSize) const;
+	void replaceRaw(const void *input, int inputSize);
+
 	int serialSize() const;
 	void serialize(char *buffer) const;
 	static Table *deserialize(const char *data, int len);
@@ -62,9 +79,18 @@ public:
 		return data[xs*ys*z + xs*y + x];
 	}
 
+	/* Emitted on every change */
     sigslot::signal<> modified;
 
+	/* Emitted right after 'modified', with the x/y extent
+	 * (spanning all z layers) of the cells that changed.
+	 * Lets users like tilemaps update only what's affected */
+	sigslot::signal<const IntRect&> modifiedArea;
+
 private:
+	void notifyModified(const IntRect &area);
+
+
 	int xs, ys, zs;
 	std::vector<int16_t> data;
 };
@@ -0,0 +1,304 @@
+/*
+** datawriter.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "datawriter.h"
+
+#include "writequeue.h"
+#include "exception.h"
+
+#include <zlib.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __WIN32__
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Followed by the inflated size (32 bit, little endian) */
+static const char compressMagic[4] = { 'M', 'K', 'X', 'Z' };
+#define COMPRESS_HEADER_SIZE 8
+
+#ifdef __WIN32__
+static std::wstring widePath(const std::string &path)
+{
+	int len = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, 0, 0);
+	std::wstring out(len > 0 ? len : 1, 0);
+
+	if (len > 0)
+		MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &out[0], len);
+
+	return out;
+}
+#endif
+
+static void removeFile(const std::string &path)
+{
+#ifdef __WIN32__
+	_wremove(widePath(path).c_str());
+#else
+	remove(path.c_str());
+#endif
+}
+
+static FILE *openFile(const std::string &path)
+{
+#ifdef __WIN32__
+	return _wfopen(widePath(path).c_str(), L"wb");
+#else
+	return fopen(path.c_str(), "wb");
+#endif
+}
+
+/* Makes sure everything written to 'f' actually hit the disk */
+static bool syncFile(FILE *f)
+{
+	if (fflush(f) != 0)
+		return false;
+
+#ifdef __WIN32__
+	return _commit(_fileno(f)) == 0;
+#else
+	return fsync(fileno(f)) == 0;
+#endif
+}
+
+static bool replaceFile(const std::string &from, const std::string &to)
+{
+#ifdef __WIN32__
+	return MoveFileExW(widePath(from).c_str(), widePath(to).c_str(),
+	                   MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	if (rename(from.c_str(), to.c_str()) != 0)
+		return false;
+
+	/* Persist the rename itself; failing that isn't fatal, the
+	 * data is safe either way */
+	size_t slash = to.find_last_of('/');
+	std::string dir = (slash == std::string::npos) ? "." : to.substr(0, slash+1);
+
+	int fd = open(dir.c_str(), O_RDONLY);
+
+	if (fd >= 0)
+	{
+		fsync(fd);
+		close(fd);
+	}
+
+	return true;
+#endif
+}
+
+/* The errno matching why replaceFile() failed;
+ * MoveFileExW reports its errors through GetLastError() */
+static int replaceErrno()
+{
+#ifdef __WIN32__
+	switch (GetLastError())
+	{
+	case ERROR_ACCESS_DENIED:
+	case ERROR_SHARING_VIOLATION:
+		return EACCES;
+	case ERROR_FILE_NOT_FOUND:
+	case ERROR_PATH_NOT_FOUND:
+		return ENOENT;
+	case ERROR_DISK_FULL:
+	case ERROR_HANDLE_DISK_FULL:
+		return ENOSPC;
+	default:
+		return EIO;
+	}
+#else
+	return errno;
+#endif
+}
+
+static bool compressData(std::string &data)
+{
+	uLongf destLen = compressBound(data.size());
+	std::string out(COMPRESS_HEADER_SIZE + destLen, 0);
+
+	memcpy(&out[0], compressMagic, sizeof(compressMagic));
+
+	uint32_t size = data.size();
+	for (int i = 0; i < 4; ++i)
+		out[4+i] = (char) ((size >> (i*8)) & 0xFF);
+
+	int rc = compress2((Bytef*) &out[COMPRESS_HEADER_SIZE], &destLen,
+	                   (const Bytef*) data.c_str(), data.size(), Z_DEFAULT_COMPRESSION);
+
+	if (rc != Z_OK)
+		return false;
+
+	out.resize(COMPRESS_HEADER_SIZE + destLen);
+	data.swap(out);
+
+	return true;
+}
+
+struct DataJob : QueuedJob
+{
+	std::string path;
+	std::string data;
+	bool compress;
+
+	DataJob(const std::string &path, bool compress)
+	    : path(path),
+	      compress(compress)
+	{}
+
+	void run()
+	{
+		if (compress && !compressData(data))
+		{
+			failed = true;
+			error = "Failed to compress data for " + path;
+		}
+		else if (DataWriter::writeFile(data.c_str(), data.size(), path.c_str(), error) != 0)
+			failed = true;
+
+		std::string().swap(data);
+	}
+};
+
+struct DataWriterPrivate
+{
+	WriteQueue queue;
+
+	DataWriterPrivate()
+	    : queue("datawrite")
+	{}
+};
+
+DataWriter::DataWriter()
+{
+	p = new DataWriterPrivate;
+}
+
+DataWriter::~DataWriter()
+{
+	delete p;
+}
+
+int DataWriter::save(std::string &data, const std::string &path, bool compress)
+{
+	DataJob *job = new DataJob(path, compress);
+	job->data.swap(data);
+
+	int handle = p->queue.add(job);
+	p->queue.enqueue(job);
+
+	return handle;
+}
+
+bool DataWriter::finished(int handle)
+{
+	bool failed;
+	std::string error;
+
+	if (!p->queue.finished(handle, failed, error))
+		return false;
+
+	if (failed)
+		throw Exception(Exception::IOError, "%s", error.c_str());
+
+	return true;
+}
+
+void DataWriter::waitAll()
+{
+	p->queue.waitAll();
+}
+
+int DataWriter::writeFile(const char *data, size_t size, const char *path,
+                          std::string &error)
+{
+	const std::string target(path);
+	const std::string tmpPath = target + ".tmp";
+
+	FILE *f = openFile(tmpPath);
+
+	if (!f)
+	{
+		int err = errno ? errno : EIO;
+		error = std::string("Failed to open ") + target + ": " + strerror(err);
+
+		return err;
+	}
+
+	/* A short write doesn't always set errno */
+	errno = 0;
+
+	bool ok = fwrite(data, 1, size, f) == size;
+	ok = syncFile(f) && ok;
+	ok = (fclose(f) == 0) && ok;
+
+	if (!ok)
+	{
+		int err = errno ? errno : EIO;
+		error = std::string("Failed to write ") + target + ": " + strerror(err);
+		removeFile(tmpPath);
+
+		return err;
+	}
+
+	if (!replaceFile(tmpPath, target))
+	{
+		int err = replaceErrno();
+		error = std::string("Failed to replace ") + target + ": " + strerror(err);
+		removeFile(tmpPath);
+
+		return err;
+	}
+
+	return 0;
+}
+
+bool DataWriter::compressed(const char *data, size_t size)
+{
+	return size >= COMPRESS_HEADER_SIZE
+	    && memcmp(data, compressMagic, sizeof(compressMagic)) == 0;
+}
+
+bool DataWriter::decompress(const char *data, size_t size, std::string &out)
+{
+	if (!compressed(data, size))
+		return false;
+
+	uint32_t inflated = 0;
+	for (int i = 0; i < 4; ++i)
+		inflated |= (uint32_t) (uint8_t) data[4+i] << (i*8);
+
+	out.resize(inflated);
+	uLongf destLen = inflated;
+
+	int rc = uncompress((Bytef*) (inflated ? &out[0] : 0), &destLen,
+	                    (const Bytef*) data + COMPRESS_HEADER_SIZE,
+	                    size - COMPRESS_HEADER_SIZE);
+
+	return rc == Z_OK && destLen == inflated;
+}
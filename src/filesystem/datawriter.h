@@ -0,0 +1,73 @@
+/*
+** datawriter.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATAWRITER_H
+#define DATAWRITER_H
+
+#include <string>
+#include <stddef.h>
+
+struct DataWriterPrivate;
+
+/* Writes serialized data (save files) on a worker thread.
+ * Files are replaced atomically: the data goes into a temporary
+ * file next to the target, which is synced to disk and then
+ * renamed over it, so a crash mid-write leaves the previous
+ * version intact. Writes happen in the order they were queued.
+ * Every write is identified by a handle to poll for its result */
+class DataWriter
+{
+public:
+	DataWriter();
+	~DataWriter();
+
+	/* Queues 'data' to be written to 'path'. The contents of 'data'
+	 * are taken over (it is left empty). With 'compress', the data
+	 * is deflated first, see compressed() */
+	int save(std::string &data, const std::string &path, bool compress);
+
+	/* Returns false while 'handle' is still being written. Once it's
+	 * done, returns true (or throws if writing failed) and forgets
+	 * about the handle; unknown handles count as done. Only the
+	 * results of the latest writes are kept until polled */
+	bool finished(int handle);
+
+	/* Blocks until every queued write is on disk */
+	void waitAll();
+
+	/* Atomically replaces 'path' with 'size' bytes of 'data'. Thread
+	 * safe; returns 0, or on failure the errno value of the call that
+	 * failed, with 'error' describing it */
+	static int writeFile(const char *data, size_t size, const char *path,
+	                     std::string &error);
+
+	/* Whether 'data' was written compressed (it starts with a small
+	 * header, which Marshal data never does) */
+	static bool compressed(const char *data, size_t size);
+
+	/* Inflates compressed 'data' into 'out'. Returns false if it is corrupt */
+	static bool decompress(const char *data, size_t size, std::string &out);
+
+private:
+	DataWriterPrivate *p;
+};
+
+#endif // DATAWRITER_H
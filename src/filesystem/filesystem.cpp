@@ -33,8 +33,9 @@
 
 #include <physfs.h>
 
+#include <SDL_mutex.h>
+
 #include <algorithm>
-#include <stack>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -271,13 +272,17 @@ struct FileSystemPrivate {
   /* Maps: lower case full filepath,
    * To:   mixed case full filepath */
   BoostHash<std::string, std::string> pathCache;
-  /* Maps: lower case directory path,
-   * To:   list of lower case filenames */
-  BoostHash<std::string, std::vector<std::string>> fileLists;
+  /* Maps: lower case full filepath, with or without extension(s),
+   * To:   lower case full filepaths it can open, in search path order */
+  BoostHash<std::string, std::vector<std::string>> stemIndex;
 
   /* This is for compatibility with games that take Windows'
    * case insensitivity for granted */
   bool havePathCache;
+
+  /* Guards the cache tables, as files may be
+   * opened from image decoding threads */
+  SDL_mutex *cacheLock;
 };
 
 static void throwPhysfsError(const char *desc) {
@@ -294,7 +299,7 @@ static void throwPhysfsError(const char *desc) {
   throw Exception(Exception::PHYSFSError, "%s: %s", desc, englishStr);
 }
 
-FileSystem::FileSystem(const char *argv0, bool allowSymlinks) {
+FileSystem::FileSystem(const char *argv0, bool allowSymlinks, bool mmapArchives) {
   if (PHYSFS_init(argv0) == 0)
     throwPhysfsError("Error initializing PhysFS");
 
@@ -309,14 +314,18 @@ FileSystem::FileSystem(const char *argv0, bool allowSymlinks) {
   if (er == 0)
     throwPhysfsError("Error registering PhysFS RGSS archiver");
 
+  RGSS_setUseMmap(mmapArchives);
+
   p = new FileSystemPrivate;
   p->havePathCache = false;
+  p->cacheLock = SDL_CreateMutex();
 
   if (allowSymlinks)
     PHYSFS_permitSymbolicLinks(1);
 }
 
 FileSystem::~FileSystem() {
+  SDL_DestroyMutex(p->cacheLock);
   delete p;
 
   if (PHYSFS_deinit() == 0)
@@ -354,7 +363,10 @@ void FileSystem::removePath(const char *path, bool reload) {
 
 struct CacheEnumData {
   FileSystemPrivate *p;
-  std::stack<std::vector<std::string> *> fileLists;
+
+  /* Directories present in several search path entries
+   * are reported once per entry; only walk them once */
+  BoostSet<std::string> visitedDirs;
 
 #ifdef __APPLE__
   iconv_t nfd2nfc;
@@ -415,21 +427,31 @@ static PHYSFS_EnumerateCallbackResult cacheEnumCB(void *d, const char *origdir,
   PHYSFS_stat(fullPath, &stat);
 
   if (stat.filetype == PHYSFS_FILETYPE_DIRECTORY) {
-    /* Create a new list for this directory */
-    std::vector<std::string> &list = data.p->fileLists[lowerCase];
+    if (data.visitedDirs.contains(mixedCase))
+      return PHYSFS_ENUM_OK;
+
+    data.visitedDirs.insert(mixedCase);
 
     /* Iterate over its contents */
-    data.fileLists.push(&list);
     PHYSFS_enumerate(fullPath, cacheEnumCB, d);
-    data.fileLists.pop();
   } else {
-    /* Get the file list for the directory we're currently
-     * traversing and append this filename to it */
-    std::vector<std::string> &list = *data.fileLists.top();
+    /* Files are reported in search path order, so the first
+     * one seen under a name is the one PhysFS would open */
+    if (data.p->pathCache.contains(lowerCase))
+      return PHYSFS_ENUM_OK;
+
+    /* Index the file under every name it can be opened by:
+     * its full name, and each prefix ending before a '.'
+     * (so "Graphics/a.b.png" is found as "graphics/a",
+     * "graphics/a.b" and "graphics/a.b.png") */
+    size_t nameStart = lowerCase.rfind('/');
+    nameStart = (nameStart == std::string::npos) ? 0 : nameStart + 1;
+
+    for (size_t i = nameStart + 1; i < lowerCase.size(); ++i)
+      if (lowerCase[i] == '.')
+        data.p->stemIndex[lowerCase.substr(0, i)].push_back(lowerCase);
 
-    std::string lowerFilename(fname);
-    strTolower(lowerFilename);
-    list.push_back(lowerFilename);
+    data.p->stemIndex[lowerCase].push_back(lowerCase);
 
     /* Add the lower -> mixed mapping of the file's full path */
     data.p->pathCache.insert(lowerCase, mixedCase);
@@ -439,19 +461,24 @@ static PHYSFS_EnumerateCallbackResult cacheEnumCB(void *d, const char *origdir,
 }
 
 void FileSystem::createPathCache() {
+  SDL_LockMutex(p->cacheLock);
+
   CacheEnumData data(p);
-  data.fileLists.push(&p->fileLists[""]);
   PHYSFS_enumerate("", cacheEnumCB, &data);
 
   p->havePathCache = true;
+
+  SDL_UnlockMutex(p->cacheLock);
 }
 
 void FileSystem::reloadPathCache() {
     if (!p->havePathCache) return;
     
-    p->fileLists.clear();
+    SDL_LockMutex(p->cacheLock);
+    p->stemIndex.clear();
     p->pathCache.clear();
     createPathCache();
+    SDL_UnlockMutex(p->cacheLock);
 }
 
 struct FontSetsCBData {
@@ -523,31 +550,16 @@ void FileSystem::initFontSets(SharedFontState &sfs) {
 }
 
 struct OpenReadEnumData {
-  FileSystem::OpenHandler &handler;
-  SDL_RWops ops;
-
   /* The filename (without directory) we're looking for */
   const char *filename;
   size_t filenameN;
 
-  /* Optional hash to translate full filepaths
-   * (used with path cache) */
-  BoostHash<std::string, std::string> *pathTrans;
+  /* Full paths of all matching files, in search order */
+  std::vector<std::string> &matches;
 
-  /* Number of files we've attempted to read and parse */
-  size_t matchCount;
-  bool stopSearching;
-
-  /* In case of a PhysFS error, save it here so it
-   * doesn't get changed before we get back into our code */
-  const char *physfsError;
-
-  OpenReadEnumData(FileSystem::OpenHandler &handler, const char *filename,
-                   size_t filenameN,
-                   BoostHash<std::string, std::string> *pathTrans)
-      : handler(handler), filename(filename), filenameN(filenameN),
-        pathTrans(pathTrans), matchCount(0), stopSearching(false),
-        physfsError(0) {}
+  OpenReadEnumData(const char *filename, size_t filenameN,
+                   std::vector<std::string> &matches)
+      : filename(filename), filenameN(filenameN), matches(matches) {}
 };
 
 static PHYSFS_EnumerateCallbackResult
@@ -556,20 +568,10 @@ openReadEnumCB(void *d, const char *dirpath, const char *filename) {
   char buffer[512];
   const char *fullPath;
 
-  if (data.stopSearching)
-    return PHYSFS_ENUM_STOP;
-
   /* If there's not even a partial match, continue searching */
   if (strncmp(filename, data.filename, data.filenameN) != 0)
     return PHYSFS_ENUM_OK;
 
-  if (!*dirpath) {
-    fullPath = filename;
-  } else {
-    snprintf(buffer, sizeof(buffer), "%s/%s", dirpath, filename);
-    fullPath = buffer;
-  }
-
   char last = filename[data.filenameN];
   /* If fname matches up to a following '.' (meaning the rest is part
    * of the extension), or up to a following '\0' (full match), we've
@@ -577,78 +579,97 @@ openReadEnumCB(void *d, const char *dirpath, const char *filename) {
   if (last != '.' && last != '\0')
     return PHYSFS_ENUM_OK;
 
-  /* If the path cache is active, translate from lower case
-   * to mixed case path */
-  if (data.pathTrans)
-    fullPath = (*data.pathTrans)[fullPath].c_str();
-
-  PHYSFS_File *phys = PHYSFS_openRead(fullPath);
-
-  if (!phys) {
-    /* Failing to open this file here means there must
-     * be a deeper rooted problem somewhere within PhysFS.
-     * Just abort alltogether. */
-    data.stopSearching = true;
-    data.physfsError = PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
-
-    return PHYSFS_ENUM_ERROR;
+  if (!*dirpath) {
+    fullPath = filename;
+  } else {
+    snprintf(buffer, sizeof(buffer), "%s/%s", dirpath, filename);
+    fullPath = buffer;
   }
-  initReadOps(phys, data.ops, false);
-
-  const char *ext = findExt(filename);
 
-  if (data.handler.tryRead(data.ops, ext))
-    data.stopSearching = true;
+  data.matches.push_back(fullPath);
 
-  ++data.matchCount;
   return PHYSFS_ENUM_OK;
 }
 
-void FileSystem::openRead(OpenHandler &handler, const char *filename) {
+bool FileSystem::tryOpenRead(OpenHandler &handler, const char *filename) {
   std::string filename_nm = normalize(filename, false, false);
   char buffer[512];
   size_t len = strcpySafe(buffer, filename_nm.c_str(), sizeof(buffer), -1);
-  char *delim;
 
-  if (p->havePathCache)
+  /* Full paths of all matching files, in search order */
+  std::vector<std::string> matches;
+
+  if (p->havePathCache) {
     for (size_t i = 0; i < len; ++i)
       buffer[i] = tolower(buffer[i]);
 
-  /* Find the deliminator separating directory and file name */
-  for (delim = buffer + len; delim > buffer; --delim)
-    if (*delim == '/')
-      break;
-
-  const bool root = (delim == buffer);
+    /* Only collect candidates while looking at the cache;
+     * opening and parsing happens without holding the lock */
+    SDL_LockMutex(p->cacheLock);
 
-  const char *file = buffer;
-  const char *dir = "";
+    const std::string stem(buffer, len);
 
-  if (!root) {
-    /* Cut the buffer in half so we can use it
-     * for both filename and directory path */
-    *delim = '\0';
-    file = delim + 1;
-    dir = buffer;
-  }
-  OpenReadEnumData data(handler, file, len + buffer - delim - !root,
-                        p->havePathCache ? &p->pathCache : 0);
+    if (p->stemIndex.contains(stem)) {
+      const std::vector<std::string> &candidates = p->stemIndex[stem];
 
-  if (p->havePathCache) {
-    /* Get the list of files contained in this directory
-     * and manually iterate over them */
-    const std::vector<std::string> &fileList = p->fileLists[dir];
+      /* Translate from lower case to mixed case path */
+      for (size_t i = 0; i < candidates.size(); ++i)
+        matches.push_back(p->pathCache.value(candidates[i]));
+    }
 
-    for (size_t i = 0; i < fileList.size(); ++i)
-      openReadEnumCB(&data, dir, fileList[i].c_str());
+    SDL_UnlockMutex(p->cacheLock);
   } else {
+    /* Find the deliminator separating directory and file name */
+    char *delim;
+    for (delim = buffer + len; delim > buffer; --delim)
+      if (*delim == '/')
+        break;
+
+    const bool root = (delim == buffer);
+
+    const char *file = buffer;
+    const char *dir = "";
+
+    if (!root) {
+      /* Cut the buffer in half so we can use it
+       * for both filename and directory path */
+      *delim = '\0';
+      file = delim + 1;
+      dir = buffer;
+    }
+
+    OpenReadEnumData data(file, len + buffer - delim - !root, matches);
     PHYSFS_enumerate(dir, openReadEnumCB, &data);
   }
 
-  if (data.physfsError)
-    throw Exception(Exception::PHYSFSError, "PhysFS: %s", data.physfsError);
+  for (size_t i = 0; i < matches.size(); ++i) {
+    const char *fullPath = matches[i].c_str();
+
+    if (handler.tryPath(fullPath))
+      break;
+
+    PHYSFS_File *phys = PHYSFS_openRead(fullPath);
+
+    if (!phys) {
+      /* Failing to open this file here means there must
+       * be a deeper rooted problem somewhere within PhysFS.
+       * Just abort alltogether. */
+      throw Exception(Exception::PHYSFSError, "PhysFS: %s",
+                      PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+    }
+
+    SDL_RWops ops;
+    initReadOps(phys, ops, false);
 
-  if (data.matchCount == 0)
+    if (handler.tryRead(ops, findExt(fullPath)))
+      break;
+  }
+
+  return !matches.empty();
+}
+
+void FileSystem::openRead(OpenHandler &handler, const char *filename) {
+  if (!tryOpenRead(handler, filename))
     throw Exception(Exception::NoFileError, "%s", filename);
 }
 
@@ -36,7 +36,8 @@ class FileSystem
 {
 public:
 	FileSystem(const char *argv0,
-	           bool allowSymlinks);
+	           bool allowSymlinks,
+	           bool mmapArchives);
 	~FileSystem();
 
 	void addPath(const char *path, const char *mountpoint = 0, bool reload = false);
@@ -62,11 +63,25 @@ public:
 		 * references to it. Instead, copy the structure without closing
 		 * if you need to further read from it later. */
 		virtual bool tryRead(SDL_RWops &ops, const char *ext) = 0;
+
+		/* Called with the resolved path of each candidate before
+		 * it is opened. Return true to accept the candidate
+		 * without reading it (eg. when it is already cached) */
+		virtual bool tryPath(const char *fullPath)
+		{
+			(void) fullPath;
+			return false;
+		}
 	};
 
 	void openRead(OpenHandler &handler,
 	              const char *filename);
 
+	/* Same as above, but returns false instead of
+	 * throwing if no matching file exists */
+	bool tryOpenRead(OpenHandler &handler,
+	                 const char *filename);
+
 	/* Circumvents extension supplementing */
 	void openReadRaw(SDL_RWops &ops,
 	                 const char *filename,
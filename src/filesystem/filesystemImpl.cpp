@@ -27,6 +27,47 @@ bool filesystemImpl::fileExists(const char *path) {
     return (fs::exists(stdPath) && !fs::is_directory(stdPath));
 }
 
+bool filesystemImpl::createDirectory(const char *path) {
+    fs::path stdPath(path);
+    std::error_code ec;
+    fs::create_directories(stdPath, ec);
+    return fs::is_directory(stdPath, ec);
+}
+
+bool filesystemImpl::listFiles(const char *path, std::vector<FileInfo> &out) {
+    std::error_code ec;
+    fs::directory_iterator iter(fs::path(path), ec), end;
+
+    for (; !ec && iter != end; iter.increment(ec)) {
+        const fs::path &filePath = iter->path();
+        std::error_code fileEc;
+
+        if (!fs::is_regular_file(filePath, fileEc))
+            continue;
+
+        FileInfo info;
+        info.path = filePath.string();
+        info.size = fs::file_size(filePath, fileEc);
+        info.modified = fs::last_write_time(filePath, fileEc).time_since_epoch().count();
+
+        if (!fileEc)
+            out.push_back(info);
+    }
+
+    return !ec;
+}
+
+bool filesystemImpl::touchFile(const char *path) {
+    std::error_code ec;
+    fs::last_write_time(fs::path(path), fs::file_time_type::clock::now(), ec);
+    return !ec;
+}
+
+bool filesystemImpl::removeFile(const char *path) {
+    std::error_code ec;
+    return fs::remove(fs::path(path), ec);
+}
+
 
 // https://stackoverflow.com/questions/2912520/read-file-contents-into-a-string-in-c
 std::string filesystemImpl::contentsOfFileAsString(const char *path) {
@@ -9,11 +9,31 @@
 #define filesystemImpl_h
 
 #include <string>
+#include <vector>
+#include <stdint.h>
 #include <SDL_video.h>
 
 namespace filesystemImpl {
+struct FileInfo {
+    std::string path;
+    uint64_t size;
+    // Only meaningful compared to other modification times
+    int64_t modified;
+};
+
 bool fileExists(const char *path);
 
+// Creates the directory and any missing parents
+bool createDirectory(const char *path);
+
+// Lists the regular files directly inside a directory
+bool listFiles(const char *path, std::vector<FileInfo> &out);
+
+// Sets the file's modification time to now
+bool touchFile(const char *path);
+
+bool removeFile(const char *path);
+
 std::string contentsOfFileAsString(const char *path);
 
 bool setCurrentDirectory(const char *path);
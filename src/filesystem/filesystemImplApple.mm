@@ -22,6 +22,40 @@ bool filesystemImpl::fileExists(const char *path) {
     return  [NSFileManager.defaultManager fileExistsAtPath:PATHTONS(path) isDirectory: &isDir] && !isDir;
 }
 
+bool filesystemImpl::createDirectory(const char *path) {
+    return [NSFileManager.defaultManager createDirectoryAtPath:PATHTONS(path) withIntermediateDirectories:YES attributes:nil error:nil];
+}
+
+bool filesystemImpl::listFiles(const char *path, std::vector<FileInfo> &out) {
+    NSString *dir = PATHTONS(path);
+    NSArray *names = [NSFileManager.defaultManager contentsOfDirectoryAtPath:dir error:nil];
+    if (names == nil)
+        return false;
+    
+    for (NSString *name in names) {
+        NSString *file = [dir stringByAppendingPathComponent:name];
+        NSDictionary *attrs = [NSFileManager.defaultManager attributesOfItemAtPath:file error:nil];
+        if (attrs == nil || ![attrs.fileType isEqualToString:NSFileTypeRegular])
+            continue;
+        
+        FileInfo info;
+        info.path = std::string(NSTOPATH(file));
+        info.size = attrs.fileSize;
+        info.modified = (int64_t)(attrs.fileModificationDate.timeIntervalSince1970 * 1000);
+        out.push_back(info);
+    }
+    
+    return true;
+}
+
+bool filesystemImpl::touchFile(const char *path) {
+    return [NSFileManager.defaultManager setAttributes:@{NSFileModificationDate: [NSDate date]} ofItemAtPath:PATHTONS(path) error:nil];
+}
+
+bool filesystemImpl::removeFile(const char *path) {
+    return [NSFileManager.defaultManager removeItemAtPath:PATHTONS(path) error:nil];
+}
+
 
 
 std::string filesystemImpl::contentsOfFileAsString(const char *path) {
@@ -238,6 +238,22 @@ int main(int argc, char *argv[]) {
     /* now we load the config */
     Config conf;
     conf.read(argc, argv);
+    
+    /* SDL was initialized before the config could be read,
+     * so switch video over to the offscreen driver now */
+    if (conf.headless.enabled) {
+      SDL_QuitSubSystem(SDL_INIT_VIDEO);
+      SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+      
+      if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0) {
+        showInitError(std::string("Error initializing headless video: ") + SDL_GetError());
+        SDL_Quit();
+        return 0;
+      }
+      
+      /* Don't override a backend picked explicitly */
+      SDL_setenv("ALSOFT_DRIVERS", "null", 0);
+    }
 
 #if defined(__WIN32__)
     // Create a debug console in debug mode
@@ -325,6 +341,8 @@ int main(int argc, char *argv[]) {
       winFlags |= SDL_WINDOW_RESIZABLE;
     if (conf.fullscreen)
       winFlags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
+    if (conf.headless.enabled)
+      winFlags |= SDL_WINDOW_HIDDEN;
     
 #ifdef GLES2_HEADER
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
@@ -34,6 +34,11 @@
 #include "gl-util.h"
 #include "global-ibo.h"
 #include "quad.h"
+#include "spritebatch.h"
+#include "glyphatlas.h"
+#include "bitmaploader.h"
+#include "imagewriter.h"
+#include "datawriter.h"
 #include "binding.h"
 #include "exception.h"
 #include "sharedmidistate.h"
@@ -72,6 +77,8 @@ struct SharedStatePrivate
 	RGSSThreadData &rtData;
 	Config &config;
 
+	BitmapLoader bitmapLoader;
+
 	SharedMidiState midiState;
 
 	Graphics graphics;
@@ -97,6 +104,14 @@ struct SharedStatePrivate
 
 	Quad gpQuad;
 
+	SpriteBatch spriteBatch;
+
+	GlyphAtlas glyphAtlas;
+
+	ImageWriter imageWriter;
+
+	DataWriter dataWriter;
+
 	unsigned int stampCounter;
     
     std::chrono::time_point<std::chrono::steady_clock> startupTime;
@@ -104,15 +119,18 @@ struct SharedStatePrivate
 	SharedStatePrivate(RGSSThreadData *threadData)
 	    : bindingData(0),
 	      sdlWindow(threadData->window),
-	      fileSystem(threadData->argv0, threadData->config.allowSymlinks),
+	      fileSystem(threadData->argv0, threadData->config.allowSymlinks,
+	                 threadData->config.mmapArchives),
 	      eThread(*threadData->ethread),
 	      rtData(*threadData),
 	      config(threadData->config),
+	      bitmapLoader(threadData->config),
 	      midiState(threadData->config),
 	      graphics(threadData),
 	      input(*threadData),
 	      audio(*threadData),
 	      _glState(threadData->config),
+	      texPool((size_t) threadData->config.texturePoolSize * 1000000),
 	      fontState(threadData->config),
 	      stampCounter(0)
 	{
@@ -241,6 +259,11 @@ GSATT(GLState&, _glState)
 GSATT(ShaderSet&, shaders)
 GSATT(TexPool&, texPool)
 GSATT(Quad&, gpQuad)
+GSATT(SpriteBatch&, spriteBatch)
+GSATT(GlyphAtlas&, glyphAtlas)
+GSATT(BitmapLoader&, bitmapLoader)
+GSATT(ImageWriter&, imageWriter)
+GSATT(DataWriter&, dataWriter)
 GSATT(SharedFontState&, fontState)
 GSATT(SharedMidiState&, midiState)
 
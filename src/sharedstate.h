@@ -34,6 +34,8 @@ struct GlobalIBO;
 struct SDL_Window;
 struct TEXFBO;
 struct Quad;
+struct SpriteBatch;
+class GlyphAtlas;
 struct ShaderSet;
 
 class Scene;
@@ -44,6 +46,9 @@ class Input;
 class Audio;
 class GLState;
 class TexPool;
+class BitmapLoader;
+class ImageWriter;
+class DataWriter;
 class Font;
 class SharedFontState;
 struct GlobalIBO;
@@ -77,6 +82,14 @@ struct SharedState
 
 	TexPool &texPool() const;
 
+	BitmapLoader &bitmapLoader() const;
+
+	/* Asynchronous Bitmap#to_file / Graphics.screenshot */
+	ImageWriter &imageWriter() const;
+
+	/* save_data_async */
+	DataWriter &dataWriter() const;
+
 	SharedFontState &fontState() const;
 	Font &defaultFont() const;
 	SharedMidiState &midiState() const;
@@ -101,6 +114,12 @@ struct SharedState
 
 	Quad &gpQuad() const;
 
+	/* Shared batcher for consecutive sprite draws */
+	SpriteBatch &spriteBatch() const;
+
+	/* Glyph cache for Bitmap#draw_text */
+	GlyphAtlas &glyphAtlas() const;
+
 	/* Basically just a simple "TexPool"
 	 * replacement for Tilemap atlas use */
 	void requestAtlasTex(int w, int h, TEXFBO &out);
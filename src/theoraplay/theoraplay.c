@@ -102,6 +102,9 @@ static unsigned char *ConvertVideoFrame420ToIYUV(const th_info *tinfo,
 #undef THEORAPLAY_CVT_RGB_ALPHA
 #undef THEORAPLAY_CVT_FNNAME_420
 
+// RGBA, vectorized
+#include "theoraplay_cvtsimd.h"
+
 
 typedef struct TheoraDecoder
 {
@@ -630,8 +633,8 @@ THEORAPLAY_Decoder *THEORAPLAY_startDecode(THEORAPLAY_Io *io,
         VIDCVT(YV12)
         VIDCVT(IYUV)
         VIDCVT(RGB)
-        VIDCVT(RGBA)
         #undef VIDCVT
+        case THEORAPLAY_VIDFMT_RGBA: vidcvt = GetRGBAConverter(); break;
         default: goto startdecode_failed;  // invalid/unsupported format.
     } // switch
 
@@ -661,6 +664,19 @@ startdecode_failed:
 } // THEORAPLAY_startDecode
 
 
+int THEORAPLAY_setRGBAConverter(THEORAPLAY_Converter cvt)
+{
+    return SetRGBAConverter(cvt);
+} // THEORAPLAY_setRGBAConverter
+
+
+const char *THEORAPLAY_getRGBAConverterName(void)
+{
+    GetRGBAConverter();
+    return rgbacvtname;
+} // THEORAPLAY_getRGBAConverterName
+
+
 void THEORAPLAY_stopDecode(THEORAPLAY_Decoder *decoder)
 {
     TheoraDecoder *ctx = (TheoraDecoder *) decoder;
@@ -75,6 +75,22 @@ void THEORAPLAY_freeAudio(const THEORAPLAY_AudioPacket *item);
 const THEORAPLAY_VideoFrame *THEORAPLAY_getVideo(THEORAPLAY_Decoder *decoder);
 void THEORAPLAY_freeVideo(const THEORAPLAY_VideoFrame *item);
 
+/* Implementations of the THEORAPLAY_VIDFMT_RGBA conversion. By default
+   the fastest one the CPU supports is picked. */
+typedef enum THEORAPLAY_Converter
+{
+    THEORAPLAY_CVT_AUTO,
+    THEORAPLAY_CVT_SCALAR,
+    THEORAPLAY_CVT_SSE2,
+    THEORAPLAY_CVT_AVX2,
+    THEORAPLAY_CVT_NEON
+} THEORAPLAY_Converter;
+
+/* Applies to decoders started afterwards (meant for benchmarking).
+   Returns zero if the build or the CPU doesn't support 'cvt'. */
+int THEORAPLAY_setRGBAConverter(THEORAPLAY_Converter cvt);
+const char *THEORAPLAY_getRGBAConverterName(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,382 @@
+/**
+ * TheoraPlay; multithreaded Ogg Theora/Ogg Vorbis decoding.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ *  SIMD versions of the 4:2:0 -> RGBA converter in theoraplay_cvtrgb.h.
+ */
+
+#if !THEORAPLAY_INTERNAL
+#error Do not include this in your app. It is used internally by TheoraPlay.
+#endif
+
+#include <SDL_cpuinfo.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define THEORAPLAY_HAVE_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(__GNUC__)
+#define THEORAPLAY_TARGET_SSE2 __attribute__((target("sse2")))
+#define THEORAPLAY_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define THEORAPLAY_TARGET_SSE2
+#define THEORAPLAY_TARGET_AVX2
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define THEORAPLAY_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// The same conversion as theoraplay_cvtrgb.h, in 16-bit fixed point so
+//  eight (SSE2, NEON) or sixteen (AVX2) pixels fit in a register.
+//  Inputs are centered and scaled up by 2^7, multiplied by the Q14
+//  coefficients below keeping the high 16 bits, which leaves the
+//  channels in Q5. Every path (including the scalar tail) does exactly
+//  the same integer math, so they agree bit for bit; they can be off by
+//  one from the float converter, which rounds slightly differently.
+#define CVT_Y_MUL   19077   // 255/219
+#define CVT_R_CR    26149   // 2(1-kr) * 255/224
+#define CVT_G_CB     6419   // 2((1-kb)kb/((1-kb)-kr)) * 255/224
+#define CVT_G_CR    13320   // 2((1-kr)kr/((1-kb)-kr)) * 255/224
+#define CVT_B_CB_1  16666   // 2(1-kb) * 255/224, minus one (doesn't fit Q14)
+
+typedef void (*ConvertRowRGBAFn)(const unsigned char *py,
+                                 const unsigned char *pcb,
+                                 const unsigned char *pcr,
+                                 unsigned char *dst, int pairs);
+
+static inline int CvtMulHi(const int a, const int b)
+{
+    return (a * b) >> 16;
+} // CvtMulHi
+
+static inline unsigned char CvtClampQ5(const int v)
+{
+    const int c = v >> 5;
+    return (unsigned char) ((c < 0) ? 0 : (c > 255) ? 255 : c);
+} // CvtClampQ5
+
+// Converts 'pairs' horizontal pixel pairs, which share one chroma sample.
+static void ConvertRowRGBAFixed(const unsigned char *py,
+                                const unsigned char *pcb,
+                                const unsigned char *pcr,
+                                unsigned char *dst, int pairs)
+{
+    int i;
+    for (i = 0; i < pairs; i++)
+    {
+        const int cb = (((int) pcb[i]) - 128) * 128;
+        const int cr = (((int) pcr[i]) - 128) * 128;
+        const int rc = CvtMulHi(cr, CVT_R_CR);
+        const int gc = CvtMulHi(cb, CVT_G_CB) + CvtMulHi(cr, CVT_G_CR);
+        const int bc = CvtMulHi(cb, CVT_B_CB_1) + (cb >> 2);
+        int j;
+
+        for (j = 0; j < 2; j++)
+        {
+            const int y = CvtMulHi((((int) py[i*2+j]) - 16) * 128, CVT_Y_MUL);
+            *(dst++) = CvtClampQ5(y + rc);
+            *(dst++) = CvtClampQ5(y - gc);
+            *(dst++) = CvtClampQ5(y + bc);
+            *(dst++) = 0xFF;
+        } // for
+    } // for
+} // ConvertRowRGBAFixed
+
+// Same frame walk as theoraplay_cvtrgb.h, a row at a time.
+static unsigned char *ConvertVideoFrame420ToRGBARows(const th_info *tinfo,
+                                                     const th_ycbcr_buffer ycbcr,
+                                                     ConvertRowRGBAFn cvtrow)
+{
+    const int w = tinfo->pic_width;
+    const int h = tinfo->pic_height;
+    const int halfw = w / 2;
+    unsigned char *pixels = (unsigned char *) malloc(w * h * 4);
+
+    if (pixels)
+    {
+        unsigned char *dst = pixels;
+        const int ystride = ycbcr[0].stride;
+        const int cbstride = ycbcr[1].stride;
+        const int crstride = ycbcr[2].stride;
+        const int yoff = (tinfo->pic_x & ~1) + ystride * (tinfo->pic_y & ~1);
+        const int cboff = (tinfo->pic_x / 2) + (cbstride) * (tinfo->pic_y / 2);
+        const unsigned char *py = ycbcr[0].data + yoff;
+        const unsigned char *pcb = ycbcr[1].data + cboff;
+        const unsigned char *pcr = ycbcr[2].data + cboff;
+        int posy;
+
+        for (posy = 0; posy < h; posy++)
+        {
+            cvtrow(py, pcb, pcr, dst, halfw);
+            dst += halfw * 8;
+
+            // adjust to the start of the next line.
+            py += ystride;
+            pcb += cbstride * (posy % 2);
+            pcr += crstride * (posy % 2);
+        } // for
+    } // if
+
+    return pixels;
+} // ConvertVideoFrame420ToRGBARows
+
+
+#if THEORAPLAY_HAVE_X86
+THEORAPLAY_TARGET_SSE2
+static void ConvertRowRGBASSE2(const unsigned char *py,
+                               const unsigned char *pcb,
+                               const unsigned char *pcr,
+                               unsigned char *dst, int pairs)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8((char) 0xFF);
+    const __m128i yoffset = _mm_set1_epi16(16);
+    const __m128i coffset = _mm_set1_epi16(128);
+    const __m128i ymul = _mm_set1_epi16(CVT_Y_MUL);
+    const __m128i rcr = _mm_set1_epi16(CVT_R_CR);
+    const __m128i gcb = _mm_set1_epi16(CVT_G_CB);
+    const __m128i gcr = _mm_set1_epi16(CVT_G_CR);
+    const __m128i bcb = _mm_set1_epi16(CVT_B_CB_1);
+    int i = 0;
+
+    // 16 pixels per round.
+    for (; i + 8 <= pairs; i += 8)
+    {
+        const __m128i y8 = _mm_loadu_si128((const __m128i *) (py + i*2));
+        const __m128i cb8 = _mm_loadl_epi64((const __m128i *) (pcb + i));
+        const __m128i cr8 = _mm_loadl_epi64((const __m128i *) (pcr + i));
+
+        const __m128i ylo = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(y8, zero), yoffset), 7), ymul);
+        const __m128i yhi = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(y8, zero), yoffset), 7), ymul);
+        const __m128i cb = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(cb8, zero), coffset), 7);
+        const __m128i cr = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(cr8, zero), coffset), 7);
+
+        // chroma terms, one per pixel pair; G's is negated so all channels add.
+        const __m128i rc = _mm_mulhi_epi16(cr, rcr);
+        const __m128i gc = _mm_sub_epi16(zero, _mm_add_epi16(_mm_mulhi_epi16(cb, gcb), _mm_mulhi_epi16(cr, gcr)));
+        const __m128i bc = _mm_add_epi16(_mm_mulhi_epi16(cb, bcb), _mm_srai_epi16(cb, 2));
+
+        #define CVT_SSE2_CHANNEL(c) _mm_packus_epi16( \
+            _mm_srai_epi16(_mm_add_epi16(ylo, _mm_unpacklo_epi16(c, c)), 5), \
+            _mm_srai_epi16(_mm_add_epi16(yhi, _mm_unpackhi_epi16(c, c)), 5))
+        const __m128i r = CVT_SSE2_CHANNEL(rc);
+        const __m128i g = CVT_SSE2_CHANNEL(gc);
+        const __m128i b = CVT_SSE2_CHANNEL(bc);
+        #undef CVT_SSE2_CHANNEL
+
+        const __m128i rglo = _mm_unpacklo_epi8(r, g);
+        const __m128i rghi = _mm_unpackhi_epi8(r, g);
+        const __m128i balo = _mm_unpacklo_epi8(b, alpha);
+        const __m128i bahi = _mm_unpackhi_epi8(b, alpha);
+        __m128i *out = (__m128i *) (dst + i*8);
+
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rglo, balo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rglo, balo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rghi, bahi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rghi, bahi));
+    } // for
+
+    ConvertRowRGBAFixed(py + i*2, pcb + i, pcr + i, dst + i*8, pairs - i);
+} // ConvertRowRGBASSE2
+
+THEORAPLAY_TARGET_AVX2
+static void ConvertRowRGBAAVX2(const unsigned char *py,
+                               const unsigned char *pcb,
+                               const unsigned char *pcr,
+                               unsigned char *dst, int pairs)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi8((char) 0xFF);
+    const __m256i yoffset = _mm256_set1_epi16(16);
+    const __m256i coffset = _mm256_set1_epi16(128);
+    const __m256i ymul = _mm256_set1_epi16(CVT_Y_MUL);
+    const __m256i rcr = _mm256_set1_epi16(CVT_R_CR);
+    const __m256i gcb = _mm256_set1_epi16(CVT_G_CB);
+    const __m256i gcr = _mm256_set1_epi16(CVT_G_CR);
+    const __m256i bcb = _mm256_set1_epi16(CVT_B_CB_1);
+    int i = 0;
+
+    // 32 pixels per round. Unpacks only work within 128-bit lanes, so
+    //  values get shuffled across them where the order matters.
+    for (; i + 16 <= pairs; i += 16)
+    {
+        const __m256i y0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (py + i*2)));
+        const __m256i y1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (py + i*2 + 16)));
+        const __m256i cb16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (pcb + i)));
+        const __m256i cr16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (pcr + i)));
+
+        const __m256i ylo = _mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y0, yoffset), 7), ymul);
+        const __m256i yhi = _mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y1, yoffset), 7), ymul);
+        const __m256i cb = _mm256_slli_epi16(_mm256_sub_epi16(cb16, coffset), 7);
+        const __m256i cr = _mm256_slli_epi16(_mm256_sub_epi16(cr16, coffset), 7);
+
+        // chroma terms, reordered (0,2,1,3 by 64 bits) so that unpacking
+        //  them with themselves doubles them up in pixel order.
+        const __m256i rc = _mm256_permute4x64_epi64(_mm256_mulhi_epi16(cr, rcr), 0xD8);
+        const __m256i gc = _mm256_permute4x64_epi64(_mm256_sub_epi16(zero, _mm256_add_epi16(_mm256_mulhi_epi16(cb, gcb), _mm256_mulhi_epi16(cr, gcr))), 0xD8);
+        const __m256i bc = _mm256_permute4x64_epi64(_mm256_add_epi16(_mm256_mulhi_epi16(cb, bcb), _mm256_srai_epi16(cb, 2)), 0xD8);
+
+        // packing leaves pixels 0-7, 16-23 | 8-15, 24-31 ...
+        #define CVT_AVX2_CHANNEL(c) _mm256_packus_epi16( \
+            _mm256_srai_epi16(_mm256_add_epi16(ylo, _mm256_unpacklo_epi16(c, c)), 5), \
+            _mm256_srai_epi16(_mm256_add_epi16(yhi, _mm256_unpackhi_epi16(c, c)), 5))
+        const __m256i r = CVT_AVX2_CHANNEL(rc);
+        const __m256i g = CVT_AVX2_CHANNEL(gc);
+        const __m256i b = CVT_AVX2_CHANNEL(bc);
+        #undef CVT_AVX2_CHANNEL
+
+        // ... so these hold pixels 0-7 | 8-15 and 16-23 | 24-31 ...
+        const __m256i rglo = _mm256_unpacklo_epi8(r, g);
+        const __m256i rghi = _mm256_unpackhi_epi8(r, g);
+        const __m256i balo = _mm256_unpacklo_epi8(b, alpha);
+        const __m256i bahi = _mm256_unpackhi_epi8(b, alpha);
+
+        // ... and these 0-3 | 8-11, 4-7 | 12-15, 16-19 | 24-27, 20-23 | 28-31.
+        const __m256i q0 = _mm256_unpacklo_epi16(rglo, balo);
+        const __m256i q1 = _mm256_unpackhi_epi16(rglo, balo);
+        const __m256i q2 = _mm256_unpacklo_epi16(rghi, bahi);
+        const __m256i q3 = _mm256_unpackhi_epi16(rghi, bahi);
+        __m256i *out = (__m256i *) (dst + i*8);
+
+        _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(q0, q1, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(q0, q1, 0x31));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(q2, q3, 0x20));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(q2, q3, 0x31));
+    } // for
+
+    ConvertRowRGBASSE2(py + i*2, pcb + i, pcr + i, dst + i*8, pairs - i);
+} // ConvertRowRGBAAVX2
+
+static unsigned char *ConvertVideoFrame420ToRGBASSE2(const th_info *tinfo,
+                                                     const th_ycbcr_buffer ycbcr)
+{
+    return ConvertVideoFrame420ToRGBARows(tinfo, ycbcr, ConvertRowRGBASSE2);
+} // ConvertVideoFrame420ToRGBASSE2
+
+static unsigned char *ConvertVideoFrame420ToRGBAAVX2(const th_info *tinfo,
+                                                     const th_ycbcr_buffer ycbcr)
+{
+    return ConvertVideoFrame420ToRGBARows(tinfo, ycbcr, ConvertRowRGBAAVX2);
+} // ConvertVideoFrame420ToRGBAAVX2
+#endif
+
+
+#if THEORAPLAY_HAVE_NEON
+static inline int16x8_t CvtMulHiNEON(const int16x8_t a, const int16_t b)
+{
+    return vcombine_s16(vshrn_n_s32(vmull_n_s16(vget_low_s16(a), b), 16),
+                        vshrn_n_s32(vmull_n_s16(vget_high_s16(a), b), 16));
+} // CvtMulHiNEON
+
+static inline int16x8_t CvtWidenNEON(const uint8x8_t v, const int16_t offset)
+{
+    return vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v)), vdupq_n_s16(offset)), 7);
+} // CvtWidenNEON
+
+static void ConvertRowRGBANEON(const unsigned char *py,
+                               const unsigned char *pcb,
+                               const unsigned char *pcr,
+                               unsigned char *dst, int pairs)
+{
+    int i = 0;
+
+    // 16 pixels per round.
+    for (; i + 8 <= pairs; i += 8)
+    {
+        const uint8x16_t y8 = vld1q_u8(py + i*2);
+        const int16x8_t ylo = CvtMulHiNEON(CvtWidenNEON(vget_low_u8(y8), 16), CVT_Y_MUL);
+        const int16x8_t yhi = CvtMulHiNEON(CvtWidenNEON(vget_high_u8(y8), 16), CVT_Y_MUL);
+        const int16x8_t cb = CvtWidenNEON(vld1_u8(pcb + i), 128);
+        const int16x8_t cr = CvtWidenNEON(vld1_u8(pcr + i), 128);
+
+        // chroma terms doubled up in pixel order; G's is negated so all channels add.
+        const int16x8_t rsum = CvtMulHiNEON(cr, CVT_R_CR);
+        const int16x8x2_t rc = vzipq_s16(rsum, rsum);
+        const int16x8_t gsum = vnegq_s16(vaddq_s16(CvtMulHiNEON(cb, CVT_G_CB), CvtMulHiNEON(cr, CVT_G_CR)));
+        const int16x8x2_t gc = vzipq_s16(gsum, gsum);
+        const int16x8_t bsum = vaddq_s16(CvtMulHiNEON(cb, CVT_B_CB_1), vshrq_n_s16(cb, 2));
+        const int16x8x2_t bc = vzipq_s16(bsum, bsum);
+
+        uint8x16x4_t rgba;
+        rgba.val[0] = vcombine_u8(vqshrun_n_s16(vaddq_s16(ylo, rc.val[0]), 5), vqshrun_n_s16(vaddq_s16(yhi, rc.val[1]), 5));
+        rgba.val[1] = vcombine_u8(vqshrun_n_s16(vaddq_s16(ylo, gc.val[0]), 5), vqshrun_n_s16(vaddq_s16(yhi, gc.val[1]), 5));
+        rgba.val[2] = vcombine_u8(vqshrun_n_s16(vaddq_s16(ylo, bc.val[0]), 5), vqshrun_n_s16(vaddq_s16(yhi, bc.val[1]), 5));
+        rgba.val[3] = vdupq_n_u8(0xFF);
+
+        vst4q_u8(dst + i*8, rgba);
+    } // for
+
+    ConvertRowRGBAFixed(py + i*2, pcb + i, pcr + i, dst + i*8, pairs - i);
+} // ConvertRowRGBANEON
+
+static unsigned char *ConvertVideoFrame420ToRGBANEON(const th_info *tinfo,
+                                                     const th_ycbcr_buffer ycbcr)
+{
+    return ConvertVideoFrame420ToRGBARows(tinfo, ycbcr, ConvertRowRGBANEON);
+} // ConvertVideoFrame420ToRGBANEON
+#endif
+
+
+static ConvertVideoFrameFn rgbacvt = NULL;
+static const char *rgbacvtname = NULL;
+
+static int SetRGBAConverter(const THEORAPLAY_Converter cvt)
+{
+    switch (cvt)
+    {
+        case THEORAPLAY_CVT_AUTO:
+            #if THEORAPLAY_HAVE_X86
+            if (SetRGBAConverter(THEORAPLAY_CVT_AVX2)) return 1;
+            if (SetRGBAConverter(THEORAPLAY_CVT_SSE2)) return 1;
+            #endif
+            #if THEORAPLAY_HAVE_NEON
+            if (SetRGBAConverter(THEORAPLAY_CVT_NEON)) return 1;
+            #endif
+            return SetRGBAConverter(THEORAPLAY_CVT_SCALAR);
+
+        case THEORAPLAY_CVT_SCALAR:
+            rgbacvt = ConvertVideoFrame420ToRGBA;
+            rgbacvtname = "scalar";
+            return 1;
+
+        #if THEORAPLAY_HAVE_X86
+        case THEORAPLAY_CVT_SSE2:
+            if (!SDL_HasSSE2()) return 0;
+            rgbacvt = ConvertVideoFrame420ToRGBASSE2;
+            rgbacvtname = "SSE2";
+            return 1;
+
+        case THEORAPLAY_CVT_AVX2:
+            if (!SDL_HasAVX2()) return 0;
+            rgbacvt = ConvertVideoFrame420ToRGBAAVX2;
+            rgbacvtname = "AVX2";
+            return 1;
+        #endif
+
+        #if THEORAPLAY_HAVE_NEON
+        case THEORAPLAY_CVT_NEON:
+            if (!SDL_HasNEON()) return 0;
+            rgbacvt = ConvertVideoFrame420ToRGBANEON;
+            rgbacvtname = "NEON";
+            return 1;
+        #endif
+
+        default: break;
+    } // switch
+
+    return 0;  // not built for this CPU.
+} // SetRGBAConverter
+
+static ConvertVideoFrameFn GetRGBAConverter(void)
+{
+    if (rgbacvt == NULL)
+        SetRGBAConverter(THEORAPLAY_CVT_AUTO);
+    return rgbacvt;
+} // GetRGBAConverter
+
+// end of theoraplay_cvtsimd.h ...
+
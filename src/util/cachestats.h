@@ -0,0 +1,45 @@
+/*
+** cachestats.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CACHESTATS_H
+#define CACHESTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Counters common to all of the engine's caches. Caches
+ * with more to report extend this */
+struct CacheStats
+{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t entries;
+
+	CacheStats()
+	    : hits(0),
+	      misses(0),
+	      evictions(0),
+	      entries(0)
+	{}
+};
+
+#endif // CACHESTATS_H
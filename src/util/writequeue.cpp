@@ -0,0 +1,236 @@
+/*
+** writequeue.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "writequeue.h"
+
+#include "boost-hash.h"
+#include "sdl-util.h"
+#include "debugwriter.h"
+
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#include <SDL_error.h>
+
+#include <deque>
+
+/* Finished jobs whose handle nobody polls are
+ * forgotten once there are more than this */
+#define MAX_UNPOLLED_JOBS 64
+
+struct WriteQueuePrivate
+{
+	SDL_Thread *worker;
+
+	SDL_mutex *mutex;
+	/* Signalled when a job is queued, or on shutdown */
+	SDL_cond *workCond;
+	/* Broadcast whenever a job finishes */
+	SDL_cond *doneCond;
+
+	/* Jobs waiting to be run */
+	std::deque<QueuedJob*> queue;
+	/* Every job whose result wasn't picked up yet */
+	BoostHash<int, QueuedJob*> jobs;
+	/* Finished jobs of the above, oldest first */
+	IntruList<QueuedJob> unpolled;
+
+	int nextHandle;
+	size_t active;
+	bool quit;
+
+	WriteQueuePrivate()
+	    : worker(0),
+	      nextHandle(1),
+	      active(0),
+	      quit(false)
+	{
+		mutex = SDL_CreateMutex();
+		workCond = SDL_CreateCond();
+		doneCond = SDL_CreateCond();
+	}
+
+	~WriteQueuePrivate()
+	{
+		SDL_DestroyCond(doneCond);
+		SDL_DestroyCond(workCond);
+		SDL_DestroyMutex(mutex);
+	}
+
+	/* Called with the lock held */
+	void markDone(QueuedJob *job)
+	{
+		job->done = true;
+		unpolled.append(job->link);
+
+		/* Don't keep results around forever for callers
+		 * that never look at their handles */
+		while (unpolled.getSize() > MAX_UNPOLLED_JOBS)
+		{
+			QueuedJob *old = unpolled.begin()->data;
+			unpolled.remove(old->link);
+			jobs.remove(old->handle);
+
+			if (old->failed)
+				Debug() << old->error;
+
+			delete old;
+		}
+	}
+
+	void workerFun()
+	{
+		SDL_LockMutex(mutex);
+
+		while (true)
+		{
+			while (queue.empty() && !quit)
+				SDL_CondWait(workCond, mutex);
+
+			/* Run everything before quitting */
+			if (queue.empty())
+				break;
+
+			QueuedJob *job = queue.front();
+			queue.pop_front();
+			++active;
+
+			SDL_UnlockMutex(mutex);
+			job->run();
+			SDL_LockMutex(mutex);
+
+			markDone(job);
+			--active;
+
+			SDL_CondBroadcast(doneCond);
+		}
+
+		SDL_UnlockMutex(mutex);
+	}
+};
+
+WriteQueue::WriteQueue(const char *threadName)
+{
+	p = new WriteQueuePrivate;
+
+	p->worker = createSDLThread
+		<WriteQueuePrivate, &WriteQueuePrivate::workerFun>(p, threadName);
+
+	if (!p->worker)
+		Debug() << "Failed to start" << threadName << "thread:" << SDL_GetError();
+}
+
+WriteQueue::~WriteQueue()
+{
+	waitAll();
+
+	SDL_LockMutex(p->mutex);
+	p->quit = true;
+	SDL_CondBroadcast(p->workCond);
+	SDL_UnlockMutex(p->mutex);
+
+	if (p->worker)
+		SDL_WaitThread(p->worker, 0);
+
+	for (BoostHash<int, QueuedJob*>::const_iterator iter = p->jobs.cbegin();
+	     iter != p->jobs.cend(); ++iter)
+	{
+		p->unpolled.remove(iter->second->link);
+		delete iter->second;
+	}
+
+	delete p;
+}
+
+int WriteQueue::add(QueuedJob *job)
+{
+	SDL_LockMutex(p->mutex);
+
+	job->handle = p->nextHandle++;
+	p->jobs.insert(job->handle, job);
+
+	SDL_UnlockMutex(p->mutex);
+
+	return job->handle;
+}
+
+void WriteQueue::enqueue(QueuedJob *job)
+{
+	SDL_LockMutex(p->mutex);
+
+	/* Without a worker, run it right away */
+	if (!p->worker)
+	{
+		SDL_UnlockMutex(p->mutex);
+		job->run();
+		SDL_LockMutex(p->mutex);
+
+		p->markDone(job);
+	}
+	else
+	{
+		p->queue.push_back(job);
+		SDL_CondSignal(p->workCond);
+	}
+
+	SDL_UnlockMutex(p->mutex);
+}
+
+bool WriteQueue::finished(int handle, bool &failed, std::string &error)
+{
+	SDL_LockMutex(p->mutex);
+
+	QueuedJob *job = p->jobs.value(handle, 0);
+
+	if (!job)
+	{
+		SDL_UnlockMutex(p->mutex);
+
+		failed = false;
+		return true;
+	}
+
+	if (!job->done)
+	{
+		SDL_UnlockMutex(p->mutex);
+		return false;
+	}
+
+	p->jobs.remove(handle);
+	p->unpolled.remove(job->link);
+
+	SDL_UnlockMutex(p->mutex);
+
+	failed = job->failed;
+	error = job->error;
+	delete job;
+
+	return true;
+}
+
+void WriteQueue::waitAll()
+{
+	SDL_LockMutex(p->mutex);
+
+	while (!p->queue.empty() || p->active > 0)
+		SDL_CondWait(p->doneCond, p->mutex);
+
+	SDL_UnlockMutex(p->mutex);
+}
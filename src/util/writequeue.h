@@ -0,0 +1,93 @@
+/*
+** writequeue.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WRITEQUEUE_H
+#define WRITEQUEUE_H
+
+#include "intrulist.h"
+
+#include <string>
+
+struct WriteQueuePrivate;
+
+/* A unit of work run by a WriteQueue. Subclasses
+ * carry the data and implement run() */
+struct QueuedJob
+{
+	int handle;
+
+	bool done;
+	bool failed;
+	/* Should name the file concerned, as it may end up in the log */
+	std::string error;
+
+	/* Link into the list of unpolled finished jobs */
+	IntruListLink<QueuedJob> link;
+
+	QueuedJob()
+	    : handle(0),
+	      done(false),
+	      failed(false),
+	      link(this)
+	{}
+
+	virtual ~QueuedJob() {}
+
+	/* Runs on the worker thread. Sets 'failed' and
+	 * 'error' if the job couldn't be carried out */
+	virtual void run() = 0;
+};
+
+/* Runs jobs on a worker thread, one after another in the order they
+ * were enqueued (or right away if the thread failed to start).
+ * Every job is identified by a handle to poll for its result.
+ * Results are only kept for the latest finished jobs; older ones
+ * nobody polled are dropped, and their failures logged */
+class WriteQueue
+{
+public:
+	WriteQueue(const char *threadName);
+
+	/* Runs every enqueued job before returning */
+	~WriteQueue();
+
+	/* Takes over 'job' and returns its new handle.
+	 * It won't run until passed to enqueue() */
+	int add(QueuedJob *job);
+
+	/* Queues a job returned by add(). It may be finished and
+	 * deleted by the time this returns, so don't touch it anymore */
+	void enqueue(QueuedJob *job);
+
+	/* Returns false while 'handle' is pending. Once it's done,
+	 * returns true and forgets about the handle, with 'failed'
+	 * and 'error' describing the result; unknown handles count
+	 * as done and successful */
+	bool finished(int handle, bool &failed, std::string &error);
+
+	/* Blocks until every enqueued job has run */
+	void waitAll();
+
+private:
+	WriteQueuePrivate *p;
+};
+
+#endif // WRITEQUEUE_H
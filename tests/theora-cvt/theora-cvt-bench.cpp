@@ -0,0 +1,176 @@
+/*
+** theora-cvt-bench.cpp
+**
+** Decodes an Ogg Theora file to RGBA with every YUV conversion
+** path (no window, no playback pacing), checks their frames
+** against the scalar converter and reports the frames per second
+** each one sustains. Build from this directory:
+**
+**   cc -O2 -c ../../src/theoraplay/theoraplay.c \
+**       $(pkg-config --cflags theoradec vorbis sdl2)
+**   c++ -O2 -I../../src/theoraplay theora-cvt-bench.cpp theoraplay.o \
+**       $(pkg-config --libs theoradec vorbis ogg sdl2)
+**   ./a.out movie.ogv
+*/
+
+#include "theoraplay.h"
+
+#include <SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+/* Frames kept in flight by the decoder thread */
+static const unsigned int maxFrames = 30;
+
+struct Result
+{
+	int frames;
+	double secs;
+	unsigned int width, height;
+
+	/* First frame, to compare the paths with */
+	std::vector<unsigned char> first;
+};
+
+static bool decode(const char *path, Result &res)
+{
+	THEORAPLAY_Decoder *decoder =
+		THEORAPLAY_startDecodeFile(path, maxFrames, THEORAPLAY_VIDFMT_RGBA);
+
+	if (!decoder)
+	{
+		printf("Failed to open %s\n", path);
+		return false;
+	}
+
+	while (!THEORAPLAY_isInitialized(decoder))
+		SDL_Delay(1);
+
+	if (!THEORAPLAY_hasVideoStream(decoder))
+	{
+		printf("%s has no video stream\n", path);
+		THEORAPLAY_stopDecode(decoder);
+		return false;
+	}
+
+	res.frames = 0;
+
+	Uint64 start = SDL_GetPerformanceCounter();
+
+	while (THEORAPLAY_isDecoding(decoder))
+	{
+		const THEORAPLAY_VideoFrame *video = THEORAPLAY_getVideo(decoder);
+		const THEORAPLAY_AudioPacket *audio = THEORAPLAY_getAudio(decoder);
+
+		if (video)
+		{
+			if (res.frames++ == 0)
+			{
+				res.width = video->width;
+				res.height = video->height;
+				res.first.assign(video->pixels, video->pixels + video->width * video->height * 4);
+			}
+
+			THEORAPLAY_freeVideo(video);
+		}
+
+		if (audio)
+			THEORAPLAY_freeAudio(audio);
+
+		if (!video && !audio)
+			SDL_Delay(0);
+	}
+
+	Uint64 end = SDL_GetPerformanceCounter();
+	res.secs = (double) (end - start) / SDL_GetPerformanceFrequency();
+
+	bool ok = !THEORAPLAY_decodingError(decoder);
+	THEORAPLAY_stopDecode(decoder);
+
+	if (!ok)
+		printf("Decoding %s failed\n", path);
+
+	return ok && res.frames > 0;
+}
+
+/* The vector paths round slightly differently from the float one */
+static bool matches(const Result &ref, const Result &res, size_t &differing)
+{
+	differing = 0;
+
+	if (ref.first.size() != res.first.size())
+		return false;
+
+	for (size_t i = 0; i < ref.first.size(); ++i)
+	{
+		int diff = abs((int) ref.first[i] - (int) res.first[i]);
+
+		if (diff > 1)
+			return false;
+
+		differing += (diff != 0);
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: %s <file.ogv>\n", argv[0]);
+		return 1;
+	}
+
+	struct
+	{
+		const char *name;
+		THEORAPLAY_Converter cvt;
+	} impls[] =
+	{
+		{ "scalar", THEORAPLAY_CVT_SCALAR },
+		{ "SSE2",   THEORAPLAY_CVT_SSE2   },
+		{ "AVX2",   THEORAPLAY_CVT_AVX2   },
+		{ "NEON",   THEORAPLAY_CVT_NEON   },
+		{ "auto",   THEORAPLAY_CVT_AUTO   }
+	};
+
+	const size_t implCount = sizeof(impls) / sizeof(impls[0]);
+
+	Result ref;
+
+	for (size_t i = 0; i < implCount; ++i)
+	{
+		if (!THEORAPLAY_setRGBAConverter(impls[i].cvt))
+		{
+			printf("%-8s not supported\n", impls[i].name);
+			continue;
+		}
+
+		Result res;
+
+		if (!decode(argv[1], res))
+			return 1;
+
+		if (i == 0)
+		{
+			ref = res;
+			printf("%s: %ux%u, %d frames\n", argv[1], res.width, res.height, res.frames);
+		}
+
+		size_t differing;
+
+		if (!matches(ref, res, differing))
+		{
+			printf("%-8s MISMATCH in the first frame\n", impls[i].name);
+			return 1;
+		}
+
+		printf("%-8s %8.1f FPS (%s, %zu bytes off by one)\n", impls[i].name,
+		       res.frames / res.secs, THEORAPLAY_getRGBAConverterName(), differing);
+	}
+
+	return 0;
+}